@@ -0,0 +1,740 @@
+/* Times every stage of the cplot pipeline on deterministic synthetic data and
+ * prints the results as JSON, one benchmark per line. With --baseline, the
+ * results are compared against an earlier run and regressions are reported. */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cplot.h"
+
+#define MAX_RESULTS 256
+#define MIN_SECONDS 0.2
+
+struct result
+{
+  char stage[32];
+  size_t size;
+  size_t iterations;
+  double seconds;		/* fastest iteration */
+  double ns_per_item;
+};
+
+struct bench
+{
+  size_t max_points;
+  size_t max_terms;
+  size_t max_parse_terms;	/* longer expressions are only parsed */
+  struct result results[MAX_RESULTS];
+  size_t nresults;
+};
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t
+next_random (uint64_t * const state)
+{
+  uint64_t x = *state;		/* xorshift64 */
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static double
+uniform (uint64_t * const state)
+{
+  return (next_random (state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void
+record (struct bench *const b, const char *const stage, const size_t size,
+	const size_t iterations, const double seconds, const size_t nitems)
+{
+  if (b->nresults == MAX_RESULTS)
+    return;
+
+  struct result *const r = &b->results[b->nresults++];
+  snprintf (r->stage, sizeof r->stage, "%s", stage);
+  r->size = size;
+  r->iterations = iterations;
+  r->seconds = seconds;
+  r->ns_per_item = nitems ? seconds * 1e9 / nitems : 0;
+
+  printf ("{\"stage\": \"%s\", \"size\": %zu, \"iterations\": %zu, "
+	  "\"seconds\": %.9f, \"ns_per_item\": %.4f}\n", r->stage, r->size,
+	  r->iterations, r->seconds, r->ns_per_item);
+  fflush (stdout);
+}
+
+/* Runs f until MIN_SECONDS have passed and returns the fastest run. */
+#define TIME_STAGE(iterations, best, body)			\
+  do								\
+    {								\
+      const double stage_start = now ();				\
+      best = 1e300;						\
+      iterations = 0;						\
+      do							\
+	{							\
+	  const double t0 = now ();				\
+	  body;							\
+	  const double t = now () - t0;				\
+	  best = t < best ? t : best;				\
+	  ++iterations;						\
+	}							\
+      while (now () - stage_start < MIN_SECONDS);		\
+    }								\
+  while (0)
+
+static point_t *
+make_points (const size_t npoints)
+{
+  point_t *const points = malloc (npoints * sizeof (*points));
+  if (!points)
+    return NULL;
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL ^ npoints;
+  for (size_t i = 0; i < npoints; ++i)
+    {
+      points[i].x = uniform (&state) * 200 - 100;
+      points[i].y = sin (points[i].x) * 10 + uniform (&state) - 0.5;
+    }
+
+  return points;
+}
+
+static char *
+make_expression (const size_t nterms)
+{
+  static const char *const terms[] = {
+    "sin(x*%zu.5)", "x^2/%zu", "cos(x-%zu)", "%zu.25*x", "ln(x*x+%zu)"
+  };
+
+  char *text;
+  size_t len;
+  FILE *const stream = open_memstream (&text, &len);
+  if (!stream)
+    return NULL;
+
+  for (size_t i = 0; i < nterms; ++i)
+    {
+      if (i > 0)
+	fputs (i % 3 ? " + " : " - ", stream);
+      fprintf (stream, terms[i % (sizeof terms / sizeof terms[0])], i + 1);
+    }
+
+  fclose (stream);
+  return text;
+}
+
+static void
+bench_expressions (struct bench *const b)
+{
+  for (size_t nterms = 10;
+       nterms <= b->max_terms || nterms <= b->max_parse_terms; nterms *= 10)
+    {
+      char *const text = make_expression (nterms);
+      if (!text)
+	return;
+      const size_t len = strlen (text);
+
+      size_t iterations;
+      double best;
+      size_t ntokens = 0;
+      TIME_STAGE (iterations, best,
+		  {
+		    tokenizer_t t;
+		    tokenizer_init (&t, text, len);
+		    ntokens = 0;
+		    for (token_t tok = next_token (&t); tok.type != TOKEN_END;
+			 tok = next_token (&t))
+		      {
+			token_destroy (tok);
+			++ntokens;
+		      }
+		  });
+      record (b, "tokenize", nterms, iterations, best, len);
+
+      TIME_STAGE (iterations, best,
+		  {
+		    expression_destroy (parse_expression (text, len));
+		  });
+      record (b, "parse", nterms, iterations, best, ntokens);
+      if (nterms > b->max_terms)
+	{
+	  free (text);
+	  continue;
+	}
+
+      const expression_t exp = parse_expression (text, len);
+      const size_t nevaluations = 1000;
+      volatile double sink = 0;
+      TIME_STAGE (iterations, best,
+		  {
+		    for (size_t i = 0; i < nevaluations; ++i)
+		      sink += evaluate_expression (exp, i * 0.01 + 0.5);
+		  });
+      (void) sink;
+      record (b, "evaluate", nterms, iterations, best, nevaluations * nterms);
+
+      struct expression_range range;
+      TIME_STAGE (iterations, best,
+		  {
+		    find_expression_range (exp, -10, 10, 0, &range);
+		  });
+      record (b, "expression_range", nterms, iterations, best,
+	      range.nevaluations * nterms);
+
+      expression_destroy (exp);
+      free (text);
+    }
+}
+
+/* Sampling a function-heavy expression with each kind of math */
+static void
+bench_math (struct bench *const b)
+{
+  static const char text[] = "sin(x)*cos(2*x) + ln(x^2 + 1) - arctan(x/3)^2.5";
+  const expression_t exp = parse_expression (text, strlen (text));
+  const size_t npoints = 100000;
+  point_t *const points = malloc (npoints * sizeof (*points));
+  if (!points)
+    {
+      perror ("");
+      expression_destroy (exp);
+      return;
+    }
+
+  size_t iterations;
+  double best;
+  TIME_STAGE (iterations, best,
+	      {
+		sample_expression_math (exp, -10, 10, 0, MATH_PRECISE,
+					points, npoints);
+	      });
+  record (b, "sample_precise", npoints, iterations, best, npoints);
+
+  TIME_STAGE (iterations, best,
+	      {
+		sample_expression_math (exp, -10, 10, 0, MATH_FAST, points,
+					npoints);
+	      });
+  record (b, "sample_fast", npoints, iterations, best, npoints);
+
+  free (points);
+  expression_destroy (exp);
+}
+
+/* As "x y" lines, or as CSV lines with the points in columns 2 and 4 of 6 */
+static char *
+format_points (const point_t * const points, const size_t npoints,
+	       const bool csv, size_t *const len)
+{
+  char *text;
+  FILE *const stream = open_memstream (&text, len);
+  if (!stream)
+    return NULL;
+
+  for (size_t i = 0; i < npoints; ++i)
+    if (csv)
+      fprintf (stream, "%zu,%.6f,host%zu,%.6f,%zu,ok\n", i, points[i].x,
+	       i % 16, points[i].y, 3 * i);
+    else
+      fprintf (stream, "%.6f %.6f\n", points[i].x, points[i].y);
+
+  fclose (stream);
+  return text;
+}
+
+/* As CSV lines of ISO 8601 times a second apart, with y in column 2 */
+static char *
+format_times (const point_t * const points, const size_t npoints,
+	      size_t *const len)
+{
+  char *text;
+  FILE *const stream = open_memstream (&text, len);
+  if (!stream)
+    return NULL;
+
+  for (size_t i = 0; i < npoints; ++i)
+    {
+      const size_t day = i / 86400, second = i % 86400;
+      fprintf (stream, "2024-%02zu-%02zuT%02zu:%02zu:%02zuZ,%.6f\n",
+	       1 + day / 28 % 12, 1 + day % 28, second / 3600,
+	       second / 60 % 60, second % 60, points[i].y);
+    }
+
+  fclose (stream);
+  return text;
+}
+
+static plot_info_t
+default_plot (const unsigned short nrows, const unsigned short ncolumns)
+{
+  plot_info_t p = {
+    .nrows = nrows,.ncolumns = ncolumns,
+    .x_number_width = 8,.y_number_width = 8,
+    .x_precision = 3,.y_precision = 3,
+    .nxticks = 6,.nyticks = 6,
+    .x_min = -100,.x_max = 100,.y_min = -11,.y_max = 11,
+    .mark_color = WHITE,.mark_char = '+',
+    .axes_color = GREEN,.x_number_color = RED,.y_number_color = BLUE
+  };
+
+  return p;
+}
+
+/* Per cell of the plot area, implicit curves should get cheaper as the area
+ * grows, since only the cells along the curve are refined */
+static void
+bench_implicit (struct bench *const b)
+{
+  static const char text[] = "x^2/10000 + y^2/100 - 1";
+  const expression_t exp = parse_expression (text, strlen (text));
+
+  for (unsigned int ncolumns = 100; ncolumns <= 10000; ncolumns *= 10)
+    {
+      const plot_info_t p = default_plot (ncolumns / 2, ncolumns);
+      size_t iterations, npoints;
+      double best;
+      TIME_STAGE (iterations, best,
+		  {
+		    free (sample_implicit (exp, p, 0, &npoints, NULL));
+		  });
+      record (b, "implicit", ncolumns, iterations, best,
+	      (size_t) p.nrows * p.ncolumns);
+    }
+
+  expression_destroy (exp);
+}
+
+static void
+bench_points (struct bench *const b)
+{
+  for (size_t npoints = 1000; npoints <= b->max_points; npoints *= 10)
+    {
+      point_t *const points = make_points (npoints);
+      if (!points)
+	{
+	  perror ("");
+	  return;
+	}
+
+      size_t iterations;
+      double best;
+
+      size_t len;
+      char *text = format_points (points, npoints, false, &len);
+      if (text)
+	{
+	  TIME_STAGE (iterations, best,
+		      {
+			FILE *const in = fmemopen (text, len, "r");
+			size_t n;
+			free (read_points (in, &n));
+			fclose (in);
+		      });
+	  record (b, "read_points", npoints, iterations, best, npoints);
+	  free (text);
+	}
+
+      struct csv_format format;
+      csv_format_init (&format);
+      format.x_column = 2;
+      format.y_column = 4;
+      text = format_points (points, npoints, true, &len);
+      if (text)
+	{
+	  TIME_STAGE (iterations, best,
+		      {
+			FILE *const in = fmemopen (text, len, "r");
+			size_t n;
+			size_t nmalformed;
+			free (csv_read_points (in, format, &n, &nmalformed));
+			fclose (in);
+		      });
+	  record (b, "read_csv", npoints, iterations, best, npoints);
+
+	  format.y_expr = "c4 / (1 + c2 ^ 2)";
+	  TIME_STAGE (iterations, best,
+		      {
+			FILE *const in = fmemopen (text, len, "r");
+			size_t n;
+			size_t nmalformed;
+			free (csv_read_points (in, format, &n, &nmalformed));
+			fclose (in);
+		      });
+	  record (b, "read_csv_expr", npoints, iterations, best, npoints);
+	  format.y_expr = NULL;
+	  free (text);
+	}
+
+      format.x_column = 1;
+      format.y_column = 2;
+      format.x_time = TIME_ISO;
+      text = format_times (points, npoints, &len);
+      if (text)
+	{
+	  TIME_STAGE (iterations, best,
+		      {
+			FILE *const in = fmemopen (text, len, "r");
+			size_t n;
+			size_t nmalformed;
+			free (csv_read_points (in, format, &n, &nmalformed));
+			fclose (in);
+		      });
+	  record (b, "read_csv_time", npoints, iterations, best, npoints);
+	  free (text);
+	}
+
+      volatile double sink = 0;
+      TIME_STAGE (iterations, best,
+		  {
+		    sink += find_x_min (points, npoints);
+		    sink += find_x_max (points, npoints);
+		    sink += find_y_min (points, npoints);
+		    sink += find_y_max (points, npoints);
+		  });
+      (void) sink;
+      record (b, "range_scan", npoints, iterations, best, npoints);
+
+      TIME_STAGE (iterations, best,
+		  {
+		    sketch_t x;
+		    sketch_t y;
+		    sketch_init (&x, SKETCH_DEFAULT_K);
+		    sketch_init (&y, SKETCH_DEFAULT_K);
+		    for (size_t i = 0; i < npoints; ++i)
+		      {
+			sketch_add (&x, points[i].x);
+			sketch_add (&y, points[i].y);
+		      }
+		    sink += sketch_quantile (&y, 0.01);
+		    sink += sketch_quantile (&y, 0.99);
+		    sketch_destroy (&x);
+		    sketch_destroy (&y);
+		  });
+      record (b, "range_sketch", npoints, iterations, best, npoints);
+
+      /* Offered in blocks as main reads them, keeping 1000 */
+      TIME_STAGE (iterations, best,
+		  {
+		    reservoir_t r;
+		    if (reservoir_init (&r, 1000, RESERVOIR_DEFAULT_SEED) == 0)
+		      {
+			for (size_t i = 0; i < npoints; i += 4096)
+			  reservoir_add (&r, points + i,
+					 npoints - i < 4096 ? npoints - i : 4096);
+			size_t n;
+			free (reservoir_take (&r, &n));
+			reservoir_destroy (&r);
+		      }
+		  });
+      record (b, "reservoir", npoints, iterations, best, npoints);
+
+      const plot_info_t p = default_plot (22, 42);
+      plot_grid_t grid;
+      if (plot_grid_init (&grid, p) == 0)
+	{
+	  TIME_STAGE (iterations, best,
+		      {
+			plot_grid_add (&grid, points, npoints);
+		      });
+	  record (b, "bin", npoints, iterations, best, npoints);
+	  plot_grid_destroy (&grid);
+	}
+
+      free (points);
+    }
+}
+
+/* Each view of --interactive should cost about the same however many points
+ * there are: the whole range, and a thousandth of it */
+static void
+bench_pyramid (struct bench *const b)
+{
+  for (size_t npoints = 1000; npoints <= b->max_points; npoints *= 10)
+    {
+      point_t *const points = make_points (npoints);
+      if (!points)
+	{
+	  perror ("");
+	  return;
+	}
+
+      size_t iterations;
+      double best;
+      pyramid_t pyramid;
+
+      /* The first build sorts the points, later ones find them sorted */
+      if (pyramid_build (&pyramid, points, npoints) != 0)
+	{
+	  free (points);
+	  return;
+	}
+      pyramid_destroy (&pyramid);
+      TIME_STAGE (iterations, best,
+		  {
+		    pyramid_build (&pyramid, points, npoints);
+		    pyramid_destroy (&pyramid);
+		  });
+      record (b, "pyramid_build", npoints, iterations, best, npoints);
+
+      pyramid_build (&pyramid, points, npoints);
+      plot_info_t p = default_plot (60, 200);
+      plot_grid_t grid;
+      if (plot_grid_init (&grid, p) == 0)
+	{
+	  TIME_STAGE (iterations, best,
+		      {
+			pyramid_view (&pyramid, &grid, p);
+		      });
+	  record (b, "pyramid_view", npoints, iterations, best, 1);
+
+	  p.x_min = 50;
+	  p.x_max = 50.2;
+	  TIME_STAGE (iterations, best,
+		      {
+			pyramid_view (&pyramid, &grid, p);
+		      });
+	  record (b, "pyramid_view_zoom", npoints, iterations, best, 1);
+	  plot_grid_destroy (&grid);
+	}
+
+      pyramid_destroy (&pyramid);
+      free (points);
+    }
+}
+
+/* Counting values into bins, without reading them */
+static void
+bench_histogram (struct bench *const b)
+{
+  const size_t nvalues = 1000000;
+  double *const values = malloc (nvalues * sizeof (*values));
+  if (!values)
+    return;
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  for (size_t i = 0; i < nvalues; ++i)
+    values[i] = exp (uniform (&state) * 10);
+
+  for (int log = 0; log <= 1; ++log)
+    {
+      histogram_t h;
+      if (histogram_init (&h, 200, 1, exp (10), log) != 0)
+	break;
+
+      size_t iterations;
+      double best;
+      TIME_STAGE (iterations, best,
+		  {
+		    histogram_add (&h, values, nvalues);
+		  });
+      record (b, log ? "histogram_log" : "histogram_linear", nvalues,
+	      iterations, best, nvalues);
+      histogram_destroy (&h);
+    }
+
+  free (values);
+}
+
+static void
+bench_render (struct bench *const b)
+{
+  static const unsigned short canvases[][2] = {
+    {22, 42}, {60, 200}, {500, 2000}
+  };
+
+  const size_t npoints = 100000;
+  point_t *const points = make_points (npoints);
+  if (!points)
+    return;
+
+  for (size_t i = 0; i < sizeof canvases / sizeof canvases[0]; ++i)
+    {
+      const plot_info_t p = default_plot (canvases[i][0], canvases[i][1]);
+      plot_grid_t grid;
+      if (plot_grid_init (&grid, p) != 0)
+	continue;
+      plot_grid_add (&grid, points, npoints);
+
+      const size_t size = plot_render_grid (NULL, 0, p, &grid) + 1;
+      char *const frame = malloc (size);
+      if (frame)
+	{
+	  size_t iterations;
+	  double best;
+	  TIME_STAGE (iterations, best,
+		      {
+			plot_render_grid (frame, size, p, &grid);
+		      });
+
+	  const size_t ncells = (size_t) p.nrows * p.ncolumns;
+	  record (b, "render", ncells, iterations, best, ncells);
+
+	  /* The largest canvas again, in bands of rows on threads */
+	  for (unsigned int nthreads = 2;
+	       i + 1 == sizeof canvases / sizeof canvases[0] && nthreads <= 8;
+	       nthreads *= 2)
+	    {
+	      plot_info_t banded = p;
+	      banded.nthreads = nthreads;
+	      TIME_STAGE (iterations, best,
+			  {
+			    plot_render_grid (frame, size, banded, &grid);
+			  });
+	      record (b, "render_bands", nthreads, iterations, best, ncells);
+	    }
+	  free (frame);
+	}
+
+      plot_grid_destroy (&grid);
+    }
+
+  /* A 4x6 fleet overview, by the number of threads rendering the panels */
+  const plot_info_t p = default_plot (12, 32);
+  plot_grid_t grid;
+  if (plot_grid_init (&grid, p) == 0)
+    {
+      plot_grid_add (&grid, points, npoints);
+
+      struct plot_panel panels[24];
+      for (size_t i = 0; i < 24; ++i)
+	{
+	  panels[i].plot = p;
+	  panels[i].grid = &grid;
+	  panels[i].title = "host";
+	}
+
+      const size_t size = plot_render_panels (NULL, 0, panels, 24, 6, 1) + 1;
+      char *const frame = malloc (size);
+      for (unsigned int nthreads = 1; frame && nthreads <= 4; nthreads *= 4)
+	{
+	  size_t iterations;
+	  double best;
+	  TIME_STAGE (iterations, best,
+		      {
+			plot_render_panels (frame, size, panels, 24, 6,
+					    nthreads);
+		      });
+	  record (b, "render_panels", nthreads, iterations, best, 24);
+	}
+
+      free (frame);
+      plot_grid_destroy (&grid);
+    }
+
+  free (points);
+}
+
+/* Returns the number of regressions against the baseline file. */
+static size_t
+compare_baseline (const struct bench *const b, const char *const path,
+		  const double tolerance)
+{
+  FILE *const file = fopen (path, "r");
+  if (!file)
+    {
+      perror (path);
+      return 0;
+    }
+
+  size_t nregressions = 0;
+  char line[512];
+  while (fgets (line, sizeof line, file))
+    {
+      struct result base;
+      if (sscanf (line, "{\"stage\": \"%31[^\"]\", \"size\": %zu, "
+		  "\"iterations\": %zu, \"seconds\": %lf, \"ns_per_item\": %lf",
+		  base.stage, &base.size, &base.iterations, &base.seconds,
+		  &base.ns_per_item) != 5)
+	continue;
+
+      for (size_t i = 0; i < b->nresults; ++i)
+	{
+	  const struct result *const r = &b->results[i];
+	  if (strcmp (r->stage, base.stage) != 0 || r->size != base.size)
+	    continue;
+
+	  const double ratio = r->seconds / base.seconds;
+	  if (ratio > 1 + tolerance)
+	    {
+	      ++nregressions;
+	      fprintf (stderr, "regression: %s size=%zu %.3fx slower "
+		       "(%.6fs, baseline %.6fs)\n", r->stage, r->size, ratio,
+		       r->seconds, base.seconds);
+	    }
+	}
+    }
+
+  fclose (file);
+  return nregressions;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const struct option long_options[] = {
+    {"max-points", required_argument, NULL, 'p'},
+    {"max-terms", required_argument, NULL, 't'},
+    {"max-parse-terms", required_argument, NULL, 'e'},
+    {"baseline", required_argument, NULL, 'b'},
+    {"tolerance", required_argument, NULL, 'r'},
+    {0, 0, 0, 0}
+  };
+
+  static struct bench b = {.max_points = 100000000,.max_terms = 10000,
+    .max_parse_terms = 100000
+  };
+  const char *baseline = NULL;
+  double tolerance = 0.25;
+
+  int c;
+  while ((c = getopt_long (argc, argv, "", long_options, NULL)) != -1)
+    switch (c)
+      {
+      case 'p':
+	b.max_points = strtod (optarg, NULL);
+	break;
+      case 't':
+	b.max_terms = strtod (optarg, NULL);
+	break;
+      case 'e':
+	b.max_parse_terms = strtod (optarg, NULL);
+	break;
+      case 'b':
+	baseline = optarg;
+	break;
+      case 'r':
+	tolerance = strtod (optarg, NULL);
+	break;
+      default:
+	fprintf (stderr, "usage: %s [--max-points=N] [--max-terms=N] [--max-parse-terms=N] "
+		 "[--baseline=FILE [--tolerance=FRACTION]]\n", argv[0]);
+	exit (EXIT_FAILURE);
+      }
+
+  bench_expressions (&b);
+  bench_math (&b);
+  bench_implicit (&b);
+  bench_points (&b);
+  bench_pyramid (&b);
+  bench_histogram (&b);
+  bench_render (&b);
+
+  if (baseline && compare_baseline (&b, baseline, tolerance) > 0)
+    exit (EXIT_FAILURE);
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,254 @@
+/* Load generator for cplot --serve: runs concurrent clients against a socket
+ * and reports throughput and latency percentiles. */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+struct client
+{
+  pthread_t thread;
+  const char *path;
+  const char *request;
+  size_t request_len;
+  size_t nrequests;
+  double *latencies;		/* seconds, one per request */
+  size_t nfailed;
+};
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+connect_socket (const char *const path)
+{
+  struct sockaddr_un addr = {.sun_family = AF_UNIX };
+  strncpy (addr.sun_path, path, sizeof addr.sun_path - 1);
+
+  const int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (connect (fd, (struct sockaddr *) &addr, sizeof addr) != 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+static int
+write_all (const int fd, const char *buf, size_t len)
+{
+  while (len > 0)
+    {
+      const ssize_t n = write (fd, buf, len);
+      if (n < 0 && errno == EINTR)
+	continue;
+      else if (n <= 0)
+	return -1;
+      buf += n;
+      len -= n;
+    }
+
+  return 0;
+}
+
+/* Reads one reply, discarding the frame. */
+static int
+read_reply (const int fd, char *const buf, const size_t size)
+{
+  size_t len = 0;
+  char *newline = NULL;
+  while (!(newline = memchr (buf, '\n', len)))
+    {
+      const ssize_t n = read (fd, buf + len, size - len);
+      if (n <= 0)
+	return -1;
+      len += n;
+    }
+
+  if (strncmp (buf, "OK ", 3) != 0)
+    return -1;
+
+  size_t remaining = strtoull (buf + 3, NULL, 10);
+  const size_t have = len - (newline + 1 - buf);
+  if (have > remaining)
+    return -1;			/* one request is in flight at a time */
+  remaining -= have;
+
+  while (remaining > 0)
+    {
+      const ssize_t n = read (fd, buf, remaining < size ? remaining : size);
+      if (n <= 0)
+	return -1;
+      remaining -= n;
+    }
+
+  return 0;
+}
+
+static void *
+run_client (void *const arg)
+{
+  struct client *const c = arg;
+  char buf[65536];
+
+  const int fd = connect_socket (c->path);
+  if (fd < 0)
+    {
+      perror (c->path);
+      c->nfailed = c->nrequests;
+      return NULL;
+    }
+
+  for (size_t i = 0; i < c->nrequests; ++i)
+    {
+      const double start = now ();
+      if (write_all (fd, c->request, c->request_len) != 0
+	  || read_reply (fd, buf, sizeof buf) != 0)
+	{
+	  c->nfailed = c->nrequests - i;
+	  break;
+	}
+      c->latencies[i] = now () - start;
+    }
+
+  close (fd);
+  return NULL;
+}
+
+static int
+double_cmp (const void *const p1, const void *const p2)
+{
+  const double d1 = *(const double *) p1;
+  const double d2 = *(const double *) p2;
+
+  return (d1 > d2) - (d1 < d2);
+}
+
+static char *
+make_request (const char *const expression, const size_t npoints)
+{
+  char *request;
+  size_t len;
+  FILE *const stream = open_memstream (&request, &len);
+  if (!stream)
+    return NULL;
+
+  if (expression)
+    fprintf (stream, "--expression='%s'\n\n", expression);
+  else
+    {
+      fputs ("--rows=22 --columns=42\n", stream);
+      srand (1);
+      for (size_t i = 0; i < npoints; ++i)
+	fprintf (stream, "%zu %f\n", i, rand () / (double) RAND_MAX);
+      fputc ('\n', stream);
+    }
+
+  fclose (stream);
+  return request;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const struct option long_options[] = {
+    {"clients", required_argument, NULL, 'c'},
+    {"requests", required_argument, NULL, 'n'},
+    {"expression", required_argument, NULL, 'e'},
+    {"points", required_argument, NULL, 'p'},
+    {0, 0, 0, 0}
+  };
+
+  size_t nclients = 8, nrequests = 1000, npoints = 1000;
+  const char *expression = NULL;
+
+  int c;
+  while ((c = getopt_long (argc, argv, "", long_options, NULL)) != -1)
+    switch (c)
+      {
+      case 'c':
+	nclients = strtoull (optarg, NULL, 10);
+	break;
+      case 'n':
+	nrequests = strtoull (optarg, NULL, 10);
+	break;
+      case 'e':
+	expression = optarg;
+	break;
+      case 'p':
+	npoints = strtoull (optarg, NULL, 10);
+	break;
+      default:
+	exit (EXIT_FAILURE);
+      }
+
+  if (optind != argc - 1 || nclients == 0)
+    {
+      fprintf (stderr, "usage: %s [--clients=N] [--requests=N] "
+	       "[--expression=EXPR | --points=N] SOCKET\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  char *const request = make_request (expression, npoints);
+  struct client *const clients = calloc (nclients, sizeof (*clients));
+  double *const latencies = malloc (nclients * nrequests * sizeof (double));
+  if (!request || !clients || !latencies)
+    {
+      perror ("");
+      exit (EXIT_FAILURE);
+    }
+
+  const double start = now ();
+  for (size_t i = 0; i < nclients; ++i)
+    {
+      clients[i].path = argv[optind];
+      clients[i].request = request;
+      clients[i].request_len = strlen (request);
+      clients[i].nrequests = nrequests;
+      clients[i].latencies = latencies + i * nrequests;
+      pthread_create (&clients[i].thread, NULL, run_client, &clients[i]);
+    }
+
+  size_t nfailed = 0;
+  for (size_t i = 0; i < nclients; ++i)
+    {
+      pthread_join (clients[i].thread, NULL);
+      nfailed += clients[i].nfailed;
+    }
+  const double elapsed = now () - start;
+
+  /* failed requests leave gaps, so compact the latencies first */
+  size_t n = 0;
+  for (size_t i = 0; i < nclients; ++i)
+    for (size_t j = 0; j < nrequests - clients[i].nfailed; ++j)
+      latencies[n++] = clients[i].latencies[j];
+  qsort (latencies, n, sizeof *latencies, double_cmp);
+
+  printf ("requests=%zu failed=%zu seconds=%.3f throughput=%.1f/s\n",
+	  n, nfailed, elapsed, n / elapsed);
+  if (n > 0)
+    printf ("latency_ms p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+	    latencies[n / 2] * 1e3, latencies[n * 9 / 10] * 1e3,
+	    latencies[n * 99 / 100] * 1e3, latencies[n - 1] * 1e3);
+
+  free (latencies);
+  free (clients);
+  free (request);
+  return nfailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
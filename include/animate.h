@@ -0,0 +1,11 @@
+#ifndef __ANIMATE_INC
+#define __ANIMATE_INC
+#include <stdio.h>
+#include "options.h"
+
+/* Plays the expression as t runs from --t-min to --t-max at --fps frames per
+ * second. Frames are sampled on a second thread while the previous one is
+ * written; frames that could not be prepared in time are skipped. Only the
+ * cells that change between frames are redrawn. */
+int animate(const struct options *const o, FILE *const out);
+#endif
@@ -0,0 +1,9 @@
+#ifndef __BATCH_INC
+#define __BATCH_INC
+
+/* Renders every job in a manifest on a pool of worker threads. Each non-empty
+ * line not starting with '#' holds the options of one job, which must include
+ * --output. Input files named by several jobs are read once. A per-job timing
+ * summary is written to standard error. */
+int batch(const char *const manifest, const unsigned int nthreads);
+#endif
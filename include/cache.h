@@ -0,0 +1,45 @@
+#ifndef __CACHE_INC
+#define __CACHE_INC
+#include <stdbool.h>
+#include <stddef.h>
+#include "evaluator.h"
+#include "plotter.h"
+#include "fastmath.h"
+
+struct cache {
+  const char *dir;
+  size_t max_size;
+};
+
+typedef struct cache cache_t;
+
+/* A cached point array, mapped copy-on-write so it may be reordered in place, and the range
+ * find_expression_range found for the expression, if it was stored with one, so that a hit
+ * needs no parsing. */
+struct cache_entry {
+  void *map;
+  size_t map_size;
+  point_t *points;
+  size_t npoints;
+  bool ranged;
+  struct expression_range range;
+};
+
+typedef struct cache_entry cache_entry_t;
+
+struct cache_stats {
+  unsigned long long hits, misses;
+  unsigned long long entries, bytes;
+};
+
+char *cache_make_key(const char *const expression, const double x_min, const double x_max,
+                     const unsigned short ncolumns, const size_t samples_per_column,
+                     const enum math_mode mode);
+bool cache_lookup(const cache_t *const cache, const char *const key, cache_entry_t *const entry);
+/* range may be NULL. */
+int cache_store(const cache_t *const cache, const char *const key,
+                const point_t *const points, const size_t npoints,
+                const struct expression_range *const range);
+void cache_release(cache_entry_t *const entry);
+int cache_get_stats(const cache_t *const cache, struct cache_stats *const stats);
+#endif
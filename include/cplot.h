@@ -0,0 +1,22 @@
+#ifndef __CPLOT_INC
+#define __CPLOT_INC
+/* Public interface of libcplot. Nothing in the library keeps global state, so
+ * independent plots may be parsed, evaluated and rendered concurrently. */
+#include "tokenizer.h"
+#include "parser.h"
+#include "evaluator.h"
+#include "fastmath.h"
+#include "plotter.h"
+#include "points.h"
+#include "cache.h"
+#include "stats.h"
+#include "sketch.h"
+#include "csv.h"
+#include "raster.h"
+#include "implicit.h"
+#include "reservoir.h"
+#include "panels.h"
+#include "sidecar.h"
+#include "pyramid.h"
+#include "histogram.h"
+#endif
@@ -0,0 +1,58 @@
+#ifndef __CSV_INC
+#define __CSV_INC
+#include <stdbool.h>
+#include <stdio.h>
+#include "fastmath.h"
+#include "plotter.h"
+#include "timestamp.h"
+
+/* Which fields of a delimited file hold the points. Columns count from 1. A blank delimiter
+ * splits fields at runs of blanks and tabs, as "x y" input is read. An x_expr or y_expr
+ * computes that coordinate from the fields of its line instead, naming them as c1, c2... or by
+ * the names in the header, which is header if given and otherwise the first line when it is
+ * skipped. */
+struct csv_format {
+  char delimiter;
+  unsigned int x_column, y_column;
+  bool skip_header;
+  enum time_format x_time;	/* TIME_NONE for plain numbers, applies to field x_column */
+  const char *x_expr, *y_expr;
+  enum math_mode math;		/* of the functions in the expressions */
+  const char *header;
+};
+
+struct csv_transform;
+
+/* Reads delimited text in large chunks, finding delimiters and newlines 16 or
+ * 32 bytes at a time, and converting only the selected fields. Lines without
+ * both fields, or with fields that are not numbers, are skipped and counted.
+ * Quoted fields are not understood. Expressions are compiled once, and
+ * evaluated over blocks of lines as they are read; lines where they are not
+ * finite are skipped too. */
+struct csv_reader {
+  FILE *in;
+  struct csv_format format;
+  char *buf;
+  size_t size, start, end;
+  bool eof;
+  bool header_skipped;
+  size_t nlines, nmalformed;
+  struct csv_transform *transform;
+};
+
+typedef struct csv_reader csv_reader_t;
+
+void csv_format_init(struct csv_format *const format);
+/* Returns 0, or -1 with errno set; EINVAL means an expression does not parse or names a column
+ * that is not there. The expressions and header must outlive the reader. */
+int csv_reader_init(csv_reader_t *const reader, FILE *const in, const struct csv_format format);
+/* Reads at most max points; fewer means the input ended. */
+size_t csv_read_block(csv_reader_t *const reader, point_t points[], const size_t max);
+void csv_reader_destroy(csv_reader_t *const reader);
+/* Describes an error from reading with the format, as strerror does. */
+const char *csv_strerror(const struct csv_format *const format, const int error);
+
+/* Reads every point, as read_points does; NULL if memory ran out. */
+point_t *csv_read_points(FILE *const in, const struct csv_format format, size_t *const npoints,
+                         size_t *const nmalformed);
+#endif
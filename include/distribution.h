@@ -0,0 +1,12 @@
+#ifndef __DISTRIBUTION_INC
+#define __DISTRIBUTION_INC
+#include <stdio.h>
+#include "options.h"
+#include "stats.h"
+
+/* Draws a --histogram of the values in the --x-col column, one per line by default. A file
+ * is split into as many parts as there are threads, and each part is counted into a histogram
+ * of its own before they are merged. Unless both ends of the range are given, a first pass
+ * finds them: over the file again, or over the values kept in memory from a stream. */
+int plot_distribution(struct options *const o, FILE *const out, stats_t *const stats);
+#endif
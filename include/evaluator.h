@@ -0,0 +1,92 @@
+#ifndef __EVALUATOR_INC
+#define __EVALUATOR_INC
+#include <stdbool.h>
+#include <stddef.h>
+#include "parser.h"
+#include "plotter.h"
+#include "fastmath.h"
+
+#define SAMPLES_PER_COLUMN 50
+
+/* Indices of the variables expressions may use, in the array passed to evaluate_expression_vars.
+ * Only implicit curves use y. Any other name evaluates to NaN, or to the empty interval, so
+ * expressions check_variables rejects are still safe to evaluate. */
+enum variable {
+  VARIABLE_X, VARIABLE_T, VARIABLE_Y, NVARIABLES
+};
+
+/* A value with its first and second derivatives with respect to x, for forward-mode automatic
+ * differentiation. */
+struct dual {
+  double value, first, second;
+};
+
+typedef struct dual dual_t;
+
+/* A closed range of values; lo > hi is the empty interval, where an expression is defined
+ * nowhere. */
+struct interval {
+  double lo, hi;
+};
+
+typedef struct interval interval_t;
+
+#define EXPRESSION_MAX_SINGULARITIES 8
+
+/* The values an expression takes over an interval of x, and the poles found in it. */
+struct expression_range {
+  double y_min, y_max;
+  size_t nevaluations;
+  size_t nsingularities;	/* only the first EXPRESSION_MAX_SINGULARITIES are kept */
+  double singularities[EXPRESSION_MAX_SINGULARITIES];
+};
+
+int variable_index(const char *const name);
+bool check_parser_errors(const expression_t expression);
+bool check_variables(const expression_t expression);
+/* As check_variables, also accepting y. */
+bool check_implicit_variables(const expression_t expression);
+double evaluate_expression_vars(const expression_t exp, const double vars[]);
+dual_t evaluate_expression_dual(const expression_t exp, const double vars[]);
+/* Bounds the values the expression takes with each variable anywhere in its interval. The
+ * bounds may be loose, but hold every value the expression is defined for. */
+interval_t evaluate_expression_interval(const expression_t exp, const interval_t vars[]);
+double evaluate_expression(const expression_t exp, const double x);
+/* How many samples each column gets: plots with lines look continuous with about one. */
+size_t samples_per_column(const plot_info_t plot);
+/* The last x a plot's samples_per_column samples per column reach, a step short of x_max, so
+ * that ranges are fitted over the x values actually plotted. */
+double last_sample_x(const plot_info_t plot);
+/* Samples npoints evenly spaced values of x from x_min, evaluating blocks of samples at a
+ * time with the given math functions. The others use precise ones. */
+void sample_expression_math(const expression_t exp, const double x_min, const double x_max,
+                            const double t, const enum math_mode mode, point_t points[],
+                            const size_t npoints);
+void sample_expression_at(const expression_t exp, const double x_min, const double x_max,
+                          const double t, point_t points[], const size_t npoints);
+void sample_expression(const expression_t exp, const double x_min, const double x_max,
+                       point_t points[], const size_t npoints);
+/* An expression compiled once to be evaluated over blocks of rows, each of its variables
+ * standing for a column of them. */
+struct column_expression;
+typedef struct column_expression column_expression_t;
+
+/* resolve numbers the column each variable names from 0, or returns -1 if there is none; then
+ * NULL is returned with errno set to EINVAL. It is NULL with ENOMEM if memory ran out. */
+column_expression_t *column_expression_compile(const expression_t exp, const enum math_mode mode,
+                                               int (*const resolve)(const char *const name,
+                                                                    void *const arg),
+                                               void *const arg);
+/* Sets out[i] to the value for row i, where the column numbered k holds columns[k][i]. */
+void column_expression_evaluate(column_expression_t *const compiled, const double *const columns[],
+                                const size_t n, double out[]);
+void column_expression_destroy(column_expression_t *const compiled);
+
+/* Finds the range of the expression over [x_min, x_max] at the given t from its values on a
+ * coarse grid and at the critical points between, located by Newton steps on the derivative;
+ * cells that hold two of them are halved until they part. Poles are where the values grow
+ * without bound, and values next to one are left out, as they say nothing about the rest of
+ * the curve. Returns -1 if the expression is nowhere finite. */
+int find_expression_range(const expression_t exp, const double x_min, const double x_max,
+                          const double t, struct expression_range *const range);
+#endif
@@ -0,0 +1,12 @@
+#ifndef __EXPLORE_INC
+#define __EXPLORE_INC
+#include <stdio.h>
+#include "options.h"
+
+/* Shows the points on the terminal and zooms and pans the x-range as keys are
+ * read from it, refitting unset y-ranges to each view. The points are sorted
+ * in place once and summed up in a pyramid, so each view costs time with the
+ * size of the plot rather than the number of points. */
+int explore(const struct options *const o, point_t points[], const size_t npoints,
+            FILE *const out);
+#endif
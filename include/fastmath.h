@@ -0,0 +1,24 @@
+#ifndef __FASTMATH_INC
+#define __FASTMATH_INC
+#include <stddef.h>
+
+/* Precise calls libm for every value. Fast works through blocks of values a vector register at
+ * a time with range reduction and polynomials, within a few ulps of libm (a few hundred for ^),
+ * and falls back to libm for arguments outside the reduced ranges; tests/math-test measures it.
+ * Built without AVX, the registers hold two values, too few for the inverse functions, ln and
+ * non-integer powers to beat libm, so fast calls libm for those. */
+enum math_mode {
+  MATH_PRECISE, MATH_FAST
+};
+
+enum math_function {
+  MATH_SIN, MATH_COS, MATH_TAN, MATH_ASIN, MATH_ACOS, MATH_ATAN, MATH_LN, MATH_NFUNCTIONS
+};
+
+/* Returns the function for an expression's function name, or -1. */
+int math_function_index(const char *const name);
+/* Both work in place on values and base. */
+void math_apply(const enum math_function f, const enum math_mode mode, double values[],
+                const size_t n);
+void math_pow(const enum math_mode mode, double base[], const double exponent[], const size_t n);
+#endif
@@ -0,0 +1,38 @@
+#ifndef __HISTOGRAM_INC
+#define __HISTOGRAM_INC
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "plotter.h"
+
+/* Counts of values in nbins bins of equal width from min to max, the last bin also taking max
+ * itself. With log, the bins are of equal width in the base-10 logarithm of the values, and
+ * min and max are logarithms too; values that are not positive are counted as below. NaNs are
+ * not counted at all. Histograms with the same bins add up, so parts of the input can be
+ * counted on threads of their own and merged. */
+struct histogram {
+  size_t nbins;
+  uint64_t *counts;
+  double min, max;
+  double scale;			/* bins per unit */
+  bool log;
+  uint64_t below, above;
+};
+
+typedef struct histogram histogram_t;
+
+/* min and max are values, and with log must be positive. Returns 0, or -1 with errno set to
+ * EINVAL for an empty range or ENOMEM if memory ran out. */
+int histogram_init(histogram_t *const histogram, const size_t nbins, const double min,
+                   const double max, const bool log);
+void histogram_add(histogram_t *const histogram, const double values[], const size_t n);
+/* Adds the counts of other, which must have the same bins. */
+void histogram_merge(histogram_t *const histogram, const histogram_t *const other);
+uint64_t histogram_max_count(const histogram_t *const histogram);
+void histogram_destroy(histogram_t *const histogram);
+
+/* Fills grid, initialized for the plot, with a bar per column as high as the largest count
+ * of the bins under it. The plot's x-range is that of the bins, logarithms included. */
+void histogram_grid(const histogram_t *const histogram, plot_grid_t *const grid,
+                    const plot_info_t plot);
+#endif
@@ -0,0 +1,14 @@
+#ifndef __IMPLICIT_INC
+#define __IMPLICIT_INC
+#include <stddef.h>
+#include "evaluator.h"
+#include "plotter.h"
+
+/* Finds the cells of the plot area that the curve exp = 0 passes through, in x and y at the
+ * given t, and returns a point at the centre of each. The area is split as a quadtree, and
+ * regions where interval arithmetic bounds exp away from 0 are dropped whole, so the work
+ * grows with the length of the curve rather than the area. Cells left at the bottom are kept
+ * where exp changes sign across them. Returns NULL with errno set if memory ran out. */
+point_t *sample_implicit(const expression_t exp, const plot_info_t plot, const double t,
+                         size_t *const npoints, size_t *const nevaluations);
+#endif
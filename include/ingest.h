@@ -0,0 +1,12 @@
+#ifndef __INGEST_INC
+#define __INGEST_INC
+#include <stdio.h>
+#include "options.h"
+#include "stats.h"
+
+/* Plots every --file as its own series, or with --panels in its own panel. Each
+ * input is opened and read on a thread of its own, so a FIFO whose writer is
+ * slow holds up nobody else, and each thread bins into its own grid, so they
+ * share nothing while reading. */
+int ingest_files(struct options *const o, FILE *const out, stats_t *const stats);
+#endif
@@ -0,0 +1,14 @@
+#ifndef __INPUT_INC
+#define __INPUT_INC
+#include <stdio.h>
+#include "options.h"
+#include "sketch.h"
+
+/* Reads the points of a single input as the options say: "x y" pairs or the selected fields of
+ * delimited text, or only a --sample of them. If x is given, every point read is added to the
+ * sketches x and y. nread counts the points read, which may be more than were kept. Returns
+ * NULL with errno set, which csv_strerror describes. */
+point_t *read_input(FILE *const in, const char *const name, const struct options *const o,
+                    size_t *const npoints, size_t *const nread, sketch_t *const x,
+                    sketch_t *const y);
+#endif
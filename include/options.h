@@ -0,0 +1,122 @@
+#ifndef __OPTIONS_INC
+#define __OPTIONS_INC
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "plotter.h"
+#include "cache.h"
+#include "sketch.h"
+#include "csv.h"
+#include "evaluator.h"
+#include "reservoir.h"
+
+#define OPTIONS_MAX_FILES 64
+
+enum input_source {
+  INPUT_STDIN, INPUT_FILE, INPUT_EXPRESSION
+};
+
+/* Everything the command line can ask for. Values point into the parsed argv. */
+struct options {
+  plot_info_t plot;
+  bool x_min_set, x_max_set;
+  bool y_min_set, y_max_set;
+
+  enum input_source source;
+  const char *file_name;	/* the first of file_names */
+  const char *file_names[OPTIONS_MAX_FILES];
+  size_t nfiles;
+  const char *expression;
+
+  cache_t cache;
+  bool cache_stats;
+
+  const char *output;
+  bool stats;
+
+  /* Animating over t is enabled by --t-max. */
+  double t_min, t_max;
+  bool t_max_set;
+  double fps;
+
+  /* With --auto-range, unset axes span these quantiles rather than the extremes. */
+  bool auto_range;
+  double auto_range_low, auto_range_high;
+
+  /* Any of --delimiter, --x-col, --y-col, --skip-header or --x-time reads input as delimited
+   * text. */
+  struct csv_format csv;
+  bool csv_set;
+
+  /* With --image, the plot is drawn to a PNG, or a PPM if the name ends in .ppm. */
+  const char *image;
+  unsigned int image_width, image_height;
+
+  /* How expressions are evaluated; options_init picks precise. */
+  enum math_mode math;
+  /* With --implicit, the expression is a function of x and y, plotted where it is 0. */
+  bool implicit;
+
+  /* --sample keeps a uniform sample of this many of the points read; 0 keeps them all. */
+  size_t sample;
+  uint64_t seed;
+
+  /* --panels plots each --file in its own panel of a grid this many panels high and wide,
+   * fitting its own ranges unless the axes are shared. */
+  unsigned int panel_rows, panel_columns;
+  bool shared_axes;
+
+  /* With --sidecar, the binned grid of a --file is saved in FILE.cplot and reused while the
+   * file and the canvas stay the same. */
+  bool sidecar;
+
+  /* --histogram counts the values of the --x-col column into bins --bin-width wide, or into
+   * one bin per column. With --log-bins the bins are equally wide in log scale. */
+  bool histogram;
+  double bin_width;
+  bool log_bins;
+
+  /* --interactive zooms and pans the plot on the terminal. */
+  bool interactive;
+
+  const char *serve_path;
+  const char *batch_manifest;
+  unsigned int nthreads;
+
+  bool help;
+};
+
+void options_init(struct options *const o);
+/* Unlike getopt_long, this keeps no global state. argv does not include the program name. */
+int options_parse(struct options *const o, const int argc, char *const argv[],
+                  char *const error, const size_t error_size);
+/* The format the input is read in: the delimited text options if any were given, and otherwise
+ * "x y" pairs split at blanks. */
+struct csv_format options_input_format(const struct options *const o);
+/* Describes everything that decides which cells the points of the --file fall in, so that a
+ * --sidecar saved with a different key is not reused. */
+void options_sidecar_key(const struct options *const o, char *const key, const size_t size);
+/* The first option given that a --batch job, or if served a --serve request, cannot carry out,
+ * or NULL. */
+const char *options_job_unsupported(const struct options *const o, const bool served);
+int options_split(char *const line, char *argv[], const int max_args);
+/* Sets the axes not given on the command line to fit the points, or the
+ * --auto-range quantiles of them. */
+void options_fit_ranges(struct options *const o, const point_t *const points, const size_t npoints);
+/* As options_fit_ranges, from sketches of the x and y values built while reading. */
+void options_fit_sketches(struct options *const o, const sketch_t *const x, const sketch_t *const y);
+
+/* Sets an unset y-range to the values the expression takes over the x-range at t, found by
+ * automatic differentiation rather than from the samples. --auto-range keeps quantiles of the
+ * samples instead. range->nsingularities counts the poles found. */
+void options_fit_expression(struct options *const o, const expression_t exp, const double t,
+                            struct expression_range *const range);
+/* Whether options_fit_expression would look for the range at all. */
+bool options_wants_expression_range(const struct options *const o);
+/* As options_fit_expression, with a range found before, as for a cache entry. Returns whether
+ * the range was wanted, and so whether its poles are worth reporting. */
+bool options_fit_found_range(struct options *const o, const struct expression_range *const range);
+
+enum plot_color process_color(const char *const color);
+size_t process_size(const char *const size);
+#endif
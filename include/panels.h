@@ -0,0 +1,24 @@
+#ifndef __PANELS_INC
+#define __PANELS_INC
+#include <stdio.h>
+#include <sys/types.h>
+#include "plotter.h"
+#include "stats.h"
+
+/* One plot of a small-multiples frame, with its own ranges. A panel without a grid is left
+ * blank. */
+struct plot_panel {
+  plot_info_t plot;
+  const plot_grid_t *grid;
+  const char *title;
+};
+
+/* Lays the panels out ncolumns to a row, each under its title, in a frame rendered like
+ * snprintf. The panels are rendered by nthreads threads and then copied into place. */
+ssize_t plot_render_panels(char *const buf, const size_t size, const struct plot_panel panels[],
+                           const size_t npanels, const unsigned short ncolumns,
+                           const unsigned int nthreads);
+void plot_write_panels(FILE *const stream, const struct plot_panel panels[], const size_t npanels,
+                       const unsigned short ncolumns, const unsigned int nthreads,
+                       stats_t *const stats);
+#endif
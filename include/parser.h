@@ -1,5 +1,7 @@
 #ifndef __EXPRESSION_INC
 #define __EXPRESSION_INC
+#include <stddef.h>
+#include "tokenizer.h"
 
 enum expression_type {
   EXPRESSION_FUNCTION, EXPRESSION_OPERATOR, EXPRESSION_NUMBER, EXPRESSION_ERROR, EXPRESSION_VARIABLE
@@ -21,6 +23,10 @@ struct expression {
 
 typedef struct expression expression_t;
 
-expression_t next_expression(FILE *const stream);
+expression_t next_expression(tokenizer_t *const t);
+expression_t parse_expression(const char *const s, const size_t len);
+/* As parse_expression, where names may also hold digits and underscores, as the columns c1,
+ * c2... and header names do; then ln2 is a name rather than ln(2). */
+expression_t parse_column_expression(const char *const s, const size_t len);
 void expression_destroy(const expression_t expression);
 #endif
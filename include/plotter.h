@@ -1,6 +1,9 @@
 #ifndef __PLOT_INC
 #define __PLOT_INC
+#include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include "stats.h"
 
 enum plot_color {
   BLACK, RED, GREEN, ORANGE, BLUE, PURPLE, CYAN, LIGHT_GRAY, DARK_GRAY, LIGHT_RED, 
@@ -20,6 +23,16 @@ struct plot_info {
   enum plot_color axes_color;
   enum plot_color x_number_color;
   enum plot_color y_number_color;
+
+  /* Connects consecutive points with lines of marks rather than marking each alone. */
+  bool lines;
+  /* x values are seconds since the epoch, labelled as dates and times in UTC. */
+  bool x_time;
+  /* x values are base-10 logarithms, labelled with the numbers they stand for. */
+  bool x_log;
+  /* Large plots are rendered in bands of rows on this many threads; 0 or 1 renders them on
+   * the calling thread. */
+  unsigned int nthreads;
 };
 
 typedef struct plot_info plot_info_t;
@@ -31,5 +44,75 @@ struct point {
 
 typedef struct point point_t;
 
-void plot(FILE *const stream, const plot_info_t plot, point_t points[], const size_t npoints);
+/* Points binned onto the plot area; cells are row-major, starting from the bottom row. */
+struct plot_grid {
+  unsigned short nrows, ncolumns;
+  unsigned int *cells;
+
+  double x_scale, y_scale;
+  double x_min, y_min;
+  double x_step, y_step;
+  double *x_bounds, *y_bounds;
+
+  /* With lines, where the last point added left the pen; lines resume from it. */
+  bool lines;
+  bool pen_down;
+  point_t pen;
+};
+
+typedef struct plot_grid plot_grid_t;
+
+/* Where the terminal plot puts tick labels, for other backends to follow:
+ * columns count from the y-axis and rows from the x-axis, both from 0. */
+bool plot_x_tick(const plot_info_t plot, const unsigned short column);
+bool plot_y_tick(const plot_info_t plot, const unsigned short row);
+double plot_column_x(const plot_info_t plot, const unsigned short column);
+double plot_row_y(const plot_info_t plot, const unsigned short row);
+/* Formats an x-axis label as snprintf does, with x_precision decimals, as a time or, for
+ * logarithms, with x_precision significant digits. */
+int plot_x_label(const plot_info_t plot, const double x, char *const buf, const size_t size);
+/* The columns each x-axis label takes: x_number_width, or more for times that need it. */
+unsigned short plot_x_label_width(const plot_info_t plot);
+
+/* Returns the message plotting would print for an unusable plot, or NULL. */
+const char *plot_check_info(const plot_info_t plot);
+
+int plot_grid_init(plot_grid_t *const grid, const plot_info_t plot);
+/* Returns how many of the points fell inside the plot area. For plots with lines, each point
+ * is joined to the one before it, even if that came in an earlier call; the parts of the lines
+ * outside the plot area are clipped away. */
+size_t plot_grid_add(plot_grid_t *const grid, const point_t points[], const size_t npoints);
+void plot_grid_clear(plot_grid_t *const grid);
+void plot_grid_destroy(plot_grid_t *const grid);
+
+#define PLOT_MAX_SERIES 16
+
+/* One of several point sets drawn on the same axes, each in its own color. */
+struct plot_series {
+  const plot_grid_t *grid;
+  enum plot_color color;
+  const char *name;
+};
+
+/* All three render like snprintf: at most size bytes including the terminating NUL are
+ * written, and the full length of the plot is returned, or -1 on error. */
+ssize_t plot_render_grid(char *const buf, const size_t size, const plot_info_t plot,
+                         const plot_grid_t *const grid);
+/* Cells with points from several series show the first; a legend follows the x-axis. */
+ssize_t plot_render_series(char *const buf, const size_t size, const plot_info_t plot,
+                           const struct plot_series series[], const size_t nseries);
+ssize_t plot_render(char *const buf, const size_t size, const plot_info_t plot,
+                    const point_t points[], const size_t npoints);
+/* Renders the terminal escapes that turn a frame of prev, drawn from the top-left corner of
+ * the screen, into one of next. Only cells whose marks differ are written. */
+ssize_t plot_render_diff(char *const buf, const size_t size, const plot_info_t plot,
+                         const plot_grid_t *const prev, const plot_grid_t *const next);
+
+void plot_write_grid(FILE *const stream, const plot_info_t plot, const plot_grid_t *const grid);
+void plot_write_series(FILE *const stream, const plot_info_t plot, const struct plot_series series[],
+                       const size_t nseries, stats_t *const stats);
+void plot(FILE *const stream, const plot_info_t plot, const point_t points[], const size_t npoints);
+/* As plot, charging binning, rendering and writing to the given stats. */
+void plot_stats(FILE *const stream, const plot_info_t plot, const point_t points[],
+                const size_t npoints, stats_t *const stats);
 #endif
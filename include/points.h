@@ -0,0 +1,14 @@
+#ifndef __POINTS_INC
+#define __POINTS_INC
+#include <stdio.h>
+#include "plotter.h"
+
+point_t *read_points(FILE *const in, size_t *npoints);
+/* Parses "x y" pairs from a string into *points, growing it (and *size) as needed. */
+size_t parse_points(const char *s, point_t **const points, size_t *const size);
+
+double find_x_min(const point_t *const points, const size_t npoints);
+double find_x_max(const point_t *const points, const size_t npoints);
+double find_y_min(const point_t *const points, const size_t npoints);
+double find_y_max(const point_t *const points, const size_t npoints);
+#endif
@@ -0,0 +1,17 @@
+#ifndef __POOL_INC
+#define __POOL_INC
+#include <stddef.h>
+
+/* A fixed set of worker threads running tasks from a FIFO queue. Tasks get the
+ * index of the worker running them, so callers can keep per-worker buffers. */
+typedef void (*pool_task_t)(void *const arg, const size_t worker);
+
+struct pool;
+typedef struct pool pool_t;
+
+pool_t *pool_create(const size_t nworkers);
+size_t pool_size(const pool_t *const pool);
+int pool_submit(pool_t *const pool, const pool_task_t task, void *const arg);
+void pool_wait(pool_t *const pool);
+void pool_destroy(pool_t *const pool);
+#endif
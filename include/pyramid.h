@@ -0,0 +1,46 @@
+#ifndef __PYRAMID_INC
+#define __PYRAMID_INC
+#include <stddef.h>
+#include "plotter.h"
+
+#define PYRAMID_BLOCK 64
+
+/* Points sorted by x, with the lowest and highest y of every block of PYRAMID_BLOCK consecutive
+ * points, of every pair of those blocks, and so on up to a single block holding all of them.
+ * The points in any x-interval are found by binary search, and their y-extent is then summed
+ * up from O(log n) blocks rather than by a pass over them. */
+struct pyramid_level {
+  double *y_min, *y_max;
+  size_t n;
+};
+
+struct pyramid {
+  point_t *points;
+  size_t npoints;
+  struct pyramid_level *levels;
+  unsigned int nlevels;
+};
+
+typedef struct pyramid pyramid_t;
+
+/* The points in an x-interval: how many there are and the extent of their y-values. */
+struct pyramid_extent {
+  size_t count;
+  double y_min, y_max;
+};
+
+/* Sorts points by x in place, dropping those whose x is not a number, and keeps them; they must
+ * outlive the pyramid. Returns 0, or -1 with errno set if memory ran out. */
+int pyramid_build(pyramid_t *const pyramid, point_t points[], const size_t npoints);
+void pyramid_destroy(pyramid_t *const pyramid);
+
+/* Of the points with x0 <= x < x1. */
+struct pyramid_extent pyramid_extent(const pyramid_t *const pyramid, const double x0,
+                                     const double x1);
+/* Bins the points in the plot's x-range into grid, which must have been initialized for the
+ * plot without lines. Columns holding few points get each of them; denser ones are filled from
+ * the lowest of their points to the highest. The work grows with the size of the grid and the
+ * log of the number of points. Returns how many points lie in the x-range. */
+size_t pyramid_view(const pyramid_t *const pyramid, plot_grid_t *const grid,
+                    const plot_info_t plot);
+#endif
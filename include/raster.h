@@ -0,0 +1,29 @@
+#ifndef __RASTER_INC
+#define __RASTER_INC
+#include <stdbool.h>
+#include <stdio.h>
+#include "plotter.h"
+
+/* An 8-bit RGB image, rows from the top. */
+struct raster {
+  unsigned int width, height;
+  unsigned char *pixels;
+};
+
+typedef struct raster raster_t;
+
+int raster_init(raster_t *const image, const unsigned int width, const unsigned int height);
+void raster_destroy(raster_t *const image);
+
+/* Draws the plot as the terminal would lay it out, with the same ticks and
+ * colors on a black background, but with points as anti-aliased dots placed
+ * to the pixel, or a line through them if lines is set. The image is split
+ * into bands of rows drawn by nthreads threads. Returns -1 with errno set if
+ * the image is too small for the plot or memory ran out. */
+int plot_raster(raster_t *const image, const plot_info_t plot, const point_t points[],
+                const size_t npoints, const bool lines, const unsigned int nthreads);
+
+int raster_write_ppm(const raster_t *const image, FILE *const stream);
+/* Writes a PNG without compressing it, so no zlib is needed. */
+int raster_write_png(const raster_t *const image, FILE *const stream);
+#endif
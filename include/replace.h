@@ -0,0 +1,16 @@
+#ifndef __REPLACE_INC
+#define __REPLACE_INC
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* The temporary files of replace_file are named as the file, followed by a dot and this many
+ * letters or digits. */
+#define REPLACE_TEMP_LETTERS 6
+
+/* Writes the parts into a temporary file beside path and renames it over path, so readers
+ * find either the old file or all of the new one. Every call has a temporary file of its own,
+ * so writers of the same path, whether threads or processes, never mix their parts. The file
+ * is created as open creates one with mode 0666, so the umask applies. Returns 0, or -1 with
+ * errno set and the temporary file removed. */
+int replace_file(const char *const path, const struct iovec parts[], const size_t nparts);
+#endif
@@ -0,0 +1,37 @@
+#ifndef __RESERVOIR_INC
+#define __RESERVOIR_INC
+#include <stddef.h>
+#include <stdint.h>
+#include "plotter.h"
+
+#define RESERVOIR_DEFAULT_SEED 1
+
+/* A uniform random sample of k points from a stream of unknown length, by
+ * Algorithm L: rather than drawing a random number for every point, it draws
+ * how many points to skip before the next one it keeps, so the work grows with
+ * k log(n/k) rather than n. Memory stays at k points, and the same seed picks
+ * the same sample. */
+struct reservoir_item {
+  uint64_t position;		/* where in the stream the point came from */
+  point_t point;
+};
+
+struct reservoir {
+  struct reservoir_item *items;
+  size_t k, n;
+  uint64_t seen;
+  uint64_t next;		/* the position of the next point to keep */
+  double w;
+  uint64_t random;
+};
+
+typedef struct reservoir reservoir_t;
+
+/* Returns -1 with errno set if memory ran out. */
+int reservoir_init(reservoir_t *const reservoir, const size_t k, const uint64_t seed);
+/* Offers the next points of the stream. */
+void reservoir_add(reservoir_t *const reservoir, const point_t points[], const size_t npoints);
+/* Returns the sample in stream order, which the caller frees, and leaves the reservoir empty. */
+point_t *reservoir_take(reservoir_t *const reservoir, size_t *const npoints);
+void reservoir_destroy(reservoir_t *const reservoir);
+#endif
@@ -0,0 +1,11 @@
+#ifndef __SERVE_INC
+#define __SERVE_INC
+
+/* Serves plot requests on a Unix domain socket until SIGINT or SIGTERM.
+ *
+ * A request is one line of command-line options, followed by "x y" point
+ * lines when neither --expression nor --file is given, and ends with an
+ * empty line. The reply is "OK <length>\n" followed by the rendered plot,
+ * or "ERR <message>\n". A connection may carry any number of requests. */
+int serve(const char *const path, const unsigned int nthreads);
+#endif
@@ -0,0 +1,44 @@
+#ifndef __SIDECAR_INC
+#define __SIDECAR_INC
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "plotter.h"
+
+/* What identifies a version of an input file: a sidecar saved for one is invalid once any of
+ * these change. */
+struct sidecar_identity {
+  uint64_t device, inode;
+  uint64_t size;
+  int64_t mtime_sec, mtime_nsec;
+};
+
+/* The binned grid of an input file, saved beside it so later plots of the same canvas need not
+ * read it again. The cells are mapped from the file. */
+struct sidecar {
+  void *map;
+  size_t map_size;
+  const unsigned int *cells;	/* row-major, as in plot_grid */
+  double x_min, x_max, y_min, y_max;
+  size_t npoints, nbinned;
+};
+
+typedef struct sidecar sidecar_t;
+
+/* Returns input with ".cplot" appended, to be freed, or NULL. */
+char *sidecar_path(const char *const input);
+int sidecar_identify(const char *const input, struct sidecar_identity *const identity);
+/* Maps the sidecar at path if it was saved for this identity of the input, for the same key,
+ * describing how the input was read and binned, and for a grid of nrows by ncolumns cells. */
+bool sidecar_load(const char *const path, const struct sidecar_identity *const identity,
+                  const char *const key, const unsigned short nrows,
+                  const unsigned short ncolumns, sidecar_t *const sidecar);
+/* Saves the grid the input was binned into with the plot's ranges, unless the input no longer
+ * has the identity it had before it was read, in which case nothing is written. Returns 0, or
+ * -1 with errno set. */
+int sidecar_store(const char *const path, const char *const input,
+                  const struct sidecar_identity *const identity, const char *const key,
+                  const plot_info_t plot, const plot_grid_t *const grid, const size_t npoints,
+                  const size_t nbinned);
+void sidecar_release(sidecar_t *const sidecar);
+#endif
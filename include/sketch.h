@@ -0,0 +1,39 @@
+#ifndef __SKETCH_INC
+#define __SKETCH_INC
+#include <stddef.h>
+#include <stdint.h>
+
+#define SKETCH_DEFAULT_K 200
+
+struct sketch_level {
+  double *items;
+  size_t n, size;
+  size_t capacity;
+};
+
+/* A KLL quantile sketch: level h holds items standing for 2^h inputs each, and
+ * a full level is sorted and every other item promoted. Memory stays around 3k
+ * items however many values are added, and ranks are typically off by well
+ * under 1/k of the count. Values are kept exactly until the first level fills.
+ * Sketches of parts of the data may be merged. */
+struct sketch {
+  unsigned int k;
+  unsigned int nlevels;
+  struct sketch_level *levels;
+  size_t nitems;
+  size_t compress_at;		/* the sum of the level capacities */
+  size_t count;
+  double min, max;
+  uint64_t random;
+};
+
+typedef struct sketch sketch_t;
+
+int sketch_init(sketch_t *const sketch, const unsigned int k);
+/* Both return 0, or -1 with errno set if memory ran out. NaNs are ignored. */
+int sketch_add(sketch_t *const sketch, const double value);
+int sketch_merge(sketch_t *const sketch, const sketch_t *const other);
+/* Returns the value at quantile q in [0, 1], or NaN if the sketch is empty. */
+double sketch_quantile(const sketch_t *const sketch, const double q);
+void sketch_destroy(sketch_t *const sketch);
+#endif
@@ -0,0 +1,42 @@
+#ifndef __STATS_INC
+#define __STATS_INC
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum stats_phase {
+  STATS_READ, STATS_PARSE, STATS_EVALUATE, STATS_RANGE, STATS_BIN, STATS_RENDER, STATS_WRITE,
+  STATS_NPHASES
+};
+
+enum stats_counter {
+  STATS_CYCLES, STATS_INSTRUCTIONS, STATS_CACHE_MISSES, STATS_NCOUNTERS
+};
+
+struct stats_phase_totals {
+  size_t calls;
+  double wall, cpu;
+  uint64_t counters[STATS_NCOUNTERS];
+};
+
+/* Per-phase timings and totals. A NULL stats_t * is accepted everywhere and records nothing. */
+struct stats {
+  struct stats_phase_totals phases[STATS_NPHASES];
+  int counter_fds[STATS_NCOUNTERS];	/* -1 where perf_event_open is unavailable */
+
+  double start_wall, start_cpu;
+  uint64_t start_counters[STATS_NCOUNTERS];
+
+  size_t points_read, points_dropped;
+  size_t bytes_emitted;
+};
+
+typedef struct stats stats_t;
+
+void stats_init(stats_t *const stats);
+void stats_begin(stats_t *const stats);
+void stats_end(stats_t *const stats, const enum stats_phase phase);
+void stats_report(const stats_t *const stats, FILE *const stream);
+void stats_destroy(stats_t *const stats);
+#endif
@@ -0,0 +1,22 @@
+#ifndef __TIMESTAMP_INC
+#define __TIMESTAMP_INC
+#include <stddef.h>
+
+/* How a time field is read: ISO-8601 dates and times are understood in every mode, and plain
+ * numbers are seconds since the epoch, or milliseconds. Times are kept as seconds since the
+ * epoch. */
+enum time_format {
+  TIME_NONE, TIME_ISO, TIME_SECONDS, TIME_MILLISECONDS
+};
+
+/* Parses "2024-03-01", "2024-03-01T12:30", "2024-03-01 12:30:05.25" and the like, with an
+ * optional "Z" or "+hh:mm" offset, into seconds since the epoch in UTC, by fixed positions
+ * with no strptime or locale. Returns the end of the timestamp, or NULL if there is no date
+ * at p. */
+const char *timestamp_parse(const char *p, const char *const end, double *const seconds);
+/* Formats a time in UTC with as much of the date or time as labels from one time to another
+ * need, from "2024-03-01" down to "30:05.250", with the date whenever the range passes
+ * midnight. Returns the length, as snprintf does. */
+int timestamp_format(char *const buf, const size_t size, const double seconds,
+                     const double from, const double to);
+#endif
@@ -1,6 +1,7 @@
 #ifndef __TOKENIZER_INC
 #define __TOKENIZER_INC
-#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 enum token_type {
   TOKEN_STRING, TOKEN_NUMBER, TOKEN_ARITHMETIC_OPERATOR, TOKEN_FUNCTION, TOKEN_END, TOKEN_UNKNOWN, TOKEN_ERROR
@@ -18,7 +19,21 @@ struct token {
 
 typedef struct token token_t;
 
-token_t next_token(FILE *const stream);
-void push_back_token(const token_t token);
+/* All tokenizing state lives here, so independent tokenizers may run concurrently. */
+struct tokenizer {
+  const char *buf;
+  size_t len;
+  size_t pos;
+
+  token_t tok;
+  bool pushed_back;
+  bool long_names;		/* names go on with digits and underscores, as c2 */
+};
+
+typedef struct tokenizer tokenizer_t;
+
+void tokenizer_init(tokenizer_t *const t, const char *const buf, const size_t len);
+token_t next_token(tokenizer_t *const t);
+void push_back_token(tokenizer_t *const t, const token_t token);
 void token_destroy(const token_t token);
 #endif
@@ -0,0 +1,344 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "animate.h"
+#include "cplot.h"
+
+#define NSLOTS 2
+
+/* A frame the sampling thread has binned and the writer has not shown yet. */
+struct frame
+{
+  plot_grid_t grid;
+  long index;
+  bool ready;
+};
+
+struct animation
+{
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  struct frame frames[NSLOTS];
+  bool done;			/* no more frames will be produced */
+  bool stopping;		/* the writer gave up, stop producing */
+  size_t dropped;
+
+  expression_t exp;
+  plot_info_t plot;
+  double t_min;
+  double fps;
+  enum math_mode math;
+  long nframes;
+  struct timespec start;
+  point_t *points;
+  size_t npoints;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void
+request_stop (const int signal)
+{
+  (void) signal;
+  stop_requested = 1;
+}
+
+static double
+seconds_since (const struct timespec *const start)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static struct timespec
+frame_deadline (const struct animation *const a, const long index)
+{
+  const double offset = index / a->fps;
+  struct timespec deadline = a->start;
+  deadline.tv_sec += (time_t) offset;
+  deadline.tv_nsec += (long) ((offset - floor (offset)) * 1e9);
+  if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+    }
+
+  return deadline;
+}
+
+/* Samples frames into free slots in turn. Each frame is the one due at the
+ * moment sampling starts, so a slow expression skips frames instead of
+ * drifting behind the clock. */
+static void *
+produce_frames (void *const arg)
+{
+  struct animation *const a = arg;
+  long last = -1;
+
+  for (size_t slot = 0;; slot = (slot + 1) % NSLOTS)
+    {
+      struct frame *const f = &a->frames[slot];
+
+      pthread_mutex_lock (&a->lock);
+      while (f->ready && !a->stopping)
+	pthread_cond_wait (&a->changed, &a->lock);
+      const bool stopping = a->stopping;
+      pthread_mutex_unlock (&a->lock);
+      if (stopping)
+	break;
+
+      long index = (long) floor (seconds_since (&a->start) * a->fps);
+      if (index <= last)
+	index = last + 1;
+      if (index >= a->nframes)
+	break;
+
+      sample_expression_math (a->exp, a->plot.x_min, a->plot.x_max,
+			      a->t_min + index / a->fps, a->math, a->points,
+			      a->npoints);
+      plot_grid_clear (&f->grid);
+      plot_grid_add (&f->grid, a->points, a->npoints);
+
+      pthread_mutex_lock (&a->lock);
+      a->dropped += index - last - 1;
+      f->index = index;
+      f->ready = true;
+      pthread_cond_broadcast (&a->changed);
+      pthread_mutex_unlock (&a->lock);
+      last = index;
+    }
+
+  pthread_mutex_lock (&a->lock);
+  a->done = true;
+  pthread_cond_broadcast (&a->changed);
+  pthread_mutex_unlock (&a->lock);
+
+  return NULL;
+}
+
+/* Renders the whole first frame, or the difference from the frame on screen. */
+static ssize_t
+render_frame (const struct animation *const a, char **const buf,
+	      size_t *const size, const plot_grid_t * const shown,
+	      const plot_grid_t * const next, const bool first)
+{
+  for (;;)
+    {
+      const ssize_t len = first
+	? plot_render_grid (*buf, *size, a->plot, next)
+	: plot_render_diff (*buf, *size, a->plot, shown, next);
+      if (len < 0 || (size_t) len < *size)
+	return len;
+
+      char *const bigger = realloc (*buf, len + 1);
+      if (!bigger)
+	return -1;
+      *buf = bigger;
+      *size = len + 1;
+    }
+}
+
+static int
+show_frames (struct animation *const a, FILE * const out,
+	     plot_grid_t * const shown, size_t *const nshown)
+{
+  size_t size = 16384;
+  char *buf = malloc (size);
+  if (!buf)
+    return -1;
+
+  int ret = 0;
+  for (size_t slot = 0;; slot = (slot + 1) % NSLOTS)
+    {
+      struct frame *const f = &a->frames[slot];
+
+      pthread_mutex_lock (&a->lock);
+      while (!f->ready && !a->done)
+	pthread_cond_wait (&a->changed, &a->lock);
+      const bool ready = f->ready;
+      pthread_mutex_unlock (&a->lock);
+      if (!ready)
+	break;
+
+      const struct timespec deadline = frame_deadline (a, f->index);
+      while (!stop_requested
+	     && clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+				 NULL) == EINTR)
+	;
+      if (stop_requested)
+	break;
+
+      const ssize_t len =
+	render_frame (a, &buf, &size, shown, &f->grid, *nshown == 0);
+      if (len < 0)
+	{
+	  ret = -1;
+	  break;
+	}
+      if (*nshown == 0)
+	fputs ("\033[?25l\033[H\033[2J", out);
+      if (fwrite (buf, 1, len, out) != (size_t) len || fflush (out) != 0)
+	{
+	  ret = -1;
+	  break;
+	}
+
+      memcpy (shown->cells, f->grid.cells,
+	      (size_t) shown->nrows * shown->ncolumns * sizeof (*shown->cells));
+      ++*nshown;
+
+      pthread_mutex_lock (&a->lock);
+      f->ready = false;
+      pthread_cond_broadcast (&a->changed);
+      pthread_mutex_unlock (&a->lock);
+    }
+
+  free (buf);
+  return ret;
+}
+
+int
+animate (const struct options *const o, FILE * const out)
+{
+  struct options fitted = *o;
+  fitted.x_min_set = fitted.x_max_set = true;
+
+  if (!(o->t_max >= o->t_min))
+    {
+      fputs ("Error: --t-max must not be less than --t-min.\n", stderr);
+      return -1;
+    }
+
+  const expression_t exp =
+    parse_expression (o->expression, strlen (o->expression));
+  if (!check_parser_errors (exp))
+    {
+      fputs ("Could not parse expression", stderr);
+      expression_destroy (exp);
+      return -1;
+    }
+  else if (!check_variables (exp))
+    {
+      fputs ("Unknown variable in expression", stderr);
+      expression_destroy (exp);
+      return -1;
+    }
+
+  struct animation a = {
+    .exp = exp,
+    .t_min = o->t_min,
+    .fps = o->fps,
+    .math = o->math,
+    .nframes = (long) floor ((o->t_max - o->t_min) * o->fps) + 1,
+    .npoints = samples_per_column (o->plot) * o->plot.ncolumns,
+  };
+  a.points = malloc (a.npoints * sizeof (*a.points));
+  if (!a.points)
+    {
+      perror ("");
+      expression_destroy (exp);
+      return -1;
+    }
+
+  /* The y-range is fitted once, to the first frame, so the axes stay put */
+  sample_expression_math (exp, o->plot.x_min, o->plot.x_max, o->t_min,
+			  o->math, a.points, a.npoints);
+  struct expression_range range;
+  options_fit_expression (&fitted, exp, o->t_min, &range);
+  options_fit_ranges (&fitted, a.points, a.npoints);
+  a.plot = fitted.plot;
+
+  const char *const error = plot_check_info (a.plot);
+  if (error)
+    {
+      fputs (error, out);
+      free (a.points);
+      expression_destroy (exp);
+      return -1;
+    }
+
+  plot_grid_t shown = {.cells = NULL };
+  int ret = plot_grid_init (&shown, a.plot);
+  size_t nslots = 0;
+  for (; ret == 0 && nslots < NSLOTS; ++nslots)
+    if (plot_grid_init (&a.frames[nslots].grid, a.plot) != 0)
+      ret = -1;
+  if (ret != 0)
+    {
+      perror ("");
+      goto out;
+    }
+
+  pthread_mutex_init (&a.lock, NULL);
+  pthread_cond_init (&a.changed, NULL);
+
+  /* only the writing thread should see the stop signals */
+  sigset_t stop_signals, old_mask;
+  sigemptyset (&stop_signals);
+  sigaddset (&stop_signals, SIGINT);
+  sigaddset (&stop_signals, SIGTERM);
+
+  struct sigaction sa, old_int, old_term;
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = request_stop;	/* no SA_RESTART, so sleeps are interrupted */
+  sigaction (SIGINT, &sa, &old_int);
+  sigaction (SIGTERM, &sa, &old_term);
+
+  clock_gettime (CLOCK_MONOTONIC, &a.start);
+  pthread_t producer;
+  pthread_sigmask (SIG_BLOCK, &stop_signals, &old_mask);
+  const int create_error =
+    pthread_create (&producer, NULL, produce_frames, &a);
+  pthread_sigmask (SIG_SETMASK, &old_mask, NULL);
+
+  size_t nshown = 0;
+  if (create_error)
+    {
+      errno = create_error;
+      perror ("");
+      ret = -1;
+    }
+  else
+    {
+      ret = show_frames (&a, out, &shown, &nshown);
+
+      pthread_mutex_lock (&a.lock);
+      a.stopping = true;
+      pthread_cond_broadcast (&a.changed);
+      pthread_mutex_unlock (&a.lock);
+      pthread_join (producer, NULL);
+    }
+
+  sigaction (SIGINT, &old_int, NULL);
+  sigaction (SIGTERM, &old_term, NULL);
+
+  /* leave the cursor below the frame, with default colors */
+  if (nshown > 0)
+    {
+      fprintf (out, "\033[0m\033[%u;1H\033[?25h", a.plot.nrows + 2u);
+      fflush (out);
+    }
+
+  if (o->stats)
+    fprintf (stderr, "stats frames_shown=%zu frames_dropped=%zu\n", nshown,
+	     a.dropped);
+
+  pthread_cond_destroy (&a.changed);
+  pthread_mutex_destroy (&a.lock);
+
+out:
+  while (nslots > 0)
+    plot_grid_destroy (&a.frames[--nslots].grid);
+  plot_grid_destroy (&shown);
+  free (a.points);
+  expression_destroy (exp);
+
+  return ret;
+}
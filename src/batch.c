@@ -0,0 +1,440 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "batch.h"
+#include "cplot.h"
+#include "input.h"
+#include "options.h"
+#include "pool.h"
+
+#define MAX_JOB_ARGS 128
+
+/* An input file shared by all the jobs that read it alike; loaded by whichever
+ * job gets to it first and freed by the last one. */
+struct batch_input
+{
+  pthread_mutex_t lock;
+  const struct options *o;	/* of the first job reading it */
+  bool loaded;
+  int error;
+  point_t *points;
+  size_t npoints;
+  size_t users;
+};
+
+struct batch_job
+{
+  size_t line;
+  char *text;
+  struct options o;
+  struct batch_input *input;
+
+  bool failed;
+  char error[128];
+  size_t npoints;
+  double load_time, render_time;
+};
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+fail (struct batch_job *const job, const char *const message)
+{
+  job->failed = true;
+  snprintf (job->error, sizeof job->error, "%s", message);
+}
+
+static void
+load_input (struct batch_input *const input)
+{
+  pthread_mutex_lock (&input->lock);
+  if (!input->loaded)
+    {
+      FILE *const file = fopen (input->o->file_name, "r");
+      if (file)
+	{
+	  size_t nread;
+	  input->points = read_input (file, input->o->file_name, input->o,
+				      &input->npoints, &nread, NULL, NULL);
+	  if (!input->points)
+	    input->error = errno;
+	  fclose (file);
+	}
+      else
+	input->error = errno;
+
+      input->loaded = true;
+    }
+  pthread_mutex_unlock (&input->lock);
+}
+
+static void
+release_input (struct batch_input *const input)
+{
+  pthread_mutex_lock (&input->lock);
+  if (--input->users == 0)
+    {
+      free (input->points);
+      input->points = NULL;
+    }
+  pthread_mutex_unlock (&input->lock);
+}
+
+static void
+run_job (void *const arg, const size_t worker)
+{
+  struct batch_job *const job = arg;
+  (void) worker;
+
+  const double start = now ();
+  point_t *points = NULL;
+  point_t *owned = NULL;
+  size_t npoints = 0;
+
+  switch (job->o.source)
+    {
+    case INPUT_FILE:
+      load_input (job->input);
+      if (job->input->error)
+	{
+	  fail (job, csv_strerror (&job->o.csv, job->input->error));
+	  release_input (job->input);
+	  return;
+	}
+      points = job->input->points;
+      npoints = job->input->npoints;
+      break;
+    case INPUT_EXPRESSION:
+      {
+	const expression_t exp =
+	  parse_expression (job->o.expression, strlen (job->o.expression));
+	if (!check_parser_errors (exp)
+	    || !(job->o.implicit ? check_implicit_variables (exp)
+		 : check_variables (exp)))
+	  {
+	    fail (job, "could not parse expression");
+	    expression_destroy (exp);
+	    return;
+	  }
+
+	if (job->o.implicit)
+	  {
+	    owned = points =
+	      sample_implicit (exp, job->o.plot, 0, &npoints, NULL);
+	    expression_destroy (exp);
+	    if (!points)
+	      {
+		fail (job, strerror (errno));
+		return;
+	      }
+	    job->o.plot.lines = false;
+	    job->o.x_min_set = job->o.x_max_set = true;
+	    job->o.y_min_set = job->o.y_max_set = true;
+	    break;
+	  }
+
+	npoints = samples_per_column (job->o.plot) * job->o.plot.ncolumns;
+	owned = points = malloc (npoints * sizeof (*points));
+	if (!points)
+	  {
+	    fail (job, strerror (errno));
+	    expression_destroy (exp);
+	    return;
+	  }
+
+	sample_expression_math (exp, job->o.plot.x_min, job->o.plot.x_max, 0,
+				job->o.math, points, npoints);
+	struct expression_range range;
+	options_fit_expression (&job->o, exp, 0, &range);
+	expression_destroy (exp);
+	job->o.x_min_set = true;
+	job->o.x_max_set = true;
+	break;
+      }
+    case INPUT_STDIN:
+      fail (job, "batch jobs need --file or --expression");
+      return;
+    }
+
+  const double loaded = now ();
+  job->load_time = loaded - start;
+  job->npoints = npoints;
+
+  options_fit_ranges (&job->o, points, npoints);
+
+  FILE *const out = fopen (job->o.output, "w");
+  if (!out)
+    fail (job, strerror (errno));
+  else
+    {
+      plot (out, job->o.plot, points, npoints);
+      if (fclose (out) != 0)
+	fail (job, strerror (errno));
+    }
+
+  job->render_time = now () - loaded;
+  free (owned);
+  if (job->input)
+    release_input (job->input);
+}
+
+static int
+text_cmp (const char *const s1, const char *const s2)
+{
+  if (!s1 || !s2)
+    return (s1 != NULL) - (s2 != NULL);
+  return strcmp (s1, s2);
+}
+
+#define CMP(a, b) ((a) < (b) ? -1 : (a) > (b))
+
+/* Jobs share an input if they read the same file into the same points */
+static int
+input_cmp (const void *const p1, const void *const p2)
+{
+  const struct options *const o1 = &(*(struct batch_job * const *) p1)->o;
+  const struct options *const o2 = &(*(struct batch_job * const *) p2)->o;
+  const struct csv_format *const f1 = &o1->csv, *const f2 = &o2->csv;
+
+  int ret = strcmp (o1->file_name, o2->file_name);
+  if (ret == 0)
+    ret = CMP (o1->csv_set, o2->csv_set);
+  if (ret == 0 && o1->csv_set)
+    {
+      ret = CMP (f1->delimiter, f2->delimiter);
+      if (ret == 0)
+	ret = CMP (f1->x_column, f2->x_column);
+      if (ret == 0)
+	ret = CMP (f1->y_column, f2->y_column);
+      if (ret == 0)
+	ret = CMP (f1->skip_header, f2->skip_header);
+      if (ret == 0)
+	ret = CMP (f1->x_time, f2->x_time);
+      if (ret == 0)
+	ret = text_cmp (f1->x_expr, f2->x_expr);
+      if (ret == 0)
+	ret = text_cmp (f1->y_expr, f2->y_expr);
+      if (ret == 0)
+	ret = CMP (f1->math, f2->math);
+    }
+  if (ret == 0)
+    ret = CMP (o1->sample, o2->sample);
+  if (ret == 0 && o1->sample > 0)
+    ret = CMP (o1->seed, o2->seed);
+  return ret;
+}
+
+/* Gives every job reading a file the input entry shared by all jobs reading it
+ * alike. */
+static struct batch_input *
+share_inputs (struct batch_job *const jobs, const size_t njobs,
+	      size_t *const ninputs)
+{
+  struct batch_job **const readers = malloc (njobs * sizeof (*readers));
+  struct batch_input *const inputs = calloc (njobs, sizeof (*inputs));
+  if (!readers || !inputs)
+    {
+      free (readers);
+      free (inputs);
+      return NULL;
+    }
+
+  size_t nreaders = 0;
+  for (size_t i = 0; i < njobs; ++i)
+    if (!jobs[i].failed && jobs[i].o.source == INPUT_FILE)
+      readers[nreaders++] = &jobs[i];
+
+  qsort (readers, nreaders, sizeof *readers, input_cmp);
+
+  *ninputs = 0;
+  for (size_t i = 0; i < nreaders; ++i)
+    {
+      if (i == 0 || input_cmp (&readers[i - 1], &readers[i]) != 0)
+	{
+	  struct batch_input *const input = &inputs[(*ninputs)++];
+	  pthread_mutex_init (&input->lock, NULL);
+	  input->o = &readers[i]->o;
+	}
+
+      readers[i]->input = &inputs[*ninputs - 1];
+      ++readers[i]->input->users;
+    }
+
+  free (readers);
+  return inputs;
+}
+
+static char *
+read_manifest (const char *const path)
+{
+  FILE *const file = fopen (path, "r");
+  if (!file)
+    return NULL;
+
+  char *text = NULL;
+  size_t len = 0;
+  FILE *const stream = open_memstream (&text, &len);
+  if (stream)
+    {
+      char buf[BUFSIZ];
+      size_t n;
+      while ((n = fread (buf, 1, sizeof buf, file)) > 0)
+	fwrite (buf, 1, n, stream);
+      fclose (stream);
+    }
+
+  fclose (file);
+  return text;
+}
+
+static struct batch_job *
+parse_manifest (char *const text, size_t *const njobs)
+{
+  size_t size = 16;
+  struct batch_job *jobs = malloc (size * sizeof (*jobs));
+  if (!jobs)
+    return NULL;
+
+  *njobs = 0;
+  size_t line = 0;
+  for (char *s = text, *next; s && *s; s = next)
+    {
+      ++line;
+      next = strchr (s, '\n');
+      if (next)
+	*next++ = '\0';
+
+      s += strspn (s, " \t\r");
+      if (*s == '\0' || *s == '#')
+	continue;
+
+      if (*njobs == size)
+	{
+	  size *= 2;
+	  struct batch_job *const buf = realloc (jobs, size * sizeof (*jobs));
+	  if (!buf)
+	    {
+	      free (jobs);
+	      return NULL;
+	    }
+	  jobs = buf;
+	}
+
+      struct batch_job *const job = &jobs[(*njobs)++];
+      memset (job, 0, sizeof *job);
+      job->line = line;
+      job->text = s;
+
+      char *argv[MAX_JOB_ARGS];
+      const char *unsupported;
+      const int argc = options_split (s, argv, MAX_JOB_ARGS);
+      options_init (&job->o);
+      if (argc < 0)
+	fail (job, "malformed options line");
+      else if (options_parse (&job->o, argc, argv, job->error,
+			      sizeof job->error) != 0)
+	job->failed = true;
+      else if (!job->o.output)
+	fail (job, "no --output given");
+      else if ((unsupported = options_job_unsupported (&job->o, false)))
+	{
+	  job->failed = true;
+	  snprintf (job->error, sizeof job->error,
+		    "%s is not supported in batch jobs", unsupported);
+	}
+    }
+
+  return jobs;
+}
+
+static void
+print_summary (const struct batch_job *const jobs, const size_t njobs,
+	       const size_t ninputs, const double elapsed)
+{
+  size_t nfailed = 0;
+  double total = 0;
+
+  fprintf (stderr, "%-6s %-6s %-6s %10s %10s %10s %10s  %s\n", "job",
+	   "line", "status", "points", "load_ms", "render_ms", "total_ms",
+	   "output");
+  for (size_t i = 0; i < njobs; ++i)
+    {
+      const struct batch_job *const job = &jobs[i];
+      const double job_total = job->load_time + job->render_time;
+      total += job_total;
+
+      if (job->failed)
+	{
+	  ++nfailed;
+	  fprintf (stderr, "%-6zu %-6zu %-6s %10s %10s %10s %10s  %s\n",
+		   i + 1, job->line, "failed", "-", "-", "-", "-",
+		   job->error);
+	}
+      else
+	fprintf (stderr,
+		 "%-6zu %-6zu %-6s %10zu %10.3f %10.3f %10.3f  %s\n", i + 1,
+		 job->line, "ok", job->npoints, job->load_time * 1e3,
+		 job->render_time * 1e3, job_total * 1e3, job->o.output);
+    }
+
+  fprintf (stderr,
+	   "batch: jobs=%zu failed=%zu inputs=%zu seconds=%.3f "
+	   "job_seconds=%.3f\n", njobs, nfailed, ninputs, elapsed, total);
+}
+
+int
+batch (const char *const manifest, const unsigned int nthreads)
+{
+  char *const text = read_manifest (manifest);
+  if (!text)
+    {
+      perror (manifest);
+      return -1;
+    }
+
+  size_t njobs, ninputs;
+  struct batch_job *const jobs = parse_manifest (text, &njobs);
+  struct batch_input *const inputs =
+    jobs ? share_inputs (jobs, njobs, &ninputs) : NULL;
+  pool_t *const pool = inputs ? pool_create (nthreads) : NULL;
+  if (!pool)
+    {
+      perror ("");
+      free (inputs);
+      free (jobs);
+      free (text);
+      return -1;
+    }
+
+  const double start = now ();
+  for (size_t i = 0; i < njobs; ++i)
+    if (!jobs[i].failed && pool_submit (pool, run_job, &jobs[i]) != 0)
+      fail (&jobs[i], strerror (errno));
+  pool_wait (pool);
+  const double elapsed = now () - start;
+  pool_destroy (pool);
+
+  print_summary (jobs, njobs, ninputs, elapsed);
+
+  int ret = 0;
+  for (size_t i = 0; i < njobs; ++i)
+    if (jobs[i].failed)
+      ret = -1;
+
+  for (size_t i = 0; i < ninputs; ++i)
+    pthread_mutex_destroy (&inputs[i].lock);
+  free (inputs);
+  free (jobs);
+  free (text);
+  return ret;
+}
@@ -0,0 +1,440 @@
+#define _GNU_SOURCE
+#include "cache.h"
+#include "replace.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "CPLOTPC3"
+#define CACHE_SUFFIX ".pts"
+#define CACHE_STATS_FILE "stats"
+#define CACHE_STALE_SECONDS 600	/* before a temporary file is left over */
+
+struct cache_header
+{
+  char magic[8];
+  uint64_t key_length;
+  uint64_t npoints;
+  uint64_t ranged;
+  double y_min, y_max;
+  uint64_t nsingularities;
+  double singularities[EXPRESSION_MAX_SINGULARITIES];
+};
+
+struct cache_file
+{
+  char *name;
+  off_t size;
+  struct timespec mtime;
+};
+
+static inline bool
+is_word_char (const int c)
+{
+  return isalnum (c) || c == '.';
+}
+
+/* Whitespace is dropped except where it separates two words, so "sin x" and
+ * "sinx" never share a key. */
+static size_t
+normalize_expression (char *const dst, const char *src)
+{
+  size_t n = 0;
+  int last = 0;
+
+  while (*src)
+    {
+      const unsigned char c = *src++;
+      if (isspace (c))
+	{
+	  while (isspace ((unsigned char) *src))
+	    ++src;
+	  if (last && is_word_char (last) && is_word_char ((unsigned char) *src))
+	    dst[n++] = ' ';
+	  continue;
+	}
+
+      dst[n++] = c;
+      last = c;
+    }
+
+  dst[n] = '\0';
+  return n;
+}
+
+static uint64_t
+hash_key (const char *const key)
+{
+  uint64_t h = 14695981039346656037ULL;	/* FNV-1a */
+  for (const unsigned char *s = (const unsigned char *) key; *s; ++s)
+    {
+      h ^= *s;
+      h *= 1099511628211ULL;
+    }
+
+  return h;
+}
+
+static char *
+entry_path (const cache_t * const cache, const char *const key)
+{
+  char *path;
+  if (asprintf (&path, "%s/%016llx" CACHE_SUFFIX, cache->dir,
+		(unsigned long long) hash_key (key)) < 0)
+    return NULL;
+
+  return path;
+}
+
+static inline size_t
+points_offset (const size_t key_length)
+{
+  const size_t offset = sizeof (struct cache_header) + key_length;
+  return (offset + sizeof (double) - 1) & ~(sizeof (double) - 1);
+}
+
+static void
+count_access (const cache_t * const cache, const bool hit)
+{
+  char *path;
+  if (asprintf (&path, "%s/" CACHE_STATS_FILE, cache->dir) < 0)
+    return;
+
+  const int fd = open (path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    {
+      free (path);
+      return;
+    }
+
+  /* statistics are best-effort, so failures only lose counts; counters
+   * that could not be written whole are dropped rather than left torn */
+  if (flock (fd, LOCK_EX) == 0)
+    {
+      uint64_t counters[2] = { 0, 0 };
+      if (pread (fd, counters, sizeof counters, 0) != sizeof counters)
+	counters[0] = counters[1] = 0;
+
+      ++counters[hit ? 0 : 1];
+      if (pwrite (fd, counters, sizeof counters, 0) != sizeof counters
+	  && ftruncate (fd, 0) != 0)
+	unlink (path);
+      flock (fd, LOCK_UN);
+    }
+
+  close (fd);
+  free (path);
+}
+
+char *
+cache_make_key (const char *const expression, const double x_min,
+		const double x_max, const unsigned short ncolumns,
+		const size_t samples_per_column, const enum math_mode mode)
+{
+  char *const normalized = malloc (strlen (expression) + 1);
+  if (!normalized)
+    return NULL;
+
+  normalize_expression (normalized, expression);
+
+  /* only the x-range determines the samples, so the y-range is not part of
+   * the key; fast math is marked so precise keys stay as they were */
+  char *key;
+  if (asprintf (&key, "%s|%a|%a|%hu|%zu%s", normalized, x_min, x_max,
+		ncolumns, samples_per_column,
+		mode == MATH_FAST ? "|fast" : "") < 0)
+    key = NULL;
+
+  free (normalized);
+  return key;
+}
+
+bool
+cache_lookup (const cache_t * const cache, const char *const key,
+	      cache_entry_t * const entry)
+{
+  char *const path = entry_path (cache, key);
+  if (!path)
+    return false;
+
+  const int fd = open (path, O_RDONLY);
+  if (fd < 0)
+    {
+      free (path);
+      count_access (cache, false);
+      return false;
+    }
+
+  const size_t key_length = strlen (key);
+  struct stat st;
+  struct cache_header header;
+  bool hit = false;
+
+  if (fstat (fd, &st) == 0
+      && pread (fd, &header, sizeof header, 0) == sizeof header
+      && memcmp (header.magic, CACHE_MAGIC, sizeof header.magic) == 0
+      && header.key_length == key_length
+      && (size_t) st.st_size ==
+      points_offset (key_length) + header.npoints * sizeof (point_t))
+    {
+      void *const map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+	{
+	  if (memcmp ((char *) map + sizeof header, key, key_length) == 0)
+	    {
+	      entry->map = map;
+	      entry->map_size = st.st_size;
+	      entry->points =
+		(point_t *) ((char *) map + points_offset (key_length));
+	      entry->npoints = header.npoints;
+	      entry->ranged = header.ranged;
+	      entry->range.y_min = header.y_min;
+	      entry->range.y_max = header.y_max;
+	      entry->range.nevaluations = 0;
+	      entry->range.nsingularities = header.nsingularities;
+	      memcpy (entry->range.singularities, header.singularities,
+		      sizeof header.singularities);
+	      hit = true;
+
+	      /* the modification time orders entries for eviction */
+	      futimens (fd, NULL);
+	    }
+	  else
+	    munmap (map, st.st_size);
+	}
+    }
+
+  close (fd);
+  free (path);
+  count_access (cache, hit);
+  return hit;
+}
+
+void
+cache_release (cache_entry_t * const entry)
+{
+  munmap (entry->map, entry->map_size);
+  entry->map = NULL;
+  entry->points = NULL;
+  entry->npoints = 0;
+}
+
+static int
+file_mtime_cmp (const void *const p1, const void *const p2)
+{
+  const struct cache_file *const f1 = p1;
+  const struct cache_file *const f2 = p2;
+
+  if (f1->mtime.tv_sec != f2->mtime.tv_sec)
+    return f1->mtime.tv_sec < f2->mtime.tv_sec ? -1 : 1;
+  else if (f1->mtime.tv_nsec != f2->mtime.tv_nsec)
+    return f1->mtime.tv_nsec < f2->mtime.tv_nsec ? -1 : 1;
+
+  return 0;
+}
+
+static void
+free_files (struct cache_file *const files, const size_t nfiles)
+{
+  for (size_t i = 0; i < nfiles; ++i)
+    free (files[i].name);
+  free (files);
+}
+
+/* Whether the name is one of an entry, or if temporary, of an entry being
+ * written by replace_file */
+static bool
+is_entry_name (const char *const name, const bool temporary)
+{
+  const size_t suffix = strlen (CACHE_SUFFIX);
+  const size_t letters = temporary ? 1 + REPLACE_TEMP_LETTERS : 0;
+  const size_t len = strlen (name);
+  return len > suffix + letters
+    && strncmp (name + len - letters - suffix, CACHE_SUFFIX, suffix) == 0
+    && (!temporary || name[len - letters] == '.');
+}
+
+/* If sweep, the temporary files of stores that never finished, such as those
+ * of killed processes, are removed as they are found; they are told from
+ * stores still writing by their age. */
+static struct cache_file *
+list_entries (const cache_t * const cache, const bool sweep,
+	      size_t *const nfiles)
+{
+  DIR *const dir = opendir (cache->dir);
+  if (!dir)
+    return NULL;
+
+  size_t size = 16;
+  size_t index = 0;
+  struct cache_file *files = malloc (size * sizeof (*files));
+  if (!files)
+    {
+      closedir (dir);
+      return NULL;
+    }
+
+  const int dfd = dirfd (dir);
+  struct dirent *d;
+  while ((d = readdir (dir)))
+    {
+      const bool temporary = is_entry_name (d->d_name, true);
+      if (!temporary && !is_entry_name (d->d_name, false))
+	continue;
+
+      struct stat st;
+      if (fstatat (dfd, d->d_name, &st, 0) != 0)
+	continue;
+
+      if (temporary)
+	{
+	  if (sweep && time (NULL) - st.st_mtim.tv_sec > CACHE_STALE_SECONDS)
+	    unlinkat (dfd, d->d_name, 0);
+	  continue;
+	}
+
+      if (index == size)
+	{
+	  size *= 2;
+	  struct cache_file *const buf =
+	    realloc (files, size * sizeof (*files));
+	  if (!buf)
+	    break;
+	  files = buf;
+	}
+
+      files[index].name = strdup (d->d_name);
+      if (!files[index].name)
+	break;
+      files[index].size = st.st_size;
+      files[index].mtime = st.st_mtim;
+      ++index;
+    }
+
+  closedir (dir);
+  *nfiles = index;
+  return files;
+}
+
+static void
+evict (const cache_t * const cache)
+{
+  size_t nfiles;
+  struct cache_file *const files = list_entries (cache, true, &nfiles);
+  if (!files)
+    return;
+
+  size_t total = 0;
+  for (size_t i = 0; i < nfiles; ++i)
+    total += files[i].size;
+
+  if (total > cache->max_size)
+    {
+      qsort (files, nfiles, sizeof *files, file_mtime_cmp);
+
+      const int dfd = open (cache->dir, O_RDONLY | O_DIRECTORY);
+      for (size_t i = 0; dfd >= 0 && i < nfiles && total > cache->max_size;
+	   ++i)
+	if (unlinkat (dfd, files[i].name, 0) == 0)
+	  total -= files[i].size;
+
+      if (dfd >= 0)
+	close (dfd);
+    }
+
+  free_files (files, nfiles);
+}
+
+int
+cache_store (const cache_t * const cache, const char *const key,
+	     const point_t * const points, const size_t npoints,
+	     const struct expression_range *const range)
+{
+  const size_t key_length = strlen (key);
+  const size_t size = points_offset (key_length) + npoints * sizeof (*points);
+  if (size > cache->max_size)
+    return 0;			/* never worth evicting everything for */
+
+  char *const path = entry_path (cache, key);
+  if (!path)
+    return -1;
+
+  struct cache_header header;
+  memset (&header, 0, sizeof header);
+  memcpy (header.magic, CACHE_MAGIC, sizeof header.magic);
+  header.key_length = key_length;
+  header.npoints = npoints;
+  if (range)
+    {
+      header.ranged = 1;
+      header.y_min = range->y_min;
+      header.y_max = range->y_max;
+      header.nsingularities = range->nsingularities;
+      memcpy (header.singularities, range->singularities,
+	      sizeof header.singularities);
+    }
+
+  const char padding[sizeof (double)] = { 0 };
+  const size_t npadding =
+    points_offset (key_length) - sizeof header - key_length;
+
+  const struct iovec parts[] = {
+    {&header, sizeof header},
+    {(char *) key, key_length},
+    {(char *) padding, npadding},
+    {(point_t *) points, npoints * sizeof (*points)}
+  };
+  const int ret = replace_file (path, parts, sizeof parts / sizeof *parts);
+  if (ret == 0)
+    evict (cache);
+
+  free (path);
+  return ret;
+}
+
+int
+cache_get_stats (const cache_t * const cache,
+		 struct cache_stats *const stats)
+{
+  memset (stats, 0, sizeof *stats);
+
+  size_t nfiles;
+  struct cache_file *const files = list_entries (cache, false, &nfiles);
+  if (!files)
+    return -1;
+
+  stats->entries = nfiles;
+  for (size_t i = 0; i < nfiles; ++i)
+    stats->bytes += files[i].size;
+  free_files (files, nfiles);
+
+  char *path;
+  if (asprintf (&path, "%s/" CACHE_STATS_FILE, cache->dir) < 0)
+    return -1;
+
+  const int fd = open (path, O_RDONLY);
+  free (path);
+  if (fd >= 0)
+    {
+      uint64_t counters[2];
+      if (pread (fd, counters, sizeof counters, 0) == sizeof counters)
+	{
+	  stats->hits = counters[0];
+	  stats->misses = counters[1];
+	}
+      close (fd);
+    }
+
+  return 0;
+}
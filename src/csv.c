@@ -0,0 +1,668 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include "csv.h"
+#include "evaluator.h"
+#include "parser.h"
+
+#define CSV_CHUNK (1 << 20)
+#define CSV_SLACK 8		/* digits are loaded 8 at a time past a field */
+#define TRANSFORM_ROWS 256	/* lines parsed before the expressions run */
+#define TRANSFORM_MAX_FIELDS 64
+
+/* The fields the expressions use, parsed a block of lines at a time into a
+ * column of values each. A coordinate without an expression is a field too. */
+struct csv_transform
+{
+  unsigned int fields[TRANSFORM_MAX_FIELDS];	/* counting from 1, ascending */
+  size_t nfields;
+  column_expression_t *x, *y;
+  size_t x_field, y_field;	/* when there is no expression */
+  double *values;		/* TRANSFORM_ROWS per field */
+  const double *columns[TRANSFORM_MAX_FIELDS];
+  double xs[TRANSFORM_ROWS], ys[TRANSFORM_ROWS];
+};
+
+/* Returns the first c in [p, end), or end */
+static inline const char *
+find_byte (const char *p, const char *const end, const char c)
+{
+#ifdef __AVX2__
+  const __m256i wide = _mm256_set1_epi8 (c);
+  for (; end - p >= 32; p += 32)
+    {
+      const __m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+      const unsigned int mask =
+	_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, wide));
+      if (mask)
+	return p + __builtin_ctz (mask);
+    }
+#endif
+#ifdef __SSE2__
+  const __m128i narrow = _mm_set1_epi8 (c);
+  for (; end - p >= 16; p += 16)
+    {
+      const __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+      const unsigned int mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, narrow));
+      if (mask)
+	return p + __builtin_ctz (mask);
+    }
+#endif
+  while (p < end && *p != c)
+    ++p;
+
+  return p;
+}
+
+/* Fields are split at each delimiter, but a blank one splits them at runs of
+ * blanks and tabs instead, and leaves out blanks before the first field. */
+static inline const char *
+skip_blanks (const char *p, const char *const end, const char delimiter)
+{
+  if (delimiter == ' ')
+    while (p < end && (*p == ' ' || *p == '\t'))
+      ++p;
+
+  return p;
+}
+
+/* Returns the end of the field at p */
+static inline const char *
+find_delimiter (const char *p, const char *const end, const char delimiter)
+{
+  if (delimiter != ' ')
+    return find_byte (p, end, delimiter);
+
+  while (p < end && *p != ' ' && *p != '\t')
+    ++p;
+
+  return p;
+}
+
+static const unsigned long long powers_of_ten[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL
+};
+
+/* Appends the run of digits at p to *mantissa, eight bytes at a time where the
+ * byte order allows, without a branch per digit. The buffer must extend 8
+ * bytes past end. */
+static inline const char *
+parse_digits (const char *p, const char *const end,
+	      unsigned long long *const mantissa)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (;;)
+    {
+      unsigned long long chunk;
+      memcpy (&chunk, p, sizeof chunk);
+
+      /* A byte is a digit if its high nibble is 3 and adding 6 keeps it so */
+      const unsigned long long other =
+	((chunk & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL)
+	| (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL)
+	   ^ 0x3030303030303030ULL);
+      size_t n = other ? (size_t) __builtin_ctzll (other) / 8 : 8;
+      if (n > (size_t) (end - p))
+	n = end - p;
+      if (n == 0)
+	return p;
+
+      /* Left-align the digits so the unused low bytes read as leading zeros */
+      unsigned long long v = (chunk & 0x0F0F0F0F0F0F0F0FULL) << (8 * (8 - n));
+      v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFULL;
+      v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFFULL;
+      v = (v * 10000 + (v >> 32)) & 0x00000000FFFFFFFFULL;
+      *mantissa = *mantissa * powers_of_ten[n] + v;
+
+      p += n;
+      if (n < 8)
+	return p;
+    }
+#else
+  for (unsigned int d; p < end && (d = (unsigned char) *p - '0') <= 9; ++p)
+    *mantissa = 10 * *mantissa + d;
+  return p;
+#endif
+}
+
+/* Plain decimals whose digits and power of ten are both exact doubles are
+ * converted with a single division, which rounds correctly just as strtod
+ * does. Returns NULL for anything else, which is left to strtod. */
+static const char *
+parse_decimal (const char *p, const char *const end, double *const value)
+{
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  while (p < end && (*p == ' ' || *p == '\t'))
+    ++p;
+
+  const bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+'))
+    ++p;
+
+  unsigned long long mantissa = 0;
+  const char *const integer = p;
+  p = parse_digits (p, end, &mantissa);
+  int ndigits = p - integer, exponent = 0;
+
+  if (p < end && *p == '.')
+    {
+      const char *const fraction = ++p;
+      p = parse_digits (p, end, &mantissa);
+      exponent = fraction - p;
+      ndigits -= exponent;
+    }
+
+  if (ndigits == 0 || ndigits > 19)
+    return NULL;
+  if (p < end && (*p == 'e' || *p == 'E' || *p == 'x' || *p == 'X'))
+    return NULL;
+  if (mantissa > (1ULL << 53) || exponent < -22)
+    return NULL;
+
+  const double d = (double) mantissa;
+  *value = negative ? -d / powers[-exponent] : d / powers[-exponent];
+  return p;
+}
+
+/* Fields may be padded with blanks, and the last one followed by a '\r'.
+ * Time fields may also be ISO-8601 dates. */
+static bool
+parse_field (const char *const field, const char *const end,
+	     const enum time_format time, double *const value)
+{
+  const char *after = time != TIME_NONE
+    ? timestamp_parse (field, end, value) : NULL;
+  if (!after)
+    {
+      after = parse_decimal (field, end, value);
+      if (!after)
+	{
+	  char *strtod_end;
+	  *value = strtod (field, &strtod_end);
+	  after = strtod_end;
+	}
+      if (time == TIME_MILLISECONDS)
+	*value /= 1000;
+    }
+  if (after == field || after > end)
+    return false;
+
+  for (; after < end; ++after)
+    if (*after != ' ' && *after != '\t' && *after != '\r')
+      return false;
+
+  return true;
+}
+
+static bool
+parse_line (const struct csv_format *const f, const char *field,
+	    const char *const end, point_t * const point)
+{
+  const unsigned int last =
+    f->x_column > f->y_column ? f->x_column : f->y_column;
+
+  for (unsigned int column = 1; column <= last; ++column)
+    {
+      if (field > end)
+	return false;
+
+      field = skip_blanks (field, end, f->delimiter);
+      const char *const field_end = find_delimiter (field, end, f->delimiter);
+      if (column == f->x_column
+	  && !parse_field (field, field_end, f->x_time, &point->x))
+	return false;
+      if (column == f->y_column
+	  && !parse_field (field, field_end, TIME_NONE, &point->y))
+	return false;
+
+      field = field_end + 1;
+    }
+
+  return true;
+}
+
+/* Parses the fields of a line the transform uses into row i of its columns */
+static bool
+parse_row (const struct csv_format *const f,
+	   struct csv_transform *const t, const char *field,
+	   const char *const end, const size_t i)
+{
+  size_t k = 0;
+  for (unsigned int column = 1; k < t->nfields; ++column)
+    {
+      if (field > end)
+	return false;
+
+      field = skip_blanks (field, end, f->delimiter);
+      const char *const field_end = find_delimiter (field, end, f->delimiter);
+      if (column == t->fields[k])
+	{
+	  const enum time_format time =
+	    column == f->x_column ? f->x_time : TIME_NONE;
+	  if (!parse_field (field, field_end, time,
+			    &t->values[k * TRANSFORM_ROWS + i]))
+	    return false;
+	  ++k;
+	}
+
+      field = field_end + 1;
+    }
+
+  return true;
+}
+
+/* Keeps the unread tail, and appends as much input as fits after it */
+static int
+refill (csv_reader_t * const r)
+{
+  if (r->start > 0)
+    {
+      memmove (r->buf, r->buf + r->start, r->end - r->start);
+      r->end -= r->start;
+      r->start = 0;
+    }
+
+  if (r->end + 1 == r->size)
+    {
+      char *const buf = realloc (r->buf, 2 * r->size + CSV_SLACK);
+      if (!buf)
+	return -1;
+      r->buf = buf;
+      r->size *= 2;
+    }
+
+  const size_t n = fread (r->buf + r->end, 1, r->size - 1 - r->end, r->in);
+  if (n == 0)
+    r->eof = true;
+  r->end += n;
+  r->buf[r->end] = '\0';		/* so strtod cannot run off the end */
+
+  return 0;
+}
+
+void
+csv_format_init (struct csv_format *const f)
+{
+  f->delimiter = ',';
+  f->x_column = 1;
+  f->y_column = 2;
+  f->skip_header = false;
+  f->x_time = TIME_NONE;
+  f->x_expr = f->y_expr = NULL;
+  f->header = NULL;
+  f->math = MATH_PRECISE;
+}
+
+/* The names of the header's fields, which go before c1, c2... */
+struct names
+{
+  struct csv_transform *t;
+  const char *header, *end;
+  char delimiter;
+  enum math_mode math;
+};
+
+/* Returns the field's column, keeping the fields in ascending order */
+static int
+add_field (struct csv_transform *const t, const unsigned int field)
+{
+  size_t k = 0;
+  while (k < t->nfields && t->fields[k] < field)
+    ++k;
+  if (k < t->nfields && t->fields[k] == field)
+    return k;
+  if (t->nfields == TRANSFORM_MAX_FIELDS)
+    return -1;
+
+  memmove (t->fields + k + 1, t->fields + k,
+	   (t->nfields - k) * sizeof (*t->fields));
+  t->fields[k] = field;
+  ++t->nfields;
+  return k;
+}
+
+/* Header fields match with blanks, a '\r' and quotes around them left out */
+static unsigned int
+find_name (const struct names *const names, const char *const name)
+{
+  const size_t len = strlen (name);
+  const char *field = names->header;
+  for (unsigned int column = 1; names->header && field <= names->end;
+       ++column)
+    {
+      field = skip_blanks (field, names->end, names->delimiter);
+      const char *const field_end =
+	find_delimiter (field, names->end, names->delimiter);
+      const char *a = field, *b = field_end;
+      while (a < b && strchr (" \t\"'", *a))
+	++a;
+      while (b > a && strchr (" \t\r\"'", b[-1]))
+	--b;
+      if ((size_t) (b - a) == len && memcmp (a, name, len) == 0)
+	return column;
+
+      field = field_end + 1;
+    }
+
+  if (name[0] == 'c' && name[1] >= '1' && name[1] <= '9')
+    {
+      char *end;
+      const unsigned long column = strtoul (name + 1, &end, 10);
+      if (*end == '\0' && column <= TRANSFORM_MAX_FIELDS * 1024)
+	return column;
+    }
+
+  return 0;
+}
+
+/* The columns only count fields that have been resolved so far, and
+ * shift as more are added; they are numbered again once all are known */
+static int
+resolve_name (const char *const name, void *const arg)
+{
+  const struct names *const names = arg;
+  const unsigned int field = find_name (names, name);
+  return field == 0 ? -1 : add_field (names->t, field) >= 0 ? 0 : -1;
+}
+
+static int
+resolve_column (const char *const name, void *const arg)
+{
+  const struct names *const names = arg;
+  const unsigned int field = find_name (names, name);
+  for (size_t k = 0; k < names->t->nfields; ++k)
+    if (names->t->fields[k] == field)
+      return k;
+  return -1;
+}
+
+static void
+transform_destroy (struct csv_transform *const t)
+{
+  column_expression_destroy (t->x);
+  column_expression_destroy (t->y);
+  free (t->values);
+  free (t);
+}
+
+/* Parses the expression, finding the fields it names with resolve */
+static column_expression_t *
+compile_expression (const char *const s, struct names *const names,
+		    int (*const resolve) (const char *const, void *const))
+{
+  const expression_t exp = parse_column_expression (s, strlen (s));
+  if (!check_parser_errors (exp))
+    {
+      expression_destroy (exp);
+      errno = EINVAL;
+      return NULL;
+    }
+
+  column_expression_t *const c =
+    column_expression_compile (exp, names->math, resolve, names);
+  expression_destroy (exp);
+  return c;
+}
+
+/* Fields are gathered from both expressions before either is compiled for
+ * good, so that each sees the same columns */
+static struct csv_transform *
+transform_create (const struct csv_format *const f, const char *const header,
+		  const char *const header_end)
+{
+  struct csv_transform *const t = calloc (1, sizeof (*t));
+  if (!t)
+    return NULL;
+
+  struct names names = {.t = t,.header = header,.end = header_end,
+    .delimiter = f->delimiter,.math = f->math
+  };
+  const char *const exprs[] = { f->x_expr, f->y_expr };
+  for (size_t i = 0; i < 2; ++i)
+    {
+      if (!exprs[i])
+	continue;
+      column_expression_t *const c =
+	compile_expression (exprs[i], &names, resolve_name);
+      if (!c)
+	{
+	  transform_destroy (t);
+	  return NULL;
+	}
+      column_expression_destroy (c);
+    }
+
+  const int x_field = f->x_expr ? 0 : add_field (t, f->x_column);
+  const int y_field = f->y_expr ? 0 : add_field (t, f->y_column);
+  if (x_field < 0 || y_field < 0)
+    {
+      transform_destroy (t);
+      errno = EINVAL;
+      return NULL;
+    }
+
+  t->x_field = f->x_expr ? 0 : (size_t) add_field (t, f->x_column);
+  t->y_field = f->y_expr ? 0 : (size_t) add_field (t, f->y_column);
+  t->x = f->x_expr ? compile_expression (f->x_expr, &names, resolve_column)
+    : NULL;
+  t->y = f->y_expr ? compile_expression (f->y_expr, &names, resolve_column)
+    : NULL;
+  t->values = malloc (t->nfields * TRANSFORM_ROWS * sizeof (*t->values));
+  if ((f->x_expr && !t->x) || (f->y_expr && !t->y) || !t->values)
+    {
+      transform_destroy (t);
+      return NULL;
+    }
+
+  for (size_t k = 0; k < t->nfields; ++k)
+    t->columns[k] = t->values + k * TRANSFORM_ROWS;
+
+  return t;
+}
+
+int
+csv_reader_init (csv_reader_t * const r, FILE * const in,
+		 const struct csv_format format)
+{
+  memset (r, 0, sizeof *r);
+  r->in = in;
+  r->format = format;
+  r->header_skipped = !format.skip_header;
+  r->size = CSV_CHUNK;
+  r->buf = malloc (r->size + CSV_SLACK);
+  if (!r->buf)
+    return -1;
+
+  r->buf[0] = '\0';
+  if (!format.x_expr && !format.y_expr)
+    return 0;
+
+  /* The header is read ahead for its names, and skipped as usual */
+  const char *header = format.header, *header_end = NULL;
+  if (header)
+    header_end = header + strlen (header);
+  else if (format.skip_header)
+    {
+      while (!r->eof && find_byte (r->buf, r->buf + r->end, '\n')
+	     == r->buf + r->end)
+	if (refill (r) != 0)
+	  {
+	    csv_reader_destroy (r);
+	    return -1;
+	  }
+      header = r->buf;
+      header_end = find_byte (r->buf, r->buf + r->end, '\n');
+    }
+
+  r->transform = transform_create (&format, header, header_end);
+  if (!r->transform)
+    {
+      const int error = errno;
+      csv_reader_destroy (r);
+      errno = error;
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Sets line and newline to the next line with fields, past the header and
+ * blank lines. Returns false once the input has run out. */
+static inline bool
+next_line (csv_reader_t * const r, const char **const line_start,
+	   const char **const line_end)
+{
+  for (;;)
+    {
+      const char *const line = r->buf + r->start;
+      const char *const end = r->buf + r->end;
+      const char *const newline = find_byte (line, end, '\n');
+
+      if (newline == end && !r->eof)
+	{
+	  if (refill (r) != 0)
+	    return false;
+	  continue;
+	}
+      else if (line == end)
+	return false;
+
+      r->start = newline - r->buf + (newline < end);
+
+      if (!r->header_skipped)
+	r->header_skipped = true;
+      else if (newline == line || (newline == line + 1 && *line == '\r'))
+	continue;
+      else
+	{
+	  ++r->nlines;
+	  *line_start = line;
+	  *line_end = newline;
+	  return true;
+	}
+    }
+}
+
+/* Parses up to TRANSFORM_ROWS lines, then computes their points from them */
+static size_t
+read_transformed (csv_reader_t * const r, point_t points[], const size_t max)
+{
+  struct csv_transform *const t = r->transform;
+  size_t n = 0;
+  while (n < max)
+    {
+      const size_t want = max - n < TRANSFORM_ROWS ? max - n : TRANSFORM_ROWS;
+      size_t m = 0;
+      const char *line, *newline;
+      while (m < want && next_line (r, &line, &newline))
+	if (parse_row (&r->format, t, line, newline, m))
+	  ++m;
+	else
+	  ++r->nmalformed;
+      if (m == 0)
+	break;
+
+      const double *const xs = t->x ? t->xs : t->columns[t->x_field];
+      const double *const ys = t->y ? t->ys : t->columns[t->y_field];
+      if (t->x)
+	column_expression_evaluate (t->x, t->columns, m, t->xs);
+      if (t->y)
+	column_expression_evaluate (t->y, t->columns, m, t->ys);
+
+      for (size_t i = 0; i < m; ++i)
+	if (isfinite (xs[i]) && isfinite (ys[i]))
+	  {
+	    points[n].x = xs[i];
+	    points[n].y = ys[i];
+	    ++n;
+	  }
+	else
+	  ++r->nmalformed;
+
+      if (m < want)
+	break;
+    }
+
+  return n;
+}
+
+size_t
+csv_read_block (csv_reader_t * const r, point_t points[], const size_t max)
+{
+  if (r->transform)
+    return read_transformed (r, points, max);
+
+  size_t n = 0;
+  const char *line, *newline;
+  while (n < max && next_line (r, &line, &newline))
+    if (parse_line (&r->format, line, newline, &points[n]))
+      ++n;
+    else
+      ++r->nmalformed;
+
+  return n;
+}
+
+void
+csv_reader_destroy (csv_reader_t * const r)
+{
+  free (r->buf);
+  r->buf = NULL;
+  if (r->transform)
+    transform_destroy (r->transform);
+  r->transform = NULL;
+}
+
+const char *
+csv_strerror (const struct csv_format *const format, const int error)
+{
+  if (error == EINVAL && (format->x_expr || format->y_expr))
+    return "an expression does not parse or names no column of the input";
+
+  return strerror (error);
+}
+
+point_t *
+csv_read_points (FILE * const in, const struct csv_format format,
+		 size_t *const npoints, size_t *const nmalformed)
+{
+  csv_reader_t r;
+  if (csv_reader_init (&r, in, format) != 0)
+    return NULL;
+
+  size_t size = 4096;
+  size_t n = 0;
+  point_t *points = malloc (size * sizeof (*points));
+  while (points)
+    {
+      const size_t nread = csv_read_block (&r, points + n, size - n);
+      n += nread;
+      if (n < size)
+	break;
+
+      size *= 2;
+      point_t *const bigger = realloc (points, size * sizeof (*points));
+      if (!bigger)
+	{
+	  free (points);
+	  points = NULL;
+	}
+      else
+	points = bigger;
+    }
+
+  *npoints = n;
+  *nmalformed = r.nmalformed;
+  csv_reader_destroy (&r);
+  return points;
+}
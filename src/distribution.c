@@ -0,0 +1,456 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cplot.h"
+#include "distribution.h"
+#include "pool.h"
+
+#define BLOCK_VALUES 4096
+#define PART_MIN_SIZE (1 << 20)	/* smaller files are counted on one thread */
+#define MAX_BINS (1 << 24)
+
+/* A part of the input, and what was found in it */
+struct part
+{
+  const struct options *o;
+  struct csv_format format;
+  const char *text;
+  size_t len;
+
+  /* Until the range is known, the values are only measured, and a stream's
+   * are kept to be counted once it is */
+  bool ranging;
+  double min, max;
+  bool sketching;
+  sketch_t sketch;
+  bool keeping;
+  double *values;
+  size_t nkept, size;
+
+  histogram_t histogram;
+  size_t nvalues, nmalformed;
+  int error;
+};
+
+static int
+keep_values (struct part *const part, const double values[], const size_t n)
+{
+  if (part->nkept + n > part->size)
+    {
+      size_t size = part->size ? part->size : 4 * BLOCK_VALUES;
+      while (size < part->nkept + n)
+	size *= 2;
+
+      double *const bigger = realloc (part->values, size * sizeof (*bigger));
+      if (!bigger)
+	return -1;
+      part->values = bigger;
+      part->size = size;
+    }
+
+  memcpy (part->values + part->nkept, values, n * sizeof (*values));
+  part->nkept += n;
+  return 0;
+}
+
+/* Logarithmic bins have no place for values that are not positive, so those
+ * do not stretch the range */
+static int
+measure_values (struct part *const part, const double values[],
+		const size_t n)
+{
+  const bool log = part->o->log_bins;
+  for (size_t i = 0; i < n; ++i)
+    {
+      const double v = values[i];
+      if (isnan (v) || (log && v <= 0))
+	continue;
+
+      part->min = v < part->min ? v : part->min;
+      part->max = v > part->max ? v : part->max;
+      if (part->sketching && sketch_add (&part->sketch, v) != 0)
+	return -1;
+    }
+
+  return part->keeping ? keep_values (part, values, n) : 0;
+}
+
+static void
+read_part (struct part *const part, FILE * const in)
+{
+  csv_reader_t csv;
+  if (csv_reader_init (&csv, in, part->format) != 0)
+    {
+      part->error = errno;
+      return;
+    }
+
+  point_t block[BLOCK_VALUES];
+  double values[BLOCK_VALUES];
+  size_t n;
+  part->nvalues = 0;
+  while ((n = csv_read_block (&csv, block, BLOCK_VALUES)) > 0)
+    {
+      for (size_t i = 0; i < n; ++i)
+	values[i] = block[i].x;
+      part->nvalues += n;
+
+      if (!part->ranging)
+	histogram_add (&part->histogram, values, n);
+      else if (measure_values (part, values, n) != 0)
+	{
+	  part->error = errno;
+	  break;
+	}
+    }
+
+  part->nmalformed = csv.nmalformed;
+  csv_reader_destroy (&csv);
+}
+
+static void
+read_mapped_part (void *const arg, const size_t worker)
+{
+  (void) worker;
+  struct part *const part = arg;
+  if (part->len == 0)
+    return;
+
+  FILE *const in = fmemopen ((char *) part->text, part->len, "r");
+  if (!in)
+    {
+      part->error = errno;
+      return;
+    }
+
+  read_part (part, in);
+  fclose (in);
+}
+
+static int
+read_parts (pool_t * const pool, struct part parts[], const size_t nparts)
+{
+  for (size_t i = 0; i < nparts; ++i)
+    if (!pool || pool_submit (pool, read_mapped_part, &parts[i]) != 0)
+      read_mapped_part (&parts[i], 0);
+  if (pool)
+    pool_wait (pool);
+
+  for (size_t i = 0; i < nparts; ++i)
+    if (parts[i].error)
+      {
+	errno = parts[i].error;
+	return -1;
+      }
+
+  return 0;
+}
+
+/* Each part after the first starts after a newline, so no line is split */
+static void
+split_lines (const char *const text, const size_t len, struct part parts[],
+	     const size_t nparts)
+{
+  size_t start = 0;
+  for (size_t i = 0; i < nparts; ++i)
+    {
+      size_t end = len;
+      if (i + 1 < nparts)
+	{
+	  size_t target = len / nparts * (i + 1);
+	  target = target > start ? target : start;
+	  const char *const newline = memchr (text + target, '\n', len - target);
+	  end = newline ? (size_t) (newline - text) + 1 : len;
+	}
+
+      parts[i].text = text + start;
+      parts[i].len = end - start;
+      start = end;
+    }
+}
+
+/* The extremes of the values, or the --auto-range quantiles of them, where
+ * the range was not given */
+static int
+fit_range (const struct options *const o, struct part parts[],
+	   const size_t nparts, double *const low, double *const high)
+{
+  double min = INFINITY, max = -INFINITY;
+  for (size_t i = 0; i < nparts; ++i)
+    {
+      min = parts[i].min < min ? parts[i].min : min;
+      max = parts[i].max > max ? parts[i].max : max;
+      if (i > 0 && parts[0].sketching
+	  && sketch_merge (&parts[0].sketch, &parts[i].sketch) != 0)
+	return -1;
+    }
+
+  if (parts[0].sketching && min <= max)
+    {
+      min = sketch_quantile (&parts[0].sketch, o->auto_range_low);
+      max = sketch_quantile (&parts[0].sketch, o->auto_range_high);
+    }
+  else if (!(min <= max))
+    {
+      min = o->log_bins ? 1 : 0;
+      max = o->log_bins ? 10 : 1;
+    }
+
+  if (min == max)
+    {
+      min = o->log_bins ? min / 2 : min - 0.5;
+      max = o->log_bins ? max * 2 : max + 0.5;
+    }
+
+  *low = o->x_min_set ? o->plot.x_min : min;
+  *high = o->x_max_set ? o->plot.x_max : max;
+  return 0;
+}
+
+/* With --bin-width, the range is widened to a whole number of bins, which
+ * are that wide in decades with --log-bins. Otherwise there is a bin for each
+ * column of the plot. */
+static int
+make_histogram (const struct options *const o, const double low,
+		double high, histogram_t * const h)
+{
+  size_t nbins = o->plot.ncolumns - 1;
+  if (o->bin_width > 0)
+    {
+      const double from = o->log_bins ? log10 (low) : low;
+      const double span = (o->log_bins ? log10 (high) : high) - from;
+      const double n = ceil (span / o->bin_width);
+      if (!(n >= 1 && n <= MAX_BINS))
+	{
+	  errno = n > MAX_BINS ? E2BIG : EINVAL;
+	  return -1;
+	}
+
+      nbins = n;
+      high = from + nbins * o->bin_width;
+      high = o->log_bins ? pow (10, high) : high;
+    }
+
+  return histogram_init (h, nbins, low, high, o->log_bins);
+}
+
+/* The columns of the plot tile the bins, each labelled at its lower edge */
+static int
+write_histogram (struct options *const o, const histogram_t * const h,
+		 FILE * const out, stats_t * const st)
+{
+  plot_info_t *const p = &o->plot;
+  const unsigned short ncolumns = p->ncolumns - 1;
+  p->x_log = h->log;
+  p->x_min = h->min;
+  p->x_max = h->max - (h->max - h->min) / ncolumns;
+  p->lines = false;
+  if (!o->y_min_set)
+    p->y_min = 0;
+  if (!o->y_max_set)
+    p->y_max = histogram_max_count (h);
+  if (!(p->y_max > p->y_min))
+    p->y_max = p->y_min + 1;
+
+  plot_grid_t grid;
+  if (plot_grid_init (&grid, *p) != 0)
+    return -1;
+
+  histogram_grid (h, &grid, *p);
+  stats_end (st, STATS_BIN);
+
+  const struct plot_series series = {.grid = &grid,.color = p->mark_color };
+  plot_write_series (out, *p, &series, 1, st);
+  plot_grid_destroy (&grid);
+  return 0;
+}
+
+static void
+report_error (const struct options *const o, const int error,
+	      const char *const name, const bool reading)
+{
+  if (reading)
+    fprintf (stderr, "%s: %s\n", name, csv_strerror (&o->csv, error));
+  else if (error == E2BIG)
+    fprintf (stderr, "%s: more than %d bins\n", name, MAX_BINS);
+  else if (error == EINVAL)
+    fprintf (stderr, "%s: the histogram's range is empty%s\n", name,
+	     o->log_bins ? " or not positive" : "");
+  else
+    fprintf (stderr, "%s: %s\n", name, strerror (error));
+}
+
+int
+plot_distribution (struct options *const o, FILE * const out,
+		   stats_t * const st)
+{
+  const char *const error = plot_check_info (o->plot);
+  if (error)
+    {
+      fputs (error, out);
+      return -1;
+    }
+
+  const char *const name = o->source == INPUT_FILE ? o->file_name : "stdin";
+  FILE *const in = o->source == INPUT_FILE ? fopen (name, "r") : stdin;
+  if (!in)
+    {
+      perror (name);
+      return -1;
+    }
+
+  /* Regular files are mapped and split into a part per thread */
+  struct stat sb;
+  char *map = NULL;
+  size_t map_size = 0;
+  if (fstat (fileno (in), &sb) == 0 && S_ISREG (sb.st_mode) && sb.st_size > 0)
+    {
+      map = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fileno (in), 0);
+      if (map == MAP_FAILED)
+	map = NULL;
+      else
+	map_size = sb.st_size;
+    }
+
+  size_t nparts = map ? map_size / PART_MIN_SIZE : 1;
+  nparts = nparts < 1 ? 1 : nparts > o->nthreads ? o->nthreads : nparts;
+  struct part *const parts = calloc (nparts, sizeof (*parts));
+  pool_t *const pool = nparts > 1 ? pool_create (nparts) : NULL;
+  if (!parts)
+    {
+      perror ("");
+      if (pool)
+	pool_destroy (pool);
+      if (map)
+	munmap (map, map_size);
+      if (in != stdin)
+	fclose (in);
+      return -1;
+    }
+
+  /* Parts after the first take the names in --x-expr from its header */
+  char *header = NULL;
+  if (map && nparts > 1 && o->csv.x_expr && o->csv.skip_header)
+    {
+      const char *const newline = memchr (map, '\n', map_size);
+      header = strndup (map, newline ? (size_t) (newline - map) : map_size);
+      if (!header)
+	nparts = 1;
+    }
+
+  /* y is unused; with --x-expr it is a constant that reads no field */
+  const bool ranging = !o->x_min_set || !o->x_max_set;
+  for (size_t i = 0; i < nparts; ++i)
+    {
+      parts[i].o = o;
+      parts[i].format = o->csv;
+      parts[i].format.y_column = o->csv.x_column;
+      parts[i].format.y_expr = o->csv.x_expr ? "0" : NULL;
+      parts[i].format.header = i > 0 ? header : NULL;
+      parts[i].format.skip_header = i == 0 && o->csv.skip_header;
+      parts[i].ranging = ranging;
+      parts[i].min = INFINITY;
+      parts[i].max = -INFINITY;
+      parts[i].keeping = ranging && !map;
+      parts[i].sketching = ranging && o->auto_range
+	&& sketch_init (&parts[i].sketch, SKETCH_DEFAULT_K) == 0;
+    }
+  if (map)
+    split_lines (map, map_size, parts, nparts);
+
+  int ret = 0;
+  bool reading = false;		/* whether ret is an error from reading */
+  double low = o->plot.x_min, high = o->plot.x_max;
+  if (ranging)
+    {
+      if (map)
+	ret = read_parts (pool, parts, nparts);
+      else
+	{
+	  read_part (&parts[0], in);
+	  ret = parts[0].error ? (errno = parts[0].error, -1) : 0;
+	}
+      reading = ret != 0;
+      stats_end (st, STATS_READ);
+
+      if (ret == 0)
+	ret = fit_range (o, parts, nparts, &low, &high);
+      stats_end (st, STATS_RANGE);
+    }
+
+  for (size_t i = 0; ret == 0 && i < nparts; ++i)
+    {
+      ret = make_histogram (o, low, high, &parts[i].histogram);
+      parts[i].ranging = false;
+    }
+
+  /* A stream's values were kept; a file is read again */
+  if (ret == 0 && parts[0].keeping)
+    histogram_add (&parts[0].histogram, parts[0].values, parts[0].nkept);
+  else if (ret == 0)
+    {
+      if (map)
+	ret = read_parts (pool, parts, nparts);
+      else
+	{
+	  read_part (&parts[0], in);
+	  ret = parts[0].error ? (errno = parts[0].error, -1) : 0;
+	}
+      reading = ret != 0;
+    }
+
+  stats_end (st, STATS_READ);
+
+  size_t nvalues = 0, nmalformed = 0;
+  for (size_t i = 0; ret == 0 && i < nparts; ++i)
+    {
+      if (i > 0)
+	histogram_merge (&parts[0].histogram, &parts[i].histogram);
+      nvalues += parts[i].nvalues;
+      nmalformed += parts[i].nmalformed;
+    }
+
+  if (ret != 0)
+    report_error (o, errno, name, reading);
+  else
+    {
+      if (nmalformed > 0)
+	fprintf (stderr, "%s: skipped %zu malformed lines\n", name,
+		 nmalformed);
+      if (st)
+	{
+	  st->points_read = nvalues;
+	  st->points_dropped =
+	    parts[0].histogram.below + parts[0].histogram.above;
+	}
+
+      if (write_histogram (o, &parts[0].histogram, out, st) != 0)
+	{
+	  perror ("");
+	  ret = -1;
+	}
+    }
+
+  if (pool)
+    pool_destroy (pool);
+  for (size_t i = 0; i < nparts; ++i)
+    {
+      histogram_destroy (&parts[i].histogram);
+      free (parts[i].values);
+      if (parts[i].sketching)
+	sketch_destroy (&parts[i].sketch);
+    }
+  free (parts);
+  free (header);
+  if (map)
+    munmap (map, map_size);
+  if (in != stdin)
+    fclose (in);
+
+  return ret;
+}
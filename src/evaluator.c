@@ -0,0 +1,1191 @@
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "evaluator.h"
+
+#define NELEMS(arr) (sizeof(arr)/sizeof(arr[0]))
+
+/* Trees are walked without recursion, as long sums parse into trees as deep
+ * as they are long. Walks this deep or values this large fit on the stack. */
+#define WALK_INLINE 64
+#define WALK_MAX_VALUE 32
+
+/* Gets the values the visits of the node's operands left, one after another,
+ * and leaves its own in result, which may be where those were */
+typedef void (*visit_t) (const expression_t * const e,
+			 const void *const operands, void *const result,
+			 void *const arg);
+
+struct frame
+{
+  const expression_t *e;
+  size_t next;			/* the operand to walk next */
+};
+
+static size_t
+count_operands (const expression_t * const e)
+{
+  switch (e->type)
+    {
+    case EXPRESSION_FUNCTION:
+      return 1;
+    case EXPRESSION_OPERATOR:
+      return e->operator == 'N' ? 1 : 2;
+    default:
+      return 0;
+    }
+}
+
+/* Both stacks double, moving off the stack of the caller the first time */
+static int
+grow_walk (struct frame **const frames, unsigned char **const values,
+	   size_t *const capacity, const size_t size, const bool inline_)
+{
+  const size_t n = 2 * *capacity;
+  struct frame *const f = inline_ ? malloc (n * sizeof (*f))
+    : realloc (*frames, n * sizeof (*f));
+  if (!f)
+    return -1;
+  if (inline_)
+    memcpy (f, *frames, *capacity * sizeof (*f));
+  *frames = f;
+
+  /* a node's operands sit on top of a value per node above it;
+   * walks with no values still allocate, as realloc to 0 bytes frees */
+  const size_t width = size > 0 ? size : 1;
+  unsigned char *const v = inline_ ? malloc ((n + 2) * width)
+    : realloc (*values, (n + 2) * width);
+  if (!v)
+    return -1;
+  if (inline_)
+    memcpy (v, *values, (*capacity + 2) * size);
+  *values = v;
+
+  *capacity = n;
+  return 0;
+}
+
+/* Calls visit on every node after its operands, in the order recursion
+ * would, with values of size bytes. Returns 0 with the root's value in
+ * result, or -1 with errno set if memory ran out. Inlined into each pass,
+ * so every pass gets a walk with its own visit and value size built in. */
+static inline __attribute__ ((always_inline)) int
+walk (const expression_t * const root, const size_t size, const visit_t visit,
+      void *const arg, void *const result)
+{
+  struct frame inline_frames[WALK_INLINE];
+  _Alignas (max_align_t) unsigned char
+    inline_values[(WALK_INLINE + 2) * WALK_MAX_VALUE];
+  struct frame *frames = inline_frames;
+  unsigned char *values = inline_values;
+  size_t capacity = WALK_INLINE, nframes = 0, nvalues = 0;
+  int ret = 0;
+
+  frames[nframes].e = root;
+  frames[nframes++].next = 0;
+  while (nframes > 0)
+    {
+      struct frame *const f = &frames[nframes - 1];
+      const size_t n = count_operands (f->e);
+      if (f->next < n)
+	{
+	  const expression_t *const operand = &f->e->operands[f->next++];
+	  if (count_operands (operand) == 0)
+	    {
+	      /* leaves need no frame of their own */
+	      visit (operand, NULL, values + nvalues++ * size, arg);
+	      continue;
+	    }
+	  if (nframes == capacity
+	      && grow_walk (&frames, &values, &capacity, size,
+			    frames == inline_frames) != 0)
+	    {
+	      ret = -1;
+	      break;
+	    }
+	  frames[nframes].e = operand;
+	  frames[nframes++].next = 0;
+	  continue;
+	}
+
+      /* the result takes the place of the operands it is made from */
+      unsigned char *const operands = values + (nvalues - n) * size;
+      visit (f->e, operands, operands, arg);
+      nvalues = nvalues - n + 1;
+      --nframes;
+    }
+
+  if (ret == 0 && size > 0)
+    memcpy (result, values, size);
+  if (frames != inline_frames)
+    free (frames);
+  if (values != inline_values)
+    free (values);
+  return ret;
+}
+
+int
+variable_index (const char *const name)
+{
+  if (name[0] == '\0' || name[1] != '\0')
+    return -1;
+
+  switch (name[0])
+    {
+    case 'x':
+      return VARIABLE_X;
+    case 't':
+      return VARIABLE_T;
+    case 'y':
+      return VARIABLE_Y;
+    default:
+      return -1;
+    }
+}
+
+struct check
+{
+  bool variables, implicit;
+  bool ok;
+};
+
+static void
+visit_check (const expression_t * const e, const void *const operands,
+	     void *const result, void *const arg)
+{
+  (void) operands;
+  (void) result;
+  struct check *const c = arg;
+  if (e->type == EXPRESSION_ERROR)
+    c->ok = false;
+  else if (c->variables && e->type == EXPRESSION_VARIABLE)
+    {
+      const int i = variable_index (e->s);
+      c->ok &= i >= 0 && (c->implicit || i != VARIABLE_Y);
+    }
+}
+
+/* Trees too deep to walk in the memory there is do not pass */
+static bool
+check (const expression_t expression, const bool variables,
+       const bool implicit)
+{
+  struct check c = {.variables = variables,.implicit = implicit,.ok = true };
+  return walk (&expression, 0, visit_check, &c, NULL) == 0 && c.ok;
+}
+
+bool
+check_parser_errors (const expression_t expression)
+{
+  return check (expression, false, false);
+}
+
+bool
+check_variables (const expression_t expression)
+{
+  return check (expression, true, false);
+}
+
+bool
+check_implicit_variables (const expression_t expression)
+{
+  return check (expression, true, true);
+}
+
+static double
+dummy (double d)
+{
+  d = 0;
+  return d;
+}
+
+typedef double (*mfptr) (double);
+
+static mfptr
+get_trig_function (const char *const name)
+{
+  static const char *function_names[] = {
+    "sin", "tan", "cos", "arcsin", "arctan", "arccos", "ln"
+  };
+  static const mfptr trig_functions[] = {
+    sin, tan, cos, asin, atan, acos, log
+  };
+
+  for (size_t i = 0; i < NELEMS (function_names); ++i)
+    if (strcmp (name, function_names[i]) == 0)
+      return trig_functions[i];
+
+  return dummy;
+}
+
+static double
+value_of (const expression_t * const e, const double a[],
+	  const double vars[])
+{
+  switch (e->type)
+    {
+    case EXPRESSION_FUNCTION:
+      return get_trig_function (e->s) (a[0]);
+    case EXPRESSION_OPERATOR:
+      switch (e->operator)
+	{
+	case '+':
+	  return a[0] + a[1];
+	case '-':
+	  return a[0] - a[1];
+	case '/':
+	  return a[0] / a[1];
+	case '*':
+	  return a[0] * a[1];
+	case '^':
+	  return pow (a[0], a[1]);
+	case 'N':
+	  return -a[0];
+	default:
+	  return 0;
+	}
+    case EXPRESSION_NUMBER:
+      return e->d;
+    case EXPRESSION_VARIABLE:
+      {
+	const int i = variable_index (e->s);
+	return i >= 0 ? vars[i] : NAN;
+      }
+    default:
+      return 0;
+    }
+}
+
+static void
+visit_value (const expression_t * const e, const void *const operands,
+	     void *const result, void *const arg)
+{
+  *(double *) result = value_of (e, operands, arg);
+}
+
+/* NaN if the tree is too deep to walk in the memory there is */
+double
+evaluate_expression_vars (const expression_t exp, const double vars[])
+{
+  double r;
+  return walk (&exp, sizeof r, visit_value, (void *) vars, &r) == 0 ? r : NAN;
+}
+
+double
+evaluate_expression (const expression_t exp, const double x)
+{
+  const double vars[NVARIABLES] = {[VARIABLE_X] = x };
+  return evaluate_expression_vars (exp, vars);
+}
+
+/* Expressions are sampled by a postfix program working on blocks of values,
+ * so each node is visited once per block rather than once per sample, and
+ * functions see whole blocks at a time */
+#define BLOCK_SIZE 256
+
+enum opcode
+{
+  OP_NUMBER, OP_VARIABLE, OP_FUNCTION, OP_NEGATE, OP_ADD, OP_SUBTRACT,
+  OP_MULTIPLY, OP_DIVIDE, OP_POWER, OP_ZERO, OP_COLUMN
+};
+
+struct instruction
+{
+  enum opcode op;
+  int arg;			/* the variable or function, or operands of OP_ZERO */
+  double d;
+};
+
+struct program
+{
+  struct instruction *code;
+  size_t n, size;
+  size_t depth, max_depth;	/* of the stack of blocks */
+  bool failed;
+
+  /* With resolve, variables are the columns it numbers */
+  int (*resolve) (const char *const name, void *const arg);
+  void *resolve_arg;
+  size_t ncolumns;
+  bool unresolved;
+};
+
+static void
+emit (struct program *const p, const enum opcode op, const int arg,
+      const double d)
+{
+  if (p->n == p->size)
+    {
+      const size_t size = p->size ? 2 * p->size : 64;
+      struct instruction *const code =
+	realloc (p->code, size * sizeof (*code));
+      if (!code)
+	{
+	  p->failed = true;
+	  return;
+	}
+      p->code = code;
+      p->size = size;
+    }
+
+  const struct instruction i = {.op = op,.arg = arg,.d = d };
+  p->code[p->n++] = i;
+
+  if (op == OP_NUMBER || op == OP_VARIABLE || op == OP_COLUMN)
+    {
+      if (++p->depth > p->max_depth)
+	p->max_depth = p->depth;
+    }
+  else if (op == OP_ZERO)
+    p->depth -= arg - 1;
+  else if (op != OP_FUNCTION && op != OP_NEGATE)
+    --p->depth;
+}
+
+/* Emits the node's instruction once its operands' are in place */
+static void
+visit_compile (const expression_t * const e, const void *const operands,
+	       void *const result, void *const arg)
+{
+  (void) operands;
+  (void) result;
+  struct program *const p = arg;
+  const expression_t exp = *e;
+  switch (exp.type)
+    {
+    case EXPRESSION_FUNCTION:
+      {
+	/* as evaluate_expression_vars, unknown functions give 0 */
+	const int f = math_function_index (exp.s);
+	emit (p, f < 0 ? OP_ZERO : OP_FUNCTION, f < 0 ? 1 : f, 0);
+	break;
+      }
+    case EXPRESSION_OPERATOR:
+      if (exp.operator == 'N')
+	{
+	  emit (p, OP_NEGATE, 0, 0);
+	  break;
+	}
+
+      switch (exp.operator)
+	{
+	case '+':
+	  emit (p, OP_ADD, 0, 0);
+	  break;
+	case '-':
+	  emit (p, OP_SUBTRACT, 0, 0);
+	  break;
+	case '*':
+	  emit (p, OP_MULTIPLY, 0, 0);
+	  break;
+	case '/':
+	  emit (p, OP_DIVIDE, 0, 0);
+	  break;
+	case '^':
+	  emit (p, OP_POWER, 0, 0);
+	  break;
+	default:
+	  emit (p, OP_ZERO, 2, 0);
+	  break;
+	}
+      break;
+    case EXPRESSION_NUMBER:
+      emit (p, OP_NUMBER, 0, exp.d);
+      break;
+    case EXPRESSION_VARIABLE:
+      if (!p->resolve && variable_index (exp.s) < 0)
+	emit (p, OP_NUMBER, 0, NAN);
+      else if (!p->resolve)
+	emit (p, OP_VARIABLE, variable_index (exp.s), 0);
+      else
+	{
+	  const int column = p->resolve (exp.s, p->resolve_arg);
+	  if (column < 0)
+	    p->unresolved = true;
+	  else if ((size_t) column >= p->ncolumns)
+	    p->ncolumns = column + 1;
+	  emit (p, OP_COLUMN, column, 0);
+	}
+      break;
+    default:
+      emit (p, OP_NUMBER, 0, 0);
+      break;
+    }
+}
+
+static void
+compile (struct program *const p, const expression_t exp)
+{
+  if (walk (&exp, 0, visit_compile, p, NULL) != 0)
+    p->failed = true;
+}
+
+/* Leaves the values of the n samples in stack[0..n). Columns are read from
+ * columns rather than from vars and points. */
+static void
+run (const struct program *const p, const enum math_mode mode,
+     const double vars[], const point_t points[], const double *const columns[],
+     const size_t n, double *const stack)
+{
+  double *top = stack - BLOCK_SIZE;
+  for (size_t pc = 0; pc < p->n; ++pc)
+    {
+      const struct instruction *const in = &p->code[pc];
+      double *const below = top - BLOCK_SIZE;
+      switch (in->op)
+	{
+	case OP_NUMBER:
+	  top += BLOCK_SIZE;
+	  for (size_t i = 0; i < n; ++i)
+	    top[i] = in->d;
+	  break;
+	case OP_VARIABLE:
+	  top += BLOCK_SIZE;
+	  for (size_t i = 0; i < n; ++i)
+	    top[i] = in->arg == VARIABLE_X ? points[i].x : vars[in->arg];
+	  break;
+	case OP_FUNCTION:
+	  math_apply (in->arg, mode, top, n);
+	  break;
+	case OP_NEGATE:
+	  for (size_t i = 0; i < n; ++i)
+	    top[i] = -top[i];
+	  break;
+	case OP_ADD:
+	  for (size_t i = 0; i < n; ++i)
+	    below[i] += top[i];
+	  top = below;
+	  break;
+	case OP_SUBTRACT:
+	  for (size_t i = 0; i < n; ++i)
+	    below[i] -= top[i];
+	  top = below;
+	  break;
+	case OP_MULTIPLY:
+	  for (size_t i = 0; i < n; ++i)
+	    below[i] *= top[i];
+	  top = below;
+	  break;
+	case OP_DIVIDE:
+	  for (size_t i = 0; i < n; ++i)
+	    below[i] /= top[i];
+	  top = below;
+	  break;
+	case OP_POWER:
+	  math_pow (mode, below, top, n);
+	  top = below;
+	  break;
+	case OP_ZERO:
+	  top -= (in->arg - 1) * BLOCK_SIZE;
+	  memset (top, 0, n * sizeof (*top));
+	  break;
+	case OP_COLUMN:
+	  top += BLOCK_SIZE;
+	  memcpy (top, columns[in->arg], n * sizeof (*top));
+	  break;
+	}
+    }
+}
+
+void
+sample_expression_math (const expression_t exp, const double x_min,
+			const double x_max, const double t,
+			const enum math_mode mode, point_t points[],
+			const size_t npoints)
+{
+  double vars[NVARIABLES] = {[VARIABLE_T] = t };
+  for (size_t i = 0; i < npoints; ++i)
+    points[i].x = i * (x_max - x_min) / npoints + x_min;
+
+  struct program p = { 0 };
+  compile (&p, exp);
+  double *const stack = p.failed ? NULL
+    : malloc (p.max_depth * BLOCK_SIZE * sizeof (*stack));
+
+  if (!stack)
+    {
+      /* one value at a time needs no memory */
+      for (size_t i = 0; i < npoints; ++i)
+	{
+	  vars[VARIABLE_X] = points[i].x;
+	  points[i].y = evaluate_expression_vars (exp, vars);
+	}
+    }
+  else
+    for (size_t start = 0; start < npoints; start += BLOCK_SIZE)
+      {
+	const size_t n =
+	  npoints - start < BLOCK_SIZE ? npoints - start : BLOCK_SIZE;
+	run (&p, mode, vars, points + start, NULL, n, stack);
+	for (size_t i = 0; i < n; ++i)
+	  points[start + i].y = stack[i];
+      }
+
+  free (stack);
+  free (p.code);
+}
+
+void
+sample_expression_at (const expression_t exp, const double x_min,
+		      const double x_max, const double t, point_t points[],
+		      const size_t npoints)
+{
+  sample_expression_math (exp, x_min, x_max, t, MATH_PRECISE, points,
+			  npoints);
+}
+
+struct column_expression
+{
+  struct program program;
+  enum math_mode mode;
+  double *stack;
+  const double **block;		/* the columns from the current block on */
+};
+
+column_expression_t *
+column_expression_compile (const expression_t exp, const enum math_mode mode,
+			   int (*const resolve) (const char *const name,
+						 void *const arg),
+			   void *const arg)
+{
+  column_expression_t *const c = calloc (1, sizeof (*c));
+  if (!c)
+    return NULL;
+
+  c->mode = mode;
+  c->program.resolve = resolve;
+  c->program.resolve_arg = arg;
+  compile (&c->program, exp);
+  if (c->program.unresolved)
+    {
+      column_expression_destroy (c);
+      errno = EINVAL;
+      return NULL;
+    }
+
+  c->stack = malloc (c->program.max_depth * BLOCK_SIZE * sizeof (*c->stack));
+  c->block = malloc ((c->program.ncolumns + 1) * sizeof (*c->block));
+  if (c->program.failed || !c->stack || !c->block)
+    {
+      column_expression_destroy (c);
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  return c;
+}
+
+void
+column_expression_evaluate (column_expression_t * const c,
+			    const double *const columns[], const size_t n,
+			    double out[])
+{
+  for (size_t start = 0; start < n; start += BLOCK_SIZE)
+    {
+      const size_t m = n - start < BLOCK_SIZE ? n - start : BLOCK_SIZE;
+      for (size_t k = 0; k < c->program.ncolumns; ++k)
+	c->block[k] = columns[k] + start;
+
+      run (&c->program, c->mode, NULL, NULL, c->block, m, c->stack);
+      memcpy (out + start, c->stack, m * sizeof (*out));
+    }
+}
+
+void
+column_expression_destroy (column_expression_t * const c)
+{
+  if (!c)
+    return;
+
+  free (c->program.code);
+  free (c->stack);
+  free (c->block);
+  free (c);
+}
+
+size_t
+samples_per_column (const plot_info_t p)
+{
+  return p.lines ? 1 : SAMPLES_PER_COLUMN;
+}
+
+/* as sample_expression_math works out x for the last of its samples */
+double
+last_sample_x (const plot_info_t p)
+{
+  const size_t npoints = samples_per_column (p) * p.ncolumns;
+  return (npoints - 1) * (p.x_max - p.x_min) / npoints + p.x_min;
+}
+
+void
+sample_expression (const expression_t exp, const double x_min,
+		   const double x_max, point_t points[], const size_t npoints)
+{
+  sample_expression_at (exp, x_min, x_max, 0, points, npoints);
+}
+
+/* f(u) given f, f' and f'' at u's value, by the chain rule */
+static inline dual_t
+chain (const dual_t u, const double f, const double df, const double d2f)
+{
+  const dual_t r = {
+    f, df * u.first, d2f * u.first * u.first + df * u.second
+  };
+  return r;
+}
+
+static dual_t
+dual_function (const char *const name, const dual_t u)
+{
+  const double v = u.value;
+
+  if (strcmp (name, "sin") == 0)
+    return chain (u, sin (v), cos (v), -sin (v));
+  else if (strcmp (name, "cos") == 0)
+    return chain (u, cos (v), -sin (v), -cos (v));
+  else if (strcmp (name, "tan") == 0)
+    {
+      const double t = tan (v);
+      return chain (u, t, 1 + t * t, 2 * t * (1 + t * t));
+    }
+  else if (strcmp (name, "arcsin") == 0 || strcmp (name, "arccos") == 0)
+    {
+      const double s = 1 / sqrt (1 - v * v);
+      const double sign = name[3] == 's' ? 1 : -1;
+      return chain (u, name[3] == 's' ? asin (v) : acos (v), sign * s,
+		    sign * v * s * s * s);
+    }
+  else if (strcmp (name, "arctan") == 0)
+    {
+      const double s = 1 / (1 + v * v);
+      return chain (u, atan (v), s, -2 * v * s * s);
+    }
+  else if (strcmp (name, "ln") == 0)
+    return chain (u, log (v), 1 / v, -1 / (v * v));
+
+  const dual_t zero = { 0, 0, 0 };
+  return zero;
+}
+
+static dual_t
+dual_pow (const dual_t a, const dual_t b)
+{
+  const double v = pow (a.value, b.value);
+
+  /* Constant exponents work for any base the power itself is defined for */
+  if (b.first == 0 && b.second == 0)
+    {
+      const double n = b.value;
+      return chain (a, v, n * pow (a.value, n - 1),
+		    n * (n - 1) * pow (a.value, n - 2));
+    }
+
+  /* Otherwise a^b = exp(b ln a) */
+  const dual_t ln_a = dual_function ("ln", a);
+  const dual_t g = {
+    b.value * ln_a.value,
+    b.first * ln_a.value + b.value * ln_a.first,
+    b.second * ln_a.value + 2 * b.first * ln_a.first + b.value * ln_a.second
+  };
+  return chain (g, v, v, v);
+}
+
+static dual_t
+dual_of (const expression_t * const e, const dual_t operands[],
+	 const double vars[])
+{
+  const expression_t exp = *e;
+  dual_t r = { 0, 0, 0 };
+
+  switch (exp.type)
+    {
+    case EXPRESSION_FUNCTION:
+      return dual_function (exp.s, operands[0]);
+    case EXPRESSION_OPERATOR:
+      {
+	const dual_t a = operands[0];
+	if (exp.operator == 'N')
+	  {
+	    r.value = -a.value;
+	    r.first = -a.first;
+	    r.second = -a.second;
+	    return r;
+	  }
+
+	const dual_t b = operands[1];
+	switch (exp.operator)
+	  {
+	  case '+':
+	  case '-':
+	    {
+	      const double sign = exp.operator == '+' ? 1 : -1;
+	      r.value = a.value + sign * b.value;
+	      r.first = a.first + sign * b.first;
+	      r.second = a.second + sign * b.second;
+	      break;
+	    }
+	  case '*':
+	    r.value = a.value * b.value;
+	    r.first = a.first * b.value + a.value * b.first;
+	    r.second = a.second * b.value + 2 * a.first * b.first
+	      + a.value * b.second;
+	    break;
+	  case '/':
+	    r.value = a.value / b.value;
+	    r.first = (a.first - r.value * b.first) / b.value;
+	    r.second = (a.second - 2 * r.first * b.first - r.value * b.second)
+	      / b.value;
+	    break;
+	  case '^':
+	    r = dual_pow (a, b);
+	    break;
+	  }
+	return r;
+      }
+    case EXPRESSION_NUMBER:
+      r.value = exp.d;
+      return r;
+    case EXPRESSION_VARIABLE:
+      {
+	const int i = variable_index (exp.s);
+	r.value = i >= 0 ? vars[i] : NAN;
+	r.first = i == VARIABLE_X;
+	return r;
+      }
+    default:
+      return r;
+    }
+}
+
+static void
+visit_dual (const expression_t * const e, const void *const operands,
+	    void *const result, void *const arg)
+{
+  *(dual_t *) result = dual_of (e, operands, arg);
+}
+
+dual_t
+evaluate_expression_dual (const expression_t exp, const double vars[])
+{
+  dual_t r;
+  if (walk (&exp, sizeof r, visit_dual, (void *) vars, &r) != 0)
+    r.value = r.first = r.second = NAN;
+  return r;
+}
+
+#define RANGE_INTERVALS 64
+#define RANGE_MAX_STEPS 60
+/* Cells are halved this many times at most looking for turns or a pole */
+#define RANGE_MAX_DEPTH 12
+
+struct range_search
+{
+  const expression_t exp;
+  double vars[NVARIABLES];
+  struct expression_range *range;
+};
+
+static dual_t
+evaluate_at (struct range_search *const s, const double x)
+{
+  s->vars[VARIABLE_X] = x;
+  ++s->range->nevaluations;
+  return evaluate_expression_dual (s->exp, s->vars);
+}
+
+static inline bool
+is_finite (const dual_t d)
+{
+  return isfinite (d.value) && isfinite (d.first) && isfinite (d.second);
+}
+
+static void
+include (struct expression_range *const r, const double y)
+{
+  if (y < r->y_min)
+    r->y_min = y;
+  if (y > r->y_max)
+    r->y_max = y;
+}
+
+static void
+add_singularity (struct expression_range *const r, const double x)
+{
+  if (r->nsingularities < EXPRESSION_MAX_SINGULARITIES)
+    r->singularities[r->nsingularities] = x;
+  ++r->nsingularities;
+}
+
+/* Newton steps on f', kept inside [lo, hi] where f' changes sign by falling
+ * back to bisection. Returns where f' is zero, or a pole if f blows up there. */
+static double
+find_critical_point (struct range_search *const s, double lo, double hi,
+		     const double lo_slope)
+{
+  double x = (lo + hi) / 2;
+  for (int step = 0; step < RANGE_MAX_STEPS; ++step)
+    {
+      const dual_t d = evaluate_at (s, x);
+      if (!is_finite (d) || d.first == 0)
+	return x;
+
+      if ((d.first < 0) == (lo_slope < 0))
+	lo = x;
+      else
+	hi = x;
+
+      double next = x - d.first / d.second;
+      if (!(next > lo && next < hi))
+	next = (lo + hi) / 2;
+      if (fabs (next - x) <= 4 * DBL_EPSILON * (fabs (x) + (hi - lo)))
+	return next;
+      x = next;
+    }
+
+  return x;
+}
+
+/* Narrows [lo, hi], over which f moves against the sign of its slope at both
+ * ends, down to the pole that must lie inside */
+static double
+find_pole (struct range_search *const s, double lo, double hi,
+	   const double lo_value, const double slope)
+{
+  for (int step = 0; step < RANGE_MAX_STEPS && hi - lo > 0; ++step)
+    {
+      const double mid = (lo + hi) / 2;
+      const dual_t d = evaluate_at (s, mid);
+      if (!is_finite (d))
+	return mid;
+
+      /* the jump stays on the side where f still moves against its slope */
+      if ((d.value - lo_value) * slope < 0)
+	hi = mid;
+      else
+	lo = mid;
+    }
+
+  return (lo + hi) / 2;
+}
+
+/* Poles are told from turns by f growing without bound, as 1/x^2 does at 0,
+ * far beyond its values at the ends of the cell */
+static bool
+blows_up (const dual_t d, const dual_t a, const dual_t b)
+{
+  const double scale = fmax (fabs (a.value), fabs (b.value));
+  return !isfinite (d.value) || fabs (d.value) > 1e6 * (scale + 1);
+}
+
+/* Includes the extrema of f in [lo, hi], whose ends have the values a and b,
+ * in the range, and adds the poles. Where f moves against its slope at both
+ * ends, there are two turns or a pole between, and the cell is halved until
+ * they part or the pole shows. Returns whether a pole was found. */
+static bool
+search_cell (struct range_search *const s, const double lo, const double hi,
+	     const dual_t a, const dual_t b, const int depth)
+{
+  if (!is_finite (a) || !is_finite (b))
+    return false;
+
+  const double rise = b.value - a.value;
+  if ((a.first < 0) != (b.first < 0))
+    {
+      const double x = find_critical_point (s, lo, hi, a.first);
+      const dual_t d = evaluate_at (s, x);
+      if (blows_up (d, a, b))
+	{
+	  add_singularity (s->range, x);
+	  return true;
+	}
+
+      include (s->range, d.value);
+      return false;
+    }
+  else if (!(rise * a.first < 0 && rise * b.first < 0))
+    return false;
+
+  if (depth == RANGE_MAX_DEPTH)
+    {
+      /* as tan(x) does at pi/2, if the values do grow without bound */
+      const double x = find_pole (s, lo, hi, a.value, a.first);
+      const dual_t d = evaluate_at (s, x);
+      if (blows_up (d, a, b))
+	{
+	  add_singularity (s->range, x);
+	  return true;
+	}
+
+      if (isfinite (d.value))
+	include (s->range, d.value);
+      return false;
+    }
+
+  const double mid = (lo + hi) / 2;
+  const dual_t m = evaluate_at (s, mid);
+  if (isinf (m.value))
+    {
+      add_singularity (s->range, mid);
+      return true;
+    }
+
+  const bool left = search_cell (s, lo, mid, a, m, depth + 1);
+  const bool right = search_cell (s, mid, hi, m, b, depth + 1);
+  if (!left && !right && isfinite (m.value))
+    include (s->range, m.value);
+  return left || right;
+}
+
+int
+find_expression_range (const expression_t exp, const double x_min,
+		       const double x_max, const double t,
+		       struct expression_range *const range)
+{
+  struct range_search s = {.exp = exp,.vars = {[VARIABLE_T] = t},.range =
+      range };
+  range->y_min = INFINITY;
+  range->y_max = -INFINITY;
+  range->nevaluations = 0;
+  range->nsingularities = 0;
+
+  dual_t samples[RANGE_INTERVALS + 1];
+  double xs[RANGE_INTERVALS + 1];
+  bool excluded[RANGE_INTERVALS + 1] = { false };
+  for (int i = 0; i <= RANGE_INTERVALS; ++i)
+    {
+      xs[i] = x_min + i * (x_max - x_min) / RANGE_INTERVALS;
+      samples[i] = evaluate_at (&s, xs[i]);
+    }
+
+  /* A pole may fall right on the grid */
+  for (int i = 0; i <= RANGE_INTERVALS; ++i)
+    if (isinf (samples[i].value))
+      {
+	add_singularity (range, xs[i]);
+	excluded[i > 0 ? i - 1 : i] = true;
+	excluded[i < RANGE_INTERVALS ? i + 1 : i] = true;
+      }
+
+  for (int i = 0; i < RANGE_INTERVALS; ++i)
+    if (search_cell (&s, xs[i], xs[i + 1], samples[i], samples[i + 1], 0))
+      excluded[i] = excluded[i + 1] = true;
+
+  for (int i = 0; i <= RANGE_INTERVALS; ++i)
+    if (isfinite (samples[i].value) && !excluded[i])
+      include (range, samples[i].value);
+
+  return range->y_min <= range->y_max ? 0 : -1;
+}
+
+static const interval_t empty_interval = { INFINITY, -INFINITY };
+static const interval_t whole_interval = { -INFINITY, INFINITY };
+
+static bool
+interval_empty (const interval_t a)
+{
+  return !(a.lo <= a.hi);
+}
+
+/* Bounds that came out undefined, as inf - inf does, could be anything */
+static interval_t
+make_interval (const double lo, const double hi)
+{
+  const interval_t r = {
+    isnan (lo) ? -INFINITY : lo, isnan (hi) ? INFINITY : hi
+  };
+  return r;
+}
+
+static interval_t
+interval_hull (const double a, const double b, const double c, const double d)
+{
+  return make_interval (fmin (fmin (a, b), fmin (c, d)),
+			fmax (fmax (a, b), fmax (c, d)));
+}
+
+/* Zero times anything in the interval, even an infinite bound, is zero */
+static double
+bound_product (const double a, const double b)
+{
+  return a == 0 || b == 0 ? 0 : a * b;
+}
+
+static interval_t
+interval_multiply (const interval_t a, const interval_t b)
+{
+  return interval_hull (bound_product (a.lo, b.lo), bound_product (a.lo, b.hi),
+			bound_product (a.hi, b.lo), bound_product (a.hi, b.hi));
+}
+
+static interval_t
+interval_divide (const interval_t a, const interval_t b)
+{
+  if (b.lo == 0 && b.hi == 0)
+    return empty_interval;
+  if (b.lo <= 0 && b.hi >= 0)
+    return whole_interval;
+
+  const interval_t inverse = { 1 / b.hi, 1 / b.lo };
+  return interval_multiply (a, inverse);
+}
+
+static interval_t
+interval_pow (const interval_t a, const interval_t b)
+{
+  /* Integer exponents are defined for negative bases too */
+  if (b.lo == b.hi && b.lo == round (b.lo) && fabs (b.lo) <= 1e9)
+    {
+      const double n = b.lo;
+      if (n == 0)
+	{
+	  const interval_t one = { 1, 1 };
+	  return one;
+	}
+      if (n < 0)
+	{
+	  const interval_t positive = { -n, -n }, one = { 1, 1 };
+	  return interval_divide (one, interval_pow (a, positive));
+	}
+
+      const double lo = pow (a.lo, n), hi = pow (a.hi, n);
+      if (fmod (n, 2) != 0)
+	return make_interval (lo, hi);
+      if (a.lo <= 0 && a.hi >= 0)
+	return make_interval (0, fmax (lo, hi));
+      return make_interval (fmin (lo, hi), fmax (lo, hi));
+    }
+
+  /* Otherwise only non-negative bases, where the power is monotonic in the
+   * base and in the exponent, so the corners bound it */
+  if (a.hi < 0)
+    return empty_interval;
+  const double lo = fmax (a.lo, 0);
+  return interval_hull (pow (lo, b.lo), pow (lo, b.hi), pow (a.hi, b.lo),
+			pow (a.hi, b.hi));
+}
+
+/* Whether x0 + k period falls in a for some integer k */
+static bool
+interval_holds_period (const interval_t a, const double x0,
+		       const double period)
+{
+  return x0 + ceil ((a.lo - x0) / period) * period <= a.hi;
+}
+
+static interval_t
+interval_function (const char *const name, const interval_t a)
+{
+  if (strcmp (name, "sin") == 0 || strcmp (name, "cos") == 0)
+    {
+      const double shift = name[0] == 'c' ? M_PI_2 : 0;
+      const interval_t s = { a.lo + shift, a.hi + shift };
+      if (!(s.hi - s.lo < 2 * M_PI))
+	return make_interval (-1, 1);
+
+      const double lo = sin (s.lo), hi = sin (s.hi);
+      return make_interval (interval_holds_period (s, -M_PI_2, 2 * M_PI)
+			    ? -1 : fmin (lo, hi),
+			    interval_holds_period (s, M_PI_2, 2 * M_PI)
+			    ? 1 : fmax (lo, hi));
+    }
+  else if (strcmp (name, "tan") == 0)
+    {
+      if (!(a.hi - a.lo < M_PI) || interval_holds_period (a, M_PI_2, M_PI))
+	return whole_interval;
+      return make_interval (tan (a.lo), tan (a.hi));
+    }
+  else if (strcmp (name, "arcsin") == 0 || strcmp (name, "arccos") == 0)
+    {
+      if (a.hi < -1 || a.lo > 1)
+	return empty_interval;
+      const double lo = fmax (a.lo, -1), hi = fmin (a.hi, 1);
+      return name[3] == 's' ? make_interval (asin (lo), asin (hi))
+	: make_interval (acos (hi), acos (lo));
+    }
+  else if (strcmp (name, "arctan") == 0)
+    return make_interval (atan (a.lo), atan (a.hi));
+  else if (strcmp (name, "ln") == 0)
+    {
+      if (a.hi < 0)
+	return empty_interval;
+      return make_interval (a.lo > 0 ? log (a.lo) : -INFINITY, log (a.hi));
+    }
+
+  const interval_t zero = { 0, 0 };
+  return zero;
+}
+
+static interval_t
+interval_of (const expression_t * const e, const interval_t operands[],
+	     const interval_t vars[])
+{
+  const expression_t exp = *e;
+  switch (exp.type)
+    {
+    case EXPRESSION_FUNCTION:
+      {
+	const interval_t a = operands[0];
+	return interval_empty (a) ? a : interval_function (exp.s, a);
+      }
+    case EXPRESSION_OPERATOR:
+      {
+	const interval_t a = operands[0];
+	if (interval_empty (a))
+	  return a;
+	if (exp.operator == 'N')
+	  return make_interval (-a.hi, -a.lo);
+
+	const interval_t b = operands[1];
+	if (interval_empty (b))
+	  return b;
+
+	switch (exp.operator)
+	  {
+	  case '+':
+	    return make_interval (a.lo + b.lo, a.hi + b.hi);
+	  case '-':
+	    return make_interval (a.lo - b.hi, a.hi - b.lo);
+	  case '*':
+	    return interval_multiply (a, b);
+	  case '/':
+	    return interval_divide (a, b);
+	  case '^':
+	    return interval_pow (a, b);
+	  default:
+	    {
+	      const interval_t zero = { 0, 0 };
+	      return zero;
+	    }
+	  }
+      }
+    case EXPRESSION_NUMBER:
+      return make_interval (exp.d, exp.d);
+    case EXPRESSION_VARIABLE:
+      {
+	const int i = variable_index (exp.s);
+	return i >= 0 ? vars[i] : empty_interval;
+      }
+    default:
+      return empty_interval;
+    }
+}
+
+static void
+visit_interval (const expression_t * const e, const void *const operands,
+		void *const result, void *const arg)
+{
+  *(interval_t *) result = interval_of (e, operands, arg);
+}
+
+/* The whole line if the tree is too deep to walk in the memory there is */
+interval_t
+evaluate_expression_interval (const expression_t exp,
+			      const interval_t vars[])
+{
+  interval_t r;
+  return walk (&exp, sizeof r, visit_interval, (void *) vars, &r) == 0
+    ? r : whole_interval;
+}
@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "cplot.h"
+#include "explore.h"
+
+enum key
+{
+  KEY_NONE, KEY_LEFT, KEY_RIGHT, KEY_ZOOM_IN, KEY_ZOOM_OUT, KEY_RESET,
+  KEY_QUIT
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void
+request_stop (const int signal)
+{
+  (void) signal;
+  stop_requested = 1;
+}
+
+static double
+milliseconds_since (const struct timespec *const start)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e3
+    + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Arrow keys arrive as escape sequences, all in one read */
+static enum key
+read_key (const int tty)
+{
+  char buf[16];
+  const ssize_t n = read (tty, buf, sizeof buf);
+  if (n <= 0)
+    return stop_requested || (n < 0 && errno != EINTR) || n == 0
+      ? KEY_QUIT : KEY_NONE;
+
+  if (n >= 3 && buf[0] == '\033' && buf[1] == '[')
+    switch (buf[2])
+      {
+      case 'A':
+	return KEY_ZOOM_IN;
+      case 'B':
+	return KEY_ZOOM_OUT;
+      case 'C':
+	return KEY_RIGHT;
+      case 'D':
+	return KEY_LEFT;
+      default:
+	return KEY_NONE;
+      }
+
+  switch (buf[0])
+    {
+    case 'h':
+      return KEY_LEFT;
+    case 'l':
+      return KEY_RIGHT;
+    case '+':
+    case '=':
+    case 'k':
+      return KEY_ZOOM_IN;
+    case '-':
+    case 'j':
+      return KEY_ZOOM_OUT;
+    case '0':
+    case 'r':
+      return KEY_RESET;
+    case 'q':
+    case 3:			/* ^C, should ISIG be off */
+      return KEY_QUIT;
+    default:
+      return KEY_NONE;
+    }
+}
+
+/* Zooming and panning keep the view inside the data's full x-range */
+static void
+move_view (const enum key key, const double home_min, const double home_max,
+	   double *const x_min, double *const x_max)
+{
+  const double center = (*x_min + *x_max) / 2;
+  double width = *x_max - *x_min;
+
+  switch (key)
+    {
+    case KEY_LEFT:
+      *x_min -= width / 4;
+      break;
+    case KEY_RIGHT:
+      *x_min += width / 4;
+      break;
+    case KEY_ZOOM_IN:
+      /* short of the columns running into each other */
+      if (width / 2 > (fabs (center) + 1) * DBL_EPSILON * 1e4)
+	width /= 2;
+      *x_min = center - width / 2;
+      break;
+    case KEY_ZOOM_OUT:
+      width *= 2;
+      *x_min = center - width / 2;
+      break;
+    case KEY_RESET:
+      *x_min = home_min;
+      width = home_max - home_min;
+      break;
+    default:
+      return;
+    }
+
+  if (width >= home_max - home_min)
+    {
+      *x_min = home_min;
+      width = home_max - home_min;
+    }
+  else if (*x_min < home_min)
+    *x_min = home_min;
+  else if (*x_min + width > home_max)
+    *x_min = home_max - width;
+
+  *x_max = *x_min + width;
+}
+
+static ssize_t
+render_view (char **const buf, size_t *const size, const plot_info_t p,
+	     const plot_grid_t * const grid)
+{
+  for (;;)
+    {
+      const ssize_t len = plot_render_grid (*buf, *size, p, grid);
+      if (len < 0 || (size_t) len < *size)
+	return len;
+
+      char *const bigger = realloc (*buf, len + 1);
+      if (!bigger)
+	return -1;
+      *buf = bigger;
+      *size = len + 1;
+    }
+}
+
+/* Draws the view from the top-left corner of the screen, with a status line */
+static int
+show_view (const struct options *const o, const pyramid_t * const pyramid,
+	   const double x_min, const double x_max, char **const buf,
+	   size_t *const size, FILE * const out)
+{
+  struct timespec start;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  plot_info_t p = o->plot;
+  p.x_min = x_min;
+  p.x_max = x_max;
+  p.lines = false;
+
+  const struct pyramid_extent e = pyramid_extent (pyramid, x_min, x_max);
+  if (!o->y_min_set && e.y_min <= e.y_max)
+    p.y_min = e.y_min;
+  if (!o->y_max_set && e.y_min <= e.y_max)
+    p.y_max = e.y_max;
+  if (p.y_min == p.y_max)
+    {
+      p.y_min -= 0.5;
+      p.y_max += 0.5;
+    }
+
+  plot_grid_t grid;
+  if (plot_grid_init (&grid, p) != 0)
+    return -1;
+
+  const size_t count = pyramid_view (pyramid, &grid, p);
+  const ssize_t len = render_view (buf, size, p, &grid);
+  plot_grid_destroy (&grid);
+  if (len < 0)
+    return -1;
+  const double elapsed = milliseconds_since (&start);
+
+  fputs ("\033[H\033[2J", out);
+  fwrite (*buf, 1, len, out);
+  fprintf (out, "\033[0m%zu points in view, drawn in %.2f ms   "
+	   "arrows or h/j/k/l: pan and zoom   0: reset   q: quit", count,
+	   elapsed);
+  return fflush (out) == 0 ? 0 : -1;
+}
+
+int
+explore (const struct options *const o, point_t points[],
+	 const size_t npoints, FILE * const out)
+{
+  const char *const error = plot_check_info (o->plot);
+  if (error)
+    {
+      fputs (error, out);
+      return -1;
+    }
+
+  const int tty = open ("/dev/tty", O_RDONLY);
+  if (tty < 0 || !isatty (fileno (out)))
+    {
+      fputs ("Error: --interactive needs a terminal.\n", stderr);
+      if (tty >= 0)
+	close (tty);
+      return -1;
+    }
+
+  pyramid_t pyramid;
+  if (pyramid_build (&pyramid, points, npoints) != 0)
+    {
+      perror ("");
+      close (tty);
+      return -1;
+    }
+
+  /* Keys are taken as they are typed, without echo */
+  struct termios saved, raw;
+  tcgetattr (tty, &saved);
+  raw = saved;
+  raw.c_lflag &= ~(ICANON | ECHO);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr (tty, TCSANOW, &raw);
+
+  struct sigaction sa, old_int, old_term;
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = request_stop;	/* no SA_RESTART, so reads are interrupted */
+  sigaction (SIGINT, &sa, &old_int);
+  sigaction (SIGTERM, &sa, &old_term);
+
+  /* The alternate screen leaves the shell's scrollback as it was */
+  fputs ("\033[?1049h\033[?25l", out);
+
+  const double home_min = o->plot.x_min, home_max = o->plot.x_max;
+  double x_min = home_min, x_max = home_max;
+  size_t size = 16384;
+  char *buf = malloc (size);
+
+  int ret = buf ? 0 : -1;
+  for (enum key key = KEY_NONE; ret == 0 && key != KEY_QUIT;
+       key = read_key (tty))
+    {
+      move_view (key, home_min, home_max, &x_min, &x_max);
+      ret = show_view (o, &pyramid, x_min, x_max, &buf, &size, out);
+    }
+
+  fputs ("\033[0m\033[?25h\033[?1049l", out);
+  fflush (out);
+
+  sigaction (SIGINT, &old_int, NULL);
+  sigaction (SIGTERM, &old_term, NULL);
+  tcsetattr (tty, TCSANOW, &saved);
+  close (tty);
+
+  free (buf);
+  pyramid_destroy (&pyramid);
+  return ret;
+}
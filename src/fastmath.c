@@ -0,0 +1,471 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include "fastmath.h"
+
+/* As wide as the target's vector registers; GCC lowers the operators below to
+ * SIMD instructions. Comparisons give masks of all ones or zeros per lane. */
+#ifdef __AVX__
+#define LANES 4
+#else
+#define LANES 2
+#endif
+
+/* The kernels made of divisions and square roots, and ln and exp, only beat
+ * libm with four lanes or more; with fewer, fast calls libm for them */
+#define WIDE (LANES >= 4)
+
+typedef double vdouble __attribute__ ((vector_size (LANES * sizeof (double))));
+typedef long long vlong __attribute__ ((vector_size (LANES * sizeof (double))));
+typedef unsigned long long vulong
+  __attribute__ ((vector_size (LANES * sizeof (double))));
+
+#define SIGN_BIT ((long long) 0x8000000000000000ULL)
+#define SHIFTER 0x1.8p52	/* adding and subtracting it rounds to an integer */
+#define TWO52 0x1p52
+#define TWO52_BITS 0x4330000000000000LL
+
+/* Beyond this, reducing by pi/2 in three parts loses accuracy */
+#define TRIG_LIMIT 1e5
+#define EXP_LIMIT 700.0
+
+/* pi/2 in three parts of 33 bits, so k times each of the first two is exact */
+static const double pio2_1 = 1.57079632673412561417e+00;
+static const double pio2_2 = 6.07710050630396597660e-11;
+static const double pio2_3 = 2.02226624871116645580e-21;
+static const double two_over_pi = 6.36619772367581382433e-01;
+
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+static const double inv_ln2 = 1.44269504088896338700e+00;
+
+static inline vdouble
+splat (const double d)
+{
+  const vdouble zero = { 0 };
+  return zero + d;
+}
+
+static inline vdouble
+select_lanes (const vlong mask, const vdouble a, const vdouble b)
+{
+  return (vdouble) ((mask & (vlong) a) | (~mask & (vlong) b));
+}
+
+static inline vdouble
+round_lanes (const vdouble v)
+{
+  return (v + SHIFTER) - SHIFTER;
+}
+
+/* Conversions between doubles and 64-bit integers, and 64-bit integer
+ * comparisons, have no SSE2 instructions, so integers go through the bits of
+ * doubles. This gives an integral k, with |k| < 2^51, in the low bits. */
+static inline vlong
+integer_bits (const vdouble k)
+{
+  return (vlong) (k + SHIFTER);
+}
+
+/* The double of a small non-negative integer u < 2^52 */
+static inline vdouble
+small_integer (const vlong u)
+{
+  return (vdouble) (u | TWO52_BITS) - TWO52;
+}
+
+static inline vdouble
+sqrt_lanes (const vdouble v)
+{
+#if defined(__AVX__)
+  return (vdouble) _mm256_sqrt_pd ((__m256d) v);
+#elif defined(__SSE2__)
+  return (vdouble) _mm_sqrt_pd ((__m128d) v);
+#else
+  vdouble r;
+  for (int i = 0; i < LANES; ++i)
+    r[i] = sqrt (v[i]);
+  return r;
+#endif
+}
+
+/* x = k pi/2 + r with |r| <= pi/4; the quadrant is k mod 4 */
+static inline vdouble
+reduce_pio2 (const vdouble x, vlong * const quadrant)
+{
+  const vdouble k = round_lanes (x * two_over_pi);
+  *quadrant = integer_bits (k) & 3;
+  return ((x - k * pio2_1) - k * pio2_2) - k * pio2_3;
+}
+
+static inline vdouble
+horner (const vdouble x, const double coefficients[], const size_t n)
+{
+  vdouble r = splat (coefficients[0]);
+#pragma GCC unroll 16
+  for (size_t i = 1; i < n; ++i)
+    r = r * x + coefficients[i];
+  return r;
+}
+
+#define HORNER(x, coefficients) \
+  horner (x, coefficients, sizeof (coefficients) / sizeof (coefficients[0]))
+
+/* The sin and cos kernels of fdlibm, for |r| <= pi/4 */
+static const double sin_coefficients[] = {
+  1.58969099521155010221e-10, -2.50507602534068634195e-08,
+  2.75573137070700676789e-06, -1.98412698298579493134e-04,
+  8.33333333332248946124e-03, -1.66666666666666324348e-01
+};
+
+static const double cos_coefficients[] = {
+  -1.13596475577881948265e-11, 2.08757232129817482790e-09,
+  -2.75573143513906633035e-07, 2.48015872894767294178e-05,
+  -1.38888888888741095749e-03, 4.16666666666666019037e-02
+};
+
+/* atan(t) = t - t^3/3 + t^5/5 - ..., for |t| <= tan(pi/16) */
+static const double atan_coefficients[] = {
+  1.0 / 21, -1.0 / 19, 1.0 / 17, -1.0 / 15, 1.0 / 13, -1.0 / 11, 1.0 / 9, -1.0 / 7, 1.0 / 5, -1.0 / 3, 1
+};
+
+/* 2 atanh(f) = 2f + 2f (f^2/3 + f^4/5 + ...) */
+static const double log_coefficients[] = {
+  1.0 / 17, 1.0 / 15, 1.0 / 13, 1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3, 0
+};
+
+/* exp(r) = 1 + r + r^2/2! + ... + r^11/11!, for |r| <= ln(2)/2 */
+static const double exp_coefficients[] = {
+  1.0 / 39916800, 1.0 / 3628800, 1.0 / 362880, 1.0 / 40320, 1.0 / 5040,
+  1.0 / 720, 1.0 / 120, 1.0 / 24, 1.0 / 6, 1.0 / 2, 1, 1
+};
+
+static inline vdouble
+sin_kernel (const vdouble r)
+{
+  const vdouble z = r * r;
+  return r + r * z * HORNER (z, sin_coefficients);
+}
+
+static inline vdouble
+cos_kernel (const vdouble r)
+{
+  const vdouble z = r * r;
+  return 1 - 0.5 * z + z * z * HORNER (z, cos_coefficients);
+}
+
+/* sin, then cos, and -sin and -cos in successive quadrants */
+static inline vdouble
+sin_quadrant (const vdouble r, const vlong quadrant)
+{
+  const vdouble v = select_lanes (small_integer (quadrant & 1) != 0,
+				  cos_kernel (r), sin_kernel (r));
+  return (vdouble) ((vlong) v ^ ((quadrant & 2) << 62));
+}
+
+static inline __attribute__ ((always_inline)) vdouble
+sin_lanes (const vdouble x)
+{
+  vlong quadrant;
+  const vdouble r = reduce_pio2 (x, &quadrant);
+  return sin_quadrant (r, quadrant);
+}
+
+static inline __attribute__ ((always_inline)) vdouble
+cos_lanes (const vdouble x)
+{
+  vlong quadrant;
+  const vdouble r = reduce_pio2 (x, &quadrant);
+  return sin_quadrant (r, (quadrant + 1) & 3);
+}
+
+static inline __attribute__ ((always_inline)) vdouble
+tan_lanes (const vdouble x)
+{
+  vlong quadrant;
+  const vdouble r = reduce_pio2 (x, &quadrant);
+  const vdouble s = sin_kernel (r), c = cos_kernel (r);
+  return select_lanes (small_integer (quadrant & 1) != 0, -c / s, s / c);
+}
+
+/* Halving the angle twice, by tan(a/2) = t / (1 + sqrt(1 + t^2)), leaves a
+ * Taylor series that converges within eleven terms */
+static inline __attribute__ ((always_inline)) vdouble
+atan_lanes (const vdouble x)
+{
+  const vlong sign = (vlong) x & SIGN_BIT;
+  const vdouble a = (vdouble) ((vlong) x & ~SIGN_BIT);
+  const vlong inverted = a > 1;
+  vdouble t = select_lanes (inverted, 1 / a, a);
+
+  t = t / (1 + sqrt_lanes (1 + t * t));
+  t = t / (1 + sqrt_lanes (1 + t * t));
+
+  vdouble r = t * HORNER (t * t, atan_coefficients);
+  r = 4 * r;
+  r = select_lanes (inverted, M_PI_2 - r, r);
+  return (vdouble) ((vlong) r | sign);
+}
+
+static inline __attribute__ ((always_inline)) vdouble
+asin_lanes (const vdouble x)
+{
+  return atan_lanes (x / sqrt_lanes ((1 - x) * (1 + x)));
+}
+
+static inline __attribute__ ((always_inline)) vdouble
+acos_lanes (const vdouble x)
+{
+  return 2 * atan_lanes (sqrt_lanes ((1 - x) / (1 + x)));
+}
+
+/* x = 2^e m with m in [sqrt(1/2), sqrt(2)), and ln(m) = 2 atanh((m-1)/(m+1)) */
+static inline __attribute__ ((always_inline)) vdouble
+log_lanes (const vdouble x)
+{
+  const vlong bits = (vlong) x;
+  vdouble ed = small_integer ((vlong) ((vulong) bits >> 52)) - 1023;
+  vdouble m = (vdouble) ((bits & 0x000FFFFFFFFFFFFFLL) | 0x3FF0000000000000LL);
+  const vlong big = m > M_SQRT2;
+  m = select_lanes (big, m * 0.5, m);
+  ed = select_lanes (big, ed + 1, ed);
+
+  const vdouble f = (m - 1) / (m + 1);
+  const vdouble tail = HORNER (f * f, log_coefficients);
+  return ed * ln2_hi + (f * (2 + 2 * tail) + ed * ln2_lo);
+}
+
+/* y = k ln 2 + r with |r| <= ln(2)/2, so exp(y) = 2^k exp(r) */
+static inline __attribute__ ((always_inline)) vdouble
+exp_lanes (const vdouble y)
+{
+  const vdouble k = round_lanes (y * inv_ln2);
+  const vdouble r = (y - k * ln2_hi) - k * ln2_lo;
+  const vdouble p = HORNER (r, exp_coefficients);
+  const vlong scale = (integer_bits (k) + 1023) << 52;
+  return p * (vdouble) scale;
+}
+
+/* Where a kernel's reductions hold; elsewhere fast falls back to libm */
+enum domain
+{
+  DOMAIN_ANY, DOMAIN_TRIG, DOMAIN_LOG
+};
+
+static inline vlong
+in_domain (const vdouble x, const enum domain d)
+{
+  switch (d)
+    {
+    case DOMAIN_TRIG:
+      return (vdouble) ((vlong) x & ~SIGN_BIT) <= TRIG_LIMIT;
+    case DOMAIN_LOG:
+      return (x >= DBL_MIN) & (x <= DBL_MAX);
+    default:
+      return (x == x) | (x != x);
+    }
+}
+
+static inline bool
+all_lanes (const vlong mask)
+{
+  long long all = -1;
+  for (int lane = 0; lane < LANES; ++lane)
+    all &= mask[lane];
+  return all != 0;
+}
+
+static inline bool
+none_lanes (const vlong mask)
+{
+  long long any = 0;
+  for (int lane = 0; lane < LANES; ++lane)
+    any |= mask[lane];
+  return any == 0;
+}
+
+static const char *const function_names[MATH_NFUNCTIONS] = {
+  [MATH_SIN] = "sin",[MATH_COS] = "cos",[MATH_TAN] = "tan",
+  [MATH_ASIN] = "arcsin",[MATH_ACOS] = "arccos",[MATH_ATAN] = "arctan",
+  [MATH_LN] = "ln"
+};
+
+int
+math_function_index (const char *const name)
+{
+  for (int i = 0; i < MATH_NFUNCTIONS; ++i)
+    if (strcmp (name, function_names[i]) == 0)
+      return i;
+
+  return -1;
+}
+
+/* Inlined with constant kernels, so each function gets its own loop. The
+ * block is loaded and stored whole; lanes are only touched one at a time when
+ * some are out of the domain. */
+static inline __attribute__ ((always_inline)) void
+apply_block (double block[LANES], vdouble (*const fast) (vdouble),
+	     double (*const precise) (double), const enum domain d)
+{
+  vdouble x;
+  memcpy (&x, block, sizeof x);
+  const vdouble y = fast (x);
+  memcpy (block, &y, sizeof y);
+
+  const vlong inside = in_domain (x, d);
+  if (d != DOMAIN_ANY && !all_lanes (inside))
+    for (int lane = 0; lane < LANES; ++lane)
+      if (!inside[lane])
+	block[lane] = precise (x[lane]);
+}
+
+static inline __attribute__ ((always_inline)) void
+apply_lanes (double values[], const size_t n, vdouble (*const fast) (vdouble),
+	     double (*const precise) (double), const enum domain d)
+{
+  size_t i = 0;
+  for (; i + LANES <= n; i += LANES)
+    apply_block (values + i, fast, precise, d);
+
+  if (i < n)
+    {
+      /* the last block is padded with a value every kernel accepts */
+      double block[LANES];
+      for (int lane = 0; lane < LANES; ++lane)
+	block[lane] = i + lane < n ? values[i + lane] : 0.5;
+      apply_block (block, fast, precise, d);
+      memcpy (values + i, block, (n - i) * sizeof (double));
+    }
+}
+
+void
+math_apply (const enum math_function f, const enum math_mode mode,
+	    double values[], const size_t n)
+{
+  static double (*const precise[MATH_NFUNCTIONS]) (double) = {
+    [MATH_SIN] = sin,[MATH_COS] = cos,[MATH_TAN] = tan,[MATH_ASIN] = asin,
+    [MATH_ACOS] = acos,[MATH_ATAN] = atan,[MATH_LN] = log
+  };
+
+  const bool narrow_loses = f == MATH_ASIN || f == MATH_ACOS
+    || f == MATH_ATAN || f == MATH_LN;
+  if (mode == MATH_PRECISE || (!WIDE && narrow_loses))
+    {
+      for (size_t i = 0; i < n; ++i)
+	values[i] = precise[f] (values[i]);
+      return;
+    }
+
+  switch (f)
+    {
+    case MATH_SIN:
+      apply_lanes (values, n, sin_lanes, sin, DOMAIN_TRIG);
+      break;
+    case MATH_COS:
+      apply_lanes (values, n, cos_lanes, cos, DOMAIN_TRIG);
+      break;
+    case MATH_TAN:
+      apply_lanes (values, n, tan_lanes, tan, DOMAIN_TRIG);
+      break;
+    case MATH_ASIN:
+      apply_lanes (values, n, asin_lanes, asin, DOMAIN_ANY);
+      break;
+    case MATH_ACOS:
+      apply_lanes (values, n, acos_lanes, acos, DOMAIN_ANY);
+      break;
+    case MATH_ATAN:
+      apply_lanes (values, n, atan_lanes, atan, DOMAIN_ANY);
+      break;
+    case MATH_LN:
+      apply_lanes (values, n, log_lanes, log, DOMAIN_LOG);
+      break;
+    default:
+      break;
+    }
+}
+
+/* Integer powers up to 64, the most common kind, by repeated squaring */
+#define INTEGER_POW_BITS 7
+
+static inline vdouble
+integer_pow_lanes (vdouble base, const vdouble exponent)
+{
+  const vulong n =
+    (vulong) integer_bits ((vdouble) ((vlong) exponent & ~SIGN_BIT));
+  vdouble r = splat (1);
+  for (int bit = 0; bit < INTEGER_POW_BITS; ++bit, base *= base)
+    r = select_lanes (small_integer ((vlong) ((n >> bit) & 1)) != 0,
+		      r * base, r);
+
+  return select_lanes (exponent < 0, 1 / r, r);
+}
+
+static inline void
+pow_block (double base[LANES], const double exponent[LANES])
+{
+  vdouble x, e;
+  memcpy (&x, base, sizeof x);
+  memcpy (&e, exponent, sizeof e);
+
+  const vlong integer = ((vdouble) ((vlong) e & ~SIGN_BIT) <= 64)
+    & (e == round_lanes (e));
+  if (all_lanes (integer))
+    {
+      const vdouble r = integer_pow_lanes (x, e);
+      memcpy (base, &r, sizeof r);
+      return;
+    }
+
+  if (!WIDE)
+    {
+      for (int lane = 0; lane < LANES; ++lane)
+	base[lane] = pow (base[lane], exponent[lane]);
+      return;
+    }
+
+  /* x^e = exp(e ln x) */
+  const vdouble y = e * log_lanes (x);
+  vdouble r = exp_lanes (y);
+  if (!none_lanes (integer))
+    r = select_lanes (integer, integer_pow_lanes (x, e), r);
+  memcpy (base, &r, sizeof r);
+
+  const vlong inside = ~integer & in_domain (x, DOMAIN_LOG)
+    & ((vdouble) ((vlong) y & ~SIGN_BIT) <= EXP_LIMIT);
+  if (!all_lanes (inside | integer))
+    for (int lane = 0; lane < LANES; ++lane)
+      if (!integer[lane] && !inside[lane])
+	base[lane] = pow (x[lane], e[lane]);
+}
+
+void
+math_pow (const enum math_mode mode, double base[],
+	  const double exponent[], const size_t n)
+{
+  if (mode == MATH_PRECISE)
+    {
+      for (size_t i = 0; i < n; ++i)
+	base[i] = pow (base[i], exponent[i]);
+      return;
+    }
+
+  size_t i = 0;
+  for (; i + LANES <= n; i += LANES)
+    pow_block (base + i, exponent + i);
+
+  if (i < n)
+    {
+      double x[LANES], e[LANES];
+      for (int lane = 0; lane < LANES; ++lane)
+	{
+	  x[lane] = i + lane < n ? base[i + lane] : 1;
+	  e[lane] = i + lane < n ? exponent[i + lane] : 1;
+	}
+      pow_block (x, e);
+      memcpy (base + i, x, (n - i) * sizeof (double));
+    }
+}
@@ -0,0 +1,117 @@
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include "histogram.h"
+
+int
+histogram_init (histogram_t * const h, const size_t nbins, const double min,
+		const double max, const bool log)
+{
+  h->counts = NULL;
+  h->nbins = nbins;
+  h->log = log;
+  h->below = h->above = 0;
+  h->min = log ? log10 (min) : min;
+  h->max = log ? log10 (max) : max;
+
+  /* also false for NaNs and for logarithms of values that are not positive */
+  if (nbins == 0 || !(h->min < h->max) || !isfinite (h->max - h->min))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  h->scale = nbins / (h->max - h->min);
+  h->counts = calloc (nbins, sizeof (*h->counts));
+  return h->counts ? 0 : -1;
+}
+
+void
+histogram_add (histogram_t * const h, const double values[], const size_t n)
+{
+  const size_t last = h->nbins - 1;
+  for (size_t i = 0; i < n; ++i)
+    {
+      double v = values[i];
+      if (h->log)
+	{
+	  if (v <= 0)
+	    {
+	      ++h->below;
+	      continue;
+	    }
+	  v = log10 (v);
+	}
+
+      const double bin = (v - h->min) * h->scale;
+      if (bin < 0)
+	++h->below;
+      else if (bin < h->nbins)
+	++h->counts[(size_t) bin];
+      else if (v <= h->max)
+	++h->counts[last];	/* rounding put max past the last bin */
+      else if (v > h->max)
+	++h->above;
+    }
+}
+
+void
+histogram_merge (histogram_t * const h, const histogram_t * const other)
+{
+  for (size_t i = 0; i < h->nbins; ++i)
+    h->counts[i] += other->counts[i];
+  h->below += other->below;
+  h->above += other->above;
+}
+
+uint64_t
+histogram_max_count (const histogram_t * const h)
+{
+  uint64_t max = 0;
+  for (size_t i = 0; i < h->nbins; ++i)
+    max = h->counts[i] > max ? h->counts[i] : max;
+
+  return max;
+}
+
+void
+histogram_destroy (histogram_t * const h)
+{
+  free (h->counts);
+  h->counts = NULL;
+}
+
+/* Column edges that fall on bin edges are taken to, so the bins a column
+ * covers are not widened by rounding */
+#define EDGE_SLACK 1e-9
+
+void
+histogram_grid (const histogram_t * const h, plot_grid_t * const grid,
+		const plot_info_t p)
+{
+  plot_grid_clear (grid);
+
+  for (unsigned short c = 0; c < grid->ncolumns; ++c)
+    {
+      const double x0 = (plot_column_x (p, c) - h->min) * h->scale;
+      const double x1 = (plot_column_x (p, c + 1) - h->min) * h->scale;
+      if (x1 <= 0 || x0 > h->nbins)
+	continue;
+
+      long first = floor (x0 + EDGE_SLACK), last = ceil (x1 - EDGE_SLACK) - 1;
+      first = first < 0 ? 0 : first;
+      last = last >= (long) h->nbins ? (long) h->nbins - 1 : last;
+      last = last < first ? first : last;
+      if (first >= (long) h->nbins)
+	continue;
+
+      uint64_t count = 0;
+      for (long i = first; i <= last; ++i)
+	count = h->counts[i] > count ? h->counts[i] : count;
+
+      /* A bar reaches every row whose lower edge it attains */
+      for (unsigned short r = 0; count > 0 && r < grid->nrows; ++r)
+	if (count >= plot_row_y (p, r))
+	  grid->cells[(size_t) r * grid->ncolumns + c] = 1;
+    }
+}
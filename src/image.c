@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raster.h"
+
+#define IDAT_SIZE (1 << 16)	/* compressed bytes in each IDAT chunk */
+#define MATCH_MAX 258
+#define HISTORY 3		/* bytes of the row before, as far as matches go */
+
+int
+raster_write_ppm (const raster_t * const image, FILE * const stream)
+{
+  const size_t size = (size_t) image->width * image->height * 3;
+
+  if (fprintf (stream, "P6\n%u %u\n255\n", image->width, image->height) < 0
+      || fwrite (image->pixels, 1, size, stream) != size)
+    return -1;
+
+  return 0;
+}
+
+/* Checksums are kept as the data is written, and the compressed data goes out
+ * as an IDAT chunk whenever the buffer fills, so neither the filtered nor the
+ * compressed image ever has to exist in memory as a whole */
+struct png_writer
+{
+  FILE *stream;
+  uint32_t crc_table[256];
+  uint32_t crc;
+  uint32_t adler_a, adler_b;
+  uint64_t bits;		/* not yet a whole byte, from the lowest */
+  unsigned int nbits;
+  unsigned char *idat;
+  size_t nidat;
+  uint16_t codes[288];		/* the fixed Huffman codes, bits reversed */
+  unsigned char code_lengths[288];
+  int error;
+};
+
+static void
+put (struct png_writer *const w, const void *const data, const size_t n)
+{
+  const unsigned char *const bytes = data;
+  for (size_t i = 0; i < n; ++i)
+    w->crc = w->crc_table[(w->crc ^ bytes[i]) & 0xFF] ^ (w->crc >> 8);
+
+  if (fwrite (data, 1, n, w->stream) != n)
+    w->error = -1;
+}
+
+/* The uncompressed data goes into the zlib stream's Adler-32 */
+static void
+sum_data (struct png_writer *const w, const unsigned char *const data,
+	  const size_t n)
+{
+  /* 5552 bytes is as many as can be summed before the sums could overflow */
+  for (size_t i = 0; i < n;)
+    {
+      const size_t end = n - i > 5552 ? i + 5552 : n;
+      for (; i < end; ++i)
+	{
+	  w->adler_a += data[i];
+	  w->adler_b += w->adler_a;
+	}
+      w->adler_a %= 65521;
+      w->adler_b %= 65521;
+    }
+}
+
+static void
+put_u32 (struct png_writer *const w, const uint32_t value)
+{
+  const unsigned char bytes[4] = {
+    value >> 24, value >> 16, value >> 8, value
+  };
+  put (w, bytes, sizeof bytes);
+}
+
+static void
+begin_chunk (struct png_writer *const w, const uint32_t length,
+	     const char type[4])
+{
+  put_u32 (w, length);
+  w->crc = 0xFFFFFFFF;
+  put (w, type, 4);
+}
+
+static void
+end_chunk (struct png_writer *const w)
+{
+  put_u32 (w, w->crc ^ 0xFFFFFFFF);
+}
+
+static void
+flush_idat (struct png_writer *const w)
+{
+  if (w->nidat == 0)
+    return;
+
+  begin_chunk (w, w->nidat, "IDAT");
+  put (w, w->idat, w->nidat);
+  end_chunk (w);
+  w->nidat = 0;
+}
+
+static void
+put_byte (struct png_writer *const w, const unsigned char byte)
+{
+  w->idat[w->nidat++] = byte;
+  if (w->nidat == IDAT_SIZE)
+    flush_idat (w);
+}
+
+/* Deflate packs its fields from the lowest bit of each byte */
+static void
+put_bits (struct png_writer *const w, const uint32_t value,
+	  const unsigned int n)
+{
+  w->bits |= (uint64_t) value << w->nbits;
+  w->nbits += n;
+  for (; w->nbits >= 8; w->nbits -= 8, w->bits >>= 8)
+    put_byte (w, w->bits & 0xFF);
+}
+
+/* Pads the last byte with zeros */
+static void
+align_bits (struct png_writer *const w)
+{
+  if (w->nbits > 0)
+    put_bits (w, 0, 8 - w->nbits);
+}
+
+/* The fixed code of deflate, RFC 1951 3.2.6. Huffman codes are sent from their
+ * highest bit, so they are kept reversed to be sent as any other field. */
+static void
+init_fixed_codes (struct png_writer *const w)
+{
+  uint32_t code = 0;
+  for (unsigned int length = 7; length <= 9; ++length, code <<= 1)
+    for (unsigned int symbol = 0; symbol < 288; ++symbol)
+      {
+	const unsigned int symbol_length = symbol < 144 ? 8 : symbol < 256 ? 9
+	  : symbol < 280 ? 7 : 8;
+	if (symbol_length != length)
+	  continue;
+
+	uint16_t reversed = 0;
+	for (unsigned int bit = 0; bit < length; ++bit)
+	  reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+	w->codes[symbol] = reversed;
+	w->code_lengths[symbol] = length;
+	++code;
+      }
+}
+
+static void
+put_symbol (struct png_writer *const w, const unsigned int symbol)
+{
+  put_bits (w, w->codes[symbol], w->code_lengths[symbol]);
+}
+
+/* A copy of length bytes from distance 1 or 3 back, which covers runs of a
+ * gray byte and runs of a pixel */
+static void
+put_match (struct png_writer *const w, const unsigned int length,
+	   const unsigned int distance)
+{
+  static const uint16_t bases[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+    67, 83, 99, 115, 131, 163, 195, 227, 258
+  };
+  static const unsigned char extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+    5, 5, 5, 5, 0
+  };
+
+  unsigned int k = 28;
+  while (bases[k] > length)
+    --k;
+  put_symbol (w, 257 + k);
+  put_bits (w, length - bases[k], extra[k]);
+  /* Distance codes are 5 bits, and code d - 1 needs no extra bits for d <= 4 */
+  uint16_t reversed = 0;
+  for (unsigned int bit = 0; bit < 5; ++bit)
+    reversed |= (((distance - 1) >> bit) & 1) << (4 - bit);
+  put_bits (w, reversed, 5);
+}
+
+/* How many bytes from data[i] on repeat those distance back, at most max */
+static size_t
+run_length (const unsigned char *const data, const size_t i,
+	    const size_t distance, const size_t max)
+{
+  size_t n = 0;
+  while (n < max && data[i + n] == data[i + n - distance])
+    ++n;
+
+  return n;
+}
+
+/* Compresses a row, preceded in line by the history bytes before it */
+static void
+compress_row (struct png_writer *const w, const unsigned char *const line,
+	      const size_t history, const size_t size)
+{
+  const size_t end = history + size;
+  for (size_t i = history; i < end;)
+    {
+      const size_t max = end - i < MATCH_MAX ? end - i : MATCH_MAX;
+      const size_t one = i >= 1 ? run_length (line, i, 1, max) : 0;
+      const size_t three = i >= 3 ? run_length (line, i, 3, max) : 0;
+      const size_t best = one >= three ? one : three;
+      if (best >= 3)
+	{
+	  put_match (w, best, one >= three ? 1 : 3);
+	  i += best;
+	}
+      else
+	put_symbol (w, line[i++]);
+    }
+}
+
+int
+raster_write_png (const raster_t * const image, FILE * const stream)
+{
+  static const unsigned char signature[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'
+  };
+
+  struct png_writer w = {.stream = stream,.adler_a = 1 };
+  for (uint32_t n = 0; n < 256; ++n)
+    {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+	c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      w.crc_table[n] = c;
+    }
+  init_fixed_codes (&w);
+
+  /* Each row is preceded by its filter type, which is always none, and by the
+   * last bytes of the row before, which matches may reach back into */
+  const size_t row = 1 + (size_t) image->width * 3;
+  unsigned char *const line = malloc (HISTORY + row);
+  w.idat = malloc (IDAT_SIZE);
+  if (!line || !w.idat)
+    {
+      free (line);
+      free (w.idat);
+      return -1;
+    }
+
+  put (&w, signature, sizeof signature);
+
+  begin_chunk (&w, 13, "IHDR");
+  put_u32 (&w, image->width);
+  put_u32 (&w, image->height);
+  /* 8 bits per sample, RGB, deflate, no filtering across rows, no interlace */
+  put (&w, (const unsigned char[]) {8, 2, 0, 0, 0}, 5);
+  end_chunk (&w);
+
+  put_byte (&w, 0x78);
+  put_byte (&w, 0x01);
+  /* A single final block with the fixed code */
+  put_bits (&w, 1, 1);
+  put_bits (&w, 1, 2);
+
+  size_t history = 0;
+  for (size_t y = 0; y < image->height; ++y)
+    {
+      memmove (line, line + row, HISTORY);
+      line[HISTORY] = 0;
+      memcpy (line + HISTORY + 1, image->pixels + y * (row - 1), row - 1);
+      sum_data (&w, line + HISTORY, row);
+      compress_row (&w, line + HISTORY - history, history, row);
+      /* Rows narrower than the history leave only part of it */
+      history = history + row < HISTORY ? history + row : HISTORY;
+    }
+
+  put_symbol (&w, 256);
+  align_bits (&w);
+  const uint32_t adler = w.adler_b << 16 | w.adler_a;
+  for (int shift = 24; shift >= 0; shift -= 8)
+    put_byte (&w, adler >> shift);
+  flush_idat (&w);
+
+  begin_chunk (&w, 0, "IEND");
+  end_chunk (&w);
+
+  free (line);
+  free (w.idat);
+  return w.error;
+}
@@ -0,0 +1,148 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "implicit.h"
+
+/* Samples across each side of a cell for the sign test */
+#define CELL_SAMPLES 3
+
+struct implicit_search
+{
+  const expression_t exp;
+  const plot_info_t plot;
+  double t;
+
+  point_t *points;
+  size_t npoints, size;
+  size_t nevaluations;
+  bool failed;
+};
+
+static void
+add_cell (struct implicit_search *const s, const double x0, const double x1,
+	  const double y0, const double y1)
+{
+  if (s->npoints == s->size)
+    {
+      const size_t size = s->size * 2;
+      point_t *const points = realloc (s->points, size * sizeof (*points));
+      if (!points)
+	{
+	  s->failed = true;
+	  return;
+	}
+      s->points = points;
+      s->size = size;
+    }
+
+  const point_t centre = { (x0 + x1) / 2, (y0 + y1) / 2 };
+  s->points[s->npoints++] = centre;
+}
+
+/* Whether exp is zero somewhere in the cell, as far as a grid of samples
+ * across it tells; points where it is undefined are skipped */
+static bool
+changes_sign (struct implicit_search *const s, const double x0,
+	      const double x1, const double y0, const double y1)
+{
+  double vars[NVARIABLES] = {[VARIABLE_T] = s->t };
+  bool negative = false, positive = false;
+
+  for (int i = 0; i < CELL_SAMPLES; ++i)
+    for (int j = 0; j < CELL_SAMPLES; ++j)
+      {
+	vars[VARIABLE_X] = x0 + (x1 - x0) * i / (CELL_SAMPLES - 1);
+	vars[VARIABLE_Y] = y0 + (y1 - y0) * j / (CELL_SAMPLES - 1);
+	const double v = evaluate_expression_vars (s->exp, vars);
+	++s->nevaluations;
+
+	if (v == 0)
+	  return true;
+	negative |= v < 0;
+	positive |= v > 0;
+	if (negative && positive)
+	  return true;
+      }
+
+  return false;
+}
+
+/* Searches columns [c0, c1) and rows [r0, r1) of the grid */
+static void
+search (struct implicit_search *const s, const unsigned short c0,
+	const unsigned short c1, const unsigned short r0,
+	const unsigned short r1)
+{
+  if (s->failed)
+    return;
+
+  const double x0 = plot_column_x (s->plot, c0);
+  const double x1 = plot_column_x (s->plot, c1);
+  const double y0 = plot_row_y (s->plot, r0);
+  const double y1 = plot_row_y (s->plot, r1);
+
+  interval_t vars[NVARIABLES] = {
+    [VARIABLE_X] = {x0, x1},
+    [VARIABLE_Y] = {y0, y1},
+    [VARIABLE_T] = {s->t, s->t}
+  };
+  const interval_t bounds = evaluate_expression_interval (s->exp, vars);
+  ++s->nevaluations;
+  if (!(bounds.lo <= 0 && bounds.hi >= 0))
+    return;
+
+  if (c1 - c0 == 1 && r1 - r0 == 1)
+    {
+      if (changes_sign (s, x0, x1, y0, y1))
+	add_cell (s, x0, x1, y0, y1);
+      return;
+    }
+
+  /* Halve each side longer than a cell */
+  const unsigned short cm = c1 - c0 > 1 ? c0 + (c1 - c0) / 2 : c1;
+  const unsigned short rm = r1 - r0 > 1 ? r0 + (r1 - r0) / 2 : r1;
+
+  search (s, c0, cm, r0, rm);
+  if (cm < c1)
+    search (s, cm, c1, r0, rm);
+  if (rm < r1)
+    {
+      search (s, c0, cm, rm, r1);
+      if (cm < c1)
+	search (s, cm, c1, rm, r1);
+    }
+}
+
+point_t *
+sample_implicit (const expression_t exp, const plot_info_t plot,
+		 const double t, size_t *const npoints,
+		 size_t *const nevaluations)
+{
+  struct implicit_search s = {
+    .exp = exp,
+    .plot = plot,
+    .t = t,
+    .size = 64,
+  };
+  s.points = malloc (s.size * sizeof (*s.points));
+  if (!s.points)
+    return NULL;
+
+  /* The cells of the grid points are binned into, one row and column fewer
+   * than the plot for the axes */
+  if (plot.ncolumns > 2 && plot.nrows > 2)
+    search (&s, 0, plot.ncolumns - 1, 0, plot.nrows - 1);
+
+  if (s.failed)
+    {
+      free (s.points);
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  *npoints = s.npoints;
+  if (nevaluations)
+    *nevaluations = s.nevaluations;
+  return s.points;
+}
@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cplot.h"
+#include "ingest.h"
+
+#define BLOCK_POINTS 1024
+
+struct source
+{
+  const char *path;
+  const struct options *o;
+  pthread_t thread;
+  int error;
+
+  /* With every range given, blocks are binned as they are read and no
+   * points are kept; otherwise they are kept until the ranges are fitted. */
+  bool streaming;
+  plot_grid_t grid;
+  size_t nbinned;
+  size_t nmalformed;
+
+  point_t *points;
+  size_t npoints, size;
+  bool sketching;
+  sketch_t x, y;
+
+  /* A panel that does not share axes fits its own ranges and bins its points
+   * on its own thread as soon as they are read. */
+  bool own_ranges;
+  plot_info_t plot;
+};
+
+static int
+keep_points (struct source *const s, const point_t block[], const size_t n)
+{
+  if (s->npoints + n > s->size)
+    {
+      size_t size = s->size ? s->size : 4 * BLOCK_POINTS;
+      while (size < s->npoints + n)
+	size *= 2;
+
+      point_t *const points = realloc (s->points, size * sizeof (*points));
+      if (!points)
+	return -1;
+      s->points = points;
+      s->size = size;
+    }
+
+  memcpy (s->points + s->npoints, block, n * sizeof (*block));
+  s->npoints += n;
+
+  for (size_t i = 0; s->sketching && i < n; ++i)
+    if (sketch_add (&s->x, block[i].x) != 0
+	|| sketch_add (&s->y, block[i].y) != 0)
+      return -1;
+
+  return 0;
+}
+
+static int
+fit_ranges (struct options *const o, struct source sources[],
+	    const size_t nsources)
+{
+  if (o->auto_range)
+    {
+      for (size_t i = 1; i < nsources; ++i)
+	if (sketch_merge (&sources[0].x, &sources[i].x) != 0
+	    || sketch_merge (&sources[0].y, &sources[i].y) != 0)
+	  return -1;
+
+      options_fit_sketches (o, &sources[0].x, &sources[0].y);
+      return 0;
+    }
+
+  /* The corners of each source's extent fit the same ranges as all its points */
+  point_t corners[2 * OPTIONS_MAX_FILES];
+  size_t ncorners = 0;
+  for (size_t i = 0; i < nsources; ++i)
+    if (sources[i].npoints > 0)
+      {
+	const point_t *const points = sources[i].points;
+	const size_t npoints = sources[i].npoints;
+	corners[ncorners].x = find_x_min (points, npoints);
+	corners[ncorners++].y = find_y_min (points, npoints);
+	corners[ncorners].x = find_x_max (points, npoints);
+	corners[ncorners++].y = find_y_max (points, npoints);
+      }
+
+  options_fit_ranges (o, corners, ncorners);
+  return 0;
+}
+
+static void
+bin_own_ranges (struct source *const s)
+{
+  struct options fitted = *s->o;
+  if (fit_ranges (&fitted, s, 1) != 0)
+    {
+      s->error = errno;
+      return;
+    }
+
+  /* An unusable plot is rendered as the message saying why */
+  s->plot = fitted.plot;
+  if (plot_check_info (s->plot))
+    return;
+
+  if (plot_grid_init (&s->grid, s->plot) != 0)
+    s->error = errno;
+  else
+    s->nbinned = plot_grid_add (&s->grid, s->points, s->npoints);
+}
+
+static void *
+read_source (void *const arg)
+{
+  struct source *const s = arg;
+
+  /* Opening a FIFO blocks until its writer shows up, so it is done here too */
+  FILE *const in = fopen (s->path, "r");
+  if (!in)
+    {
+      s->error = errno;
+      return NULL;
+    }
+
+  csv_reader_t csv;
+  if (csv_reader_init (&csv, in, options_input_format (s->o)) != 0)
+    {
+      s->error = errno;
+      fclose (in);
+      return NULL;
+    }
+
+  point_t block[BLOCK_POINTS];
+  size_t n;
+  while ((n = csv_read_block (&csv, block, BLOCK_POINTS)) > 0)
+    {
+      if (s->streaming)
+	{
+	  s->nbinned += plot_grid_add (&s->grid, block, n);
+	  s->npoints += n;
+	}
+      else if (keep_points (s, block, n) != 0)
+	{
+	  s->error = errno;
+	  break;
+	}
+    }
+
+  s->nmalformed = csv.nmalformed;
+  csv_reader_destroy (&csv);
+  fclose (in);
+
+  if (!s->error && s->own_ranges)
+    bin_own_ranges (s);
+  return NULL;
+}
+
+int
+ingest_files (struct options *const o, FILE * const out, stats_t * const st)
+{
+  static const enum plot_color palette[] = {
+    LIGHT_RED, LIGHT_GREEN, YELLOW, LIGHT_BLUE, LIGHT_PURPLE, LIGHT_CYAN,
+    ORANGE, LIGHT_GRAY
+  };
+
+  const size_t nsources = o->nfiles;
+  const bool streaming = o->x_min_set && o->x_max_set
+    && o->y_min_set && o->y_max_set;
+  const bool panels = o->panel_rows > 0;
+
+  const char *const error = plot_check_info (o->plot);
+  if (error)
+    {
+      fputs (error, out);
+      return -1;
+    }
+
+  struct source sources[OPTIONS_MAX_FILES];
+  memset (sources, 0, sizeof sources);
+
+  int ret = 0;
+  size_t nstarted = 0;
+  for (; nstarted < nsources; ++nstarted)
+    {
+      struct source *const s = &sources[nstarted];
+      s->path = o->file_names[nstarted];
+      s->o = o;
+      s->streaming = streaming;
+      s->sketching = !streaming && o->auto_range;
+      s->own_ranges = !streaming && panels && !o->shared_axes;
+      s->plot = o->plot;
+
+      if ((streaming && plot_grid_init (&s->grid, o->plot) != 0)
+	  || (s->sketching && (sketch_init (&s->x, SKETCH_DEFAULT_K) != 0
+			       || sketch_init (&s->y, SKETCH_DEFAULT_K) != 0)))
+	{
+	  perror ("");
+	  ret = -1;
+	  break;
+	}
+
+      const int create_error =
+	pthread_create (&s->thread, NULL, read_source, s);
+      if (create_error)
+	{
+	  errno = create_error;
+	  perror ("");
+	  ret = -1;
+	  break;
+	}
+    }
+
+  for (size_t i = 0; i < nstarted; ++i)
+    pthread_join (sources[i].thread, NULL);
+  stats_end (st, STATS_READ);
+
+  for (size_t i = 0; i < nstarted; ++i)
+    if (sources[i].error)
+      {
+	fprintf (stderr, "%s: %s\n", sources[i].path,
+		 csv_strerror (&o->csv, sources[i].error));
+	ret = -1;
+      }
+    else if (sources[i].nmalformed > 0)
+      fprintf (stderr, "%s: skipped %zu malformed lines\n", sources[i].path,
+	       sources[i].nmalformed);
+
+  if (ret == 0 && !streaming && !sources[0].own_ranges)
+    {
+      if (fit_ranges (o, sources, nsources) != 0)
+	{
+	  perror ("");
+	  ret = -1;
+	}
+      stats_end (st, STATS_RANGE);
+
+      for (size_t i = 0; ret == 0 && i < nsources; ++i)
+	{
+	  struct source *const s = &sources[i];
+	  s->plot = o->plot;
+	  if (plot_grid_init (&s->grid, o->plot) != 0)
+	    {
+	      perror ("");
+	      ret = -1;
+	    }
+	  else
+	    s->nbinned = plot_grid_add (&s->grid, s->points, s->npoints);
+	}
+      stats_end (st, STATS_BIN);
+    }
+
+  if (ret == 0 && panels)
+    {
+      struct plot_panel grid[OPTIONS_MAX_FILES];
+      for (size_t i = 0; i < nsources; ++i)
+	{
+	  grid[i].plot = sources[i].plot;
+	  grid[i].grid = &sources[i].grid;
+	  grid[i].title = sources[i].path;
+	  if (st)
+	    {
+	      st->points_read += sources[i].npoints;
+	      st->points_dropped += sources[i].npoints - sources[i].nbinned;
+	    }
+	}
+
+      plot_write_panels (out, grid, nsources, o->panel_columns, o->nthreads,
+			 st);
+    }
+  else if (ret == 0)
+    {
+      struct plot_series series[PLOT_MAX_SERIES];
+      for (size_t i = 0; i < nsources; ++i)
+	{
+	  series[i].grid = &sources[i].grid;
+	  series[i].color = i == 0 ? o->plot.mark_color
+	    : palette[(i - 1) % (sizeof palette / sizeof palette[0])];
+	  series[i].name = sources[i].path;
+
+	  if (st)
+	    {
+	      st->points_read += sources[i].npoints;
+	      st->points_dropped += sources[i].npoints - sources[i].nbinned;
+	    }
+	}
+
+      plot_write_series (out, o->plot, series, nsources, st);
+    }
+
+  for (size_t i = 0; i < nsources; ++i)
+    {
+      plot_grid_destroy (&sources[i].grid);
+      free (sources[i].points);
+      if (sources[i].sketching)
+	{
+	  sketch_destroy (&sources[i].x);
+	  sketch_destroy (&sources[i].y);
+	}
+    }
+
+  return ret;
+}
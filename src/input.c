@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cplot.h"
+#include "input.h"
+
+#define SAMPLE_BLOCK 4096
+
+/* Keeps only a --sample of the points as they are read, so memory stays at the
+ * sample size however long the input runs. The sketches still see every
+ * point. */
+static point_t *
+sample_input (FILE * const in, const char *const name,
+	      const struct options *const o, size_t *const npoints,
+	      size_t *const nread, sketch_t * const x, sketch_t * const y)
+{
+  reservoir_t r;
+  csv_reader_t csv;
+  point_t *const block = malloc (SAMPLE_BLOCK * sizeof (*block));
+  if (!block || reservoir_init (&r, o->sample, o->seed) != 0)
+    {
+      free (block);
+      return NULL;
+    }
+  if (csv_reader_init (&csv, in, options_input_format (o)) != 0)
+    {
+      reservoir_destroy (&r);
+      free (block);
+      return NULL;
+    }
+
+  size_t n;
+  while ((n = csv_read_block (&csv, block, SAMPLE_BLOCK)) > 0)
+    {
+      reservoir_add (&r, block, n);
+      for (size_t i = 0; x && i < n; ++i)
+	if (sketch_add (x, block[i].x) != 0
+	    || sketch_add (y, block[i].y) != 0)
+	  break;
+    }
+
+  if (csv.nmalformed > 0)
+    fprintf (stderr, "%s: skipped %zu malformed lines\n", name,
+	     csv.nmalformed);
+  csv_reader_destroy (&csv);
+
+  *nread = r.seen;
+  point_t *const points = reservoir_take (&r, npoints);
+  reservoir_destroy (&r);
+  free (block);
+  return points;
+}
+
+/* Reads "x y" pairs, or the selected fields of delimited text, sketching the
+ * values as they are read if x is given. */
+static point_t *
+read_all_input (FILE * const in, const char *const name,
+		const struct options *const o, size_t *const npoints,
+		sketch_t * const x, sketch_t * const y)
+{
+  size_t nmalformed;
+  point_t *const points =
+    csv_read_points (in, options_input_format (o), npoints, &nmalformed);
+  if (points && nmalformed > 0)
+    fprintf (stderr, "%s: skipped %zu malformed lines\n", name, nmalformed);
+
+  for (size_t i = 0; points && x && i < *npoints; ++i)
+    if (sketch_add (x, points[i].x) != 0 || sketch_add (y, points[i].y) != 0)
+      break;
+
+  return points;
+}
+
+point_t *
+read_input (FILE * const in, const char *const name,
+	    const struct options *const o, size_t *const npoints,
+	    size_t *const nread, sketch_t * const x, sketch_t * const y)
+{
+  if (o->sample > 0)
+    return sample_input (in, name, o, npoints, nread, x, y);
+
+  point_t *const points = read_all_input (in, name, o, npoints, x, y);
+  *nread = points ? *npoints : 0;
+  return points;
+}
@@ -1,531 +1,621 @@
 #include <stdio.h>
-#include <getopt.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
-#include "plotter.h"
-#include "parser.h"
+#include <limits.h>
+#include <errno.h>
+#include "cplot.h"
+#include "options.h"
+#include "serve.h"
+#include "batch.h"
+#include "animate.h"
+#include "ingest.h"
+#include "explore.h"
+#include "distribution.h"
+#include "input.h"
+
+/* Column names are only known once the input is read, but the syntax can be
+ * checked up front */
+static void
+check_column_expression (const char *const s, const char *const option)
+{
+  if (!s)
+    return;
 
-#define NELEMS(arr) (sizeof(arr)/sizeof(arr[0]))
+  const expression_t exp = parse_column_expression (s, strlen (s));
+  const bool ok = check_parser_errors (exp);
+  expression_destroy (exp);
+  if (!ok)
+    {
+      fprintf (stderr, "Could not parse %s\n", option);
+      exit (EXIT_FAILURE);
+    }
+}
 
-enum command_line_options
+/* Plots the grid an earlier run saved beside the file, if it still holds for
+ * the file and the canvas */
+static bool
+plot_from_sidecar (struct options *const o, const char *const path,
+		   const struct sidecar_identity *const identity,
+		   const char *const key, FILE * const out, stats_t * const st)
 {
-  file, expression, x_min, x_max, y_min, y_max, x_ticks, y_ticks,
-  x_number_color, y_number_color, axes_color, mark_color, rows, columns,
-  x_number_width, y_number_width, x_precision, y_precision, mark_char, help
-};
-
-enum plot_color process_color (const char *const color);
-point_t *read_points (FILE * const in, size_t * npoints);
-double evaluate_expression (const expression_t exp, const double x);
-bool check_parser_errors (const expression_t exp);
-bool check_variables (const expression_t exp);
-
-double find_x_min (const point_t * const points, const size_t npoints);
-double find_x_max (const point_t * const points, const size_t npoints);
-double find_y_min (const point_t * const points, const size_t npoints);
-double find_y_max (const point_t * const points, const size_t npoints);
+  plot_info_t *const p = &o->plot;
+  sidecar_t sidecar;
+  if (!sidecar_load (path, identity, key, p->nrows - 1, p->ncolumns - 1,
+		     &sidecar))
+    return false;
+  stats_end (st, STATS_READ);
+
+  p->x_min = sidecar.x_min;
+  p->x_max = sidecar.x_max;
+  p->y_min = sidecar.y_min;
+  p->y_max = sidecar.y_max;
+
+  plot_grid_t grid;
+  if (plot_check_info (*p) || plot_grid_init (&grid, *p) != 0)
+    {
+      sidecar_release (&sidecar);
+      return false;
+    }
+
+  memcpy (grid.cells, sidecar.cells,
+	  (size_t) grid.nrows * grid.ncolumns * sizeof (*grid.cells));
+  if (st)
+    {
+      st->points_read = sidecar.npoints;
+      st->points_dropped = sidecar.npoints - sidecar.nbinned;
+    }
+  sidecar_release (&sidecar);
+  stats_end (st, STATS_BIN);
+
+  const struct plot_series series = {.grid = &grid,.color = p->mark_color };
+  plot_write_series (out, *p, &series, 1, st);
+  plot_grid_destroy (&grid);
+  return true;
+}
+
+/* As plot_stats, saving the grid beside the file for later runs */
+static void
+plot_to_sidecar (const struct options *const o, const char *const path,
+		 const struct sidecar_identity *const identity,
+		 const char *const key, const point_t points[],
+		 const size_t npoints, const size_t nread, FILE * const out,
+		 stats_t * const st)
+{
+  const plot_info_t p = o->plot;
+  const char *const error = plot_check_info (p);
+  if (error)
+    {
+      fputs (error, out);
+      return;
+    }
+
+  plot_grid_t grid;
+  if (plot_grid_init (&grid, p) != 0)
+    {
+      fputs ("Error: out of memory.\n", out);
+      return;
+    }
+
+  const size_t nbinned = plot_grid_add (&grid, points, npoints);
+  if (st)
+    st->points_dropped += npoints - nbinned;
+  stats_end (st, STATS_BIN);
+
+  /* so that a later run reports the same points read and dropped */
+  if (sidecar_store (path, o->file_name, identity, key, p, &grid, nread,
+		     nread - (npoints - nbinned)) != 0)
+    perror ("Could not write sidecar");
+  stats_end (st, STATS_WRITE);
+
+  const struct plot_series series = {.grid = &grid,.color = p.mark_color };
+  plot_write_series (out, p, &series, 1, st);
+  plot_grid_destroy (&grid);
+}
+
+/* Expressions are drawn as a line through their samples, and so is data
+ * with --lines; other data, and the cells of implicit curves, as dots. */
+static int
+write_image (const struct options *const o, const point_t points[],
+	     const size_t npoints, stats_t * const st)
+{
+  raster_t image;
+  if (raster_init (&image, o->image_width, o->image_height) != 0)
+    {
+      perror ("");
+      return -1;
+    }
+
+  if (plot_raster (&image, o->plot, points, npoints,
+		   o->plot.lines || (o->source == INPUT_EXPRESSION
+				     && !o->implicit),
+		   o->nthreads) != 0)
+    {
+      perror (o->image);
+      raster_destroy (&image);
+      return -1;
+    }
+  stats_end (st, STATS_RENDER);
+
+  const size_t len = strlen (o->image);
+  const bool ppm = len >= 4 && strcmp (o->image + len - 4, ".ppm") == 0;
+
+  int ret = -1;
+  FILE *const file = fopen (o->image, "wb");
+  if (file)
+    {
+      ret = ppm ? raster_write_ppm (&image, file)
+	: raster_write_png (&image, file);
+      if (fclose (file) != 0)
+	ret = -1;
+    }
+  if (ret != 0)
+    perror (o->image);
+  stats_end (st, STATS_WRITE);
+
+  raster_destroy (&image);
+  return ret;
+}
 
 int
 main (int argc, char *argv[])
 {
-  static const struct option long_options[] = {
-    {"file", required_argument, NULL, file},
-    {"expression", required_argument, NULL, expression},
-    {"x-min", required_argument, NULL, x_min},
-    {"x-max", required_argument, NULL, x_max},
-    {"y-min", required_argument, NULL, y_min},
-    {"y-max", required_argument, NULL, y_max},
-    {"x-ticks", required_argument, NULL, x_ticks},
-    {"y-ticks", required_argument, NULL, y_ticks},
-    {"x-number-color", required_argument, NULL, x_number_color},
-    {"y-number-color", required_argument, NULL, y_number_color},
-    {"axes-color", required_argument, NULL, axes_color},
-    {"mark-color", required_argument, NULL, mark_color},
-    {"rows", required_argument, NULL, rows},
-    {"columns", required_argument, NULL, columns},
-    {"x-number-width", required_argument, NULL, x_number_width},
-    {"y-number-width", required_argument, NULL, y_number_width},
-    {"x-precision", required_argument, NULL, x_precision},
-    {"y-precision", required_argument, NULL, y_precision},
-    {"mark-char", required_argument, NULL, mark_char},
-    {"help", no_argument, NULL, help},
-    {0, 0, 0, 0}
+  /* In parts, each within the length compilers must take */
+  static const char *const help_message[] = {
+    "--file, --file=\t\t\t\tread and plot points from a file; repeat to plot several files concurrently.\n"
+    "--expression, --expression=\t\tgenerate points from given expression.\n"
+    "--x-min, --x-min=\t\t\tspecify minimum x-value.\n"
+    "--x-max, --x-max=\t\t\tspecify maximum x-value.\n"
+    "--y-min, --y-min=\t\t\tspecify minimum y-value.\n"
+    "--y-max, --y-max=\t\t\tspecify maximum y-value\n"
+    "--x-ticks, --x-ticks=\t\t\tspecify number of x-axis ticks.\n"
+    "--y-ticks, --y-ticks=\t\t\tspecify number of y-axis ticks.\n"
+    "--x-number-color, --x-number-color=\tspecify color used to print tick labels on x-axis.\n"
+    "--y-number-color, --y-number-color=\tspecify color used to print tick labels on y-axis.\n"
+    "--axes-color, --axes-color=\t\tspecify color used to print axes.\n"
+    "--mark-color, --mark-color=\t\tspecify color used to print marks on plot.\n"
+    "--rows, --rows=\t\t\t\tspecify number of rows y-axis uses.\n"
+    "--columns, --columns=\t\t\tspecify number of columns x-axis uses.\n"
+    "--x-number-width, --x-number-width=\tspecify width of tick labels on x-axis.\n"
+    "--y-number-width, --y-number-width=\tspecify width of tick labels on y-axis.\n"
+    "--x-precision, --x-precision=\t\tspecify number of decimal points to use when printing x-axis tick labels.\n"
+    "--y-precision, --y-precision=\t\tspecify number of decimal points to use when printing y-axis tick labels.\n"
+    "--mark-char, --mark-char=\t\tspecify marker character to use on plot.\n"
+    "--cache-dir, --cache-dir=\t\tcache sampled expressions in the given directory.\n"
+    "--cache-max-size, --cache-max-size=\tspecify cache size limit in bytes (k, M and G suffixes allowed).\n"
+    "--cache-stats\t\t\t\tprint cache hit and miss counts to standard error.\n"
+    "--serve, --serve=\t\t\tserve plot requests on the given Unix socket.\n"
+    "--threads, --threads=\t\t\tspecify number of worker threads.\n"
+    "--batch, --batch=\t\t\trender every job listed in a manifest file.\n"
+    "--output, --output=\t\t\twrite the plot to a file instead of standard output.\n"
+    "--stats\t\t\t\t\tprint per-phase timings and counters to standard error.\n"
+    "--t-min, --t-min=\t\t\tspecify the value of t an animation starts from.\n"
+    "--t-max, --t-max=\t\t\tanimate the expression until t reaches this value.\n"
+    "--fps, --fps=\t\t\t\tspecify the frame rate of an animation.\n"
+    "--auto-range, --auto-range=\t\tfit unset axes to percentiles of the data, e.g. p1,p99.\n"
+    "--delimiter, --delimiter=\t\tread delimited text split on this character (\\t or tab for TSV, ' ' for runs of blanks).\n"
+    "--x-col, --x-col=\t\t\tspecify the column of delimited text holding x-values (default 1).\n"
+    "--y-col, --y-col=\t\t\tspecify the column of delimited text holding y-values (default 2).\n"
+    "--skip-header\t\t\t\tskip the first line of delimited text.\n",
+    "--x-expr, --x-expr=\t\t\tcompute x from the columns of delimited text, e.g. ln(c2)/c3.\n"
+    "--y-expr, --y-expr=\t\t\tcompute y from the columns of delimited text, named c1, c2... or as in the header.\n"
+    "--image, --image=\t\t\tdraw the plot to a PNG file, or PPM if the name ends in .ppm.\n"
+    "--image-size, --image-size=\t\tspecify the image size in pixels (default 1600x800).\n"
+    "--lines\t\t\t\t\tconnect consecutive points with lines.\n"
+    "--math, --math=\t\t\t\tevaluate expressions with fast or precise math functions (default precise).\n"
+    "--implicit\t\t\t\tplot where the expression, a function of x and y, is 0.\n"
+    "--sample, --sample=\t\t\tplot a uniform random sample of this many of the points read.\n"
+    "--seed, --seed=\t\t\t\tseed the random sample (default 1).\n"
+    "--x-time, --x-time=\t\t\tread x as ISO-8601 times or epoch seconds (iso, s) or milliseconds (ms).\n"
+    "--panels, --panels=\t\t\tplot each file in its own panel of a grid, e.g. 4x6.\n"
+    "--shared-axes\t\t\t\tgive every panel the same ranges.\n"
+    "--histogram\t\t\t\tplot the distribution of the values in --x-col, one per line by default.\n"
+    "--bin-width, --bin-width=\t\tspecify the width of histogram bins (default one per column).\n"
+    "--log-bins\t\t\t\tuse histogram bins of equal width in log scale; --bin-width is then in decades.\n"
+    "--interactive\t\t\t\tzoom and pan the plot with the arrow keys.\n"
+    "--sidecar\t\t\t\tsave the binned plot beside the file, and reuse it while the file is unchanged.\n"
+    "--help\t\t\t\t\tprint this message.\n\n\n"
+    "The following colors may be passed to arguments requiring colors:\n"
+    "black red green orange blue purple cyan ligh-gray dark-gray light-red light-green yellow light-blue light-purple "
+    "light-cyan white no-color\n\n"
+    "By default, if neither --file or --expression is specified, points are read from standard input."
   };
 
-  bool read_from_stdin = true;
-  bool read_from_file = false;
-  char *file_name = NULL;
-  bool from_expression = false;
-  char *source_expression = NULL;
-  bool x_min_set = false, x_max_set = false;
-  bool y_min_set = false, y_max_set = false;
-
-  plot_info_t p;
-
-  p.x_min = -10;
-  p.x_max = 10;
-  p.y_min = -10;
-  p.y_max = 10;
-  p.nxticks = 6;
-  p.nyticks = 6;
-  p.x_number_color = RED;
-  p.y_number_color = BLUE;
-  p.axes_color = GREEN;
-  p.mark_color = WHITE;
-  p.mark_char = '+';
-  p.nrows = 22;
-  p.ncolumns = 42;
-  p.x_number_width = 8;
-  p.y_number_width = 8;
-  p.x_precision = 3;
-  p.y_precision = 3;
-
-  for (;;)
-    {
-      int option_index = 0;
-
-      int c = getopt_long (argc, argv, "", long_options, &option_index);
-      if (c == -1)
-	break;
-
-      switch (c)
+
+  struct options o;
+  char error[256];
+
+  options_init (&o);
+  if (options_parse (&o, argc - 1, argv + 1, error, sizeof error) != 0)
+    {
+      fprintf (stderr, "%s: %s\n", argv[0], error);
+      exit (EXIT_FAILURE);
+    }
+
+  if (o.help)
+    {
+      for (size_t i = 0; i < sizeof help_message / sizeof *help_message; ++i)
+	fputs (help_message[i], stdout);
+      putchar ('\n');
+      exit (EXIT_SUCCESS);
+    }
+
+  if (o.serve_path)
+    exit (serve (o.serve_path, o.nthreads) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  else if (o.batch_manifest)
+    exit (batch (o.batch_manifest, o.nthreads) ==
+	  0 ? EXIT_SUCCESS : EXIT_FAILURE);
+
+  /* Batch jobs and requests already have a thread each; a single plot may
+   * render large canvases on all of them */
+  o.plot.nthreads = o.nthreads;
+
+  FILE *const out = o.output ? fopen (o.output, "w") : stdout;
+  if (!out)
+    {
+      perror (o.output);
+      exit (EXIT_FAILURE);
+    }
+
+  if (o.implicit && o.source != INPUT_EXPRESSION)
+    {
+      fprintf (stderr, "%s: --implicit requires --expression\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if (o.interactive && (o.image || o.t_max_set || o.nfiles > 1
+			|| o.panel_rows > 0 || o.sidecar))
+    {
+      fprintf (stderr, "%s: --interactive shows a single input on the "
+	       "terminal\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if (o.t_max_set)
+    {
+      if (o.implicit)
 	{
-	case file:
-	  read_from_stdin = false;
-	  from_expression = false;
-	  read_from_file = true;
-	  file_name = optarg;
-	  break;
-	case expression:
-	  read_from_stdin = false;
-	  read_from_file = false;
-	  from_expression = true;
-	  source_expression = optarg;
-	  break;
-	case x_min:
-	  sscanf (optarg, "%lf", &p.x_min);
-	  x_min_set = true;
-	  break;
-	case x_max:
-	  sscanf (optarg, "%lf", &p.x_max);
-	  x_max_set = true;
-	  break;
-	case y_min:
-	  sscanf (optarg, "%lf", &p.y_min);
-	  y_min_set = true;
-	  break;
-	case y_max:
-	  sscanf (optarg, "%lf", &p.y_max);
-	  y_max_set = true;
-	  break;
-	case x_ticks:
-	  sscanf (optarg, "%hu", &p.nxticks);
-	  break;
-	case y_ticks:
-	  sscanf (optarg, "%hu", &p.nyticks);
-	  break;
-	case x_number_color:
-	  fflush (stdout);
-	  p.x_number_color = process_color (optarg);
-	  break;
-	case y_number_color:
-	  p.y_number_color = process_color (optarg);
-	  break;
-	case axes_color:
-	  p.axes_color = process_color (optarg);
-	  break;
-	case mark_color:
-	  p.mark_color = process_color (optarg);
-	  break;
-	case rows:
-	  sscanf (optarg, "%hu", &p.nrows);
-	  break;
-	case columns:
-	  sscanf (optarg, "%hu", &p.ncolumns);
-	  break;
-	case x_number_width:
-	  sscanf (optarg, "%hu", &p.x_number_width);
-	  break;
-	case y_number_width:
-	  sscanf (optarg, "%hu", &p.y_number_width);
-	  break;
-	case x_precision:
-	  sscanf (optarg, "%hu", &p.x_precision);
-	  break;
-	case y_precision:
-	  sscanf (optarg, "%hu", &p.y_precision);
-	  break;
-	case mark_char:
-	  p.mark_char = optarg[0];
-	  break;
-	case help:
-	  {
-	    static const char *const help_message =
-	      "--file, --file=\t\t\t\tread and plot points from a file.\n"
-	      "--expression, --expression=\t\tgenerate points from given expression.\n"
-	      "--x-min, --x-min=\t\t\tspecify minimum x-value.\n"
-	      "--x-max, --x-max=\t\t\tspecify maximum x-value.\n"
-	      "--y-min, --y-min=\t\t\tspecify minimum y-value.\n"
-	      "--y-max, --y-max=\t\t\tspecify maximum y-value\n"
-	      "--x-ticks, --x-ticks=\t\t\tspecify number of x-axis ticks.\n"
-	      "--y-ticks, --y-ticks=\t\t\tspecify number of y-axis ticks.\n"
-	      "--x-number-color, --x-number-color=\tspecify color used to print tick labels on x-axis.\n"
-	      "--y-number-color, --y-number-color=\tspecify color used to print tick labels on y-axis.\n"
-	      "--axes-color, --axes-color=\t\tspecify color used to print axes.\n"
-	      "--mark-color, --mark-color=\t\tspecify color used to print marks on plot.\n"
-	      "--rows, --rows=\t\t\t\tspecify number of rows y-axis uses.\n"
-	      "--columns, --columns=\t\t\tspecify number of columns x-axis uses.\n"
-	      "--x-number-width, --x-number-width=\tspecify width of tick labels on x-axis.\n"
-	      "--y-number-width, --y-number-width=\tspecify width of tick labels on y-axis.\n"
-	      "--x-precision, --x-precision=\t\tspecify number of decimal points to use when printing x-axis tick labels.\n"
-	      "--y-precision, --y-precision=\t\tspecify number of decimal points to use when printing y-axis tick labels.\n"
-	      "--mark-char, --mark-char=\t\tspecify marker character to use on plot.\n"
-	      "--help\t\t\t\t\tprint this message.\n\n\n"
-	      "The following colors may be passed to arguments requiring colors:\n"
-	      "black red green orange blue purple cyan ligh-gray dark-gray light-red light-green yellow light-blue light-purple "
-	      "light-cyan white no-color\n\n"
-	      "By default, if neither --file or --expression is specified, points are read from standard input.";
-
-
-
-	    puts (help_message);
-	    exit (EXIT_SUCCESS);
-	    break;
-	  }
+	  fprintf (stderr, "%s: --implicit curves cannot be animated\n",
+		   argv[0]);
+	  exit (EXIT_FAILURE);
+	}
+
+      if (o.source != INPUT_EXPRESSION)
+	{
+	  fprintf (stderr, "%s: --t-max requires --expression\n", argv[0]);
+	  exit (EXIT_FAILURE);
 	}
+
+      const int ret = animate (&o, out);
+      if (out != stdout)
+	fclose (out);
+      exit (ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
     }
 
-  size_t npoints;
-  point_t *points = NULL;
-  if (read_from_stdin)
+  stats_t stats;
+  stats_t *const st = o.stats ? &stats : NULL;
+  stats_init (st);
+
+  if (o.sample > 0 && (o.nfiles > 1 || o.source == INPUT_EXPRESSION))
     {
-      npoints = 0;
-      points = read_points (stdin, &npoints);
-      if (!points)
+      fprintf (stderr, "%s: --sample takes standard input or a single --file\n",
+	       argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if ((o.nfiles > 1 || o.panel_rows > 0) && o.image)
+    {
+      fprintf (stderr, "%s: --image takes a single input\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if (o.panel_rows > 0 && (o.source != INPUT_FILE
+			   || o.nfiles > o.panel_rows * o.panel_columns))
+    {
+      fprintf (stderr, "%s: --panels takes up to one --file per panel\n",
+	       argv[0]);
+      exit (EXIT_FAILURE);
+    }
+  else if (o.panel_rows == 0 && o.nfiles > PLOT_MAX_SERIES)
+    {
+      fprintf (stderr, "%s: --file may be given up to %d times without "
+	       "--panels\n", argv[0], PLOT_MAX_SERIES);
+      exit (EXIT_FAILURE);
+    }
+
+  if (o.sidecar
+      && (o.source != INPUT_FILE || o.nfiles > 1 || o.image))
+    {
+      fprintf (stderr, "%s: --sidecar takes a single --file and no --image\n",
+	       argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if (o.histogram && (o.source == INPUT_EXPRESSION || o.nfiles > 1
+		      || o.panel_rows > 0 || o.image || o.sample > 0
+		      || o.sidecar || o.interactive))
+    {
+      fprintf (stderr, "%s: --histogram takes standard input or a single "
+	       "--file and draws on the terminal\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if ((o.csv.x_expr || o.csv.y_expr) && o.source == INPUT_EXPRESSION)
+    {
+      fprintf (stderr, "%s: --x-expr and --y-expr take standard input or "
+	       "--file\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+  check_column_expression (o.csv.x_expr, "--x-expr");
+  check_column_expression (o.csv.y_expr, "--y-expr");
+
+  if (o.histogram || o.nfiles > 1 || o.panel_rows > 0)
+    {
+      const int ret = o.histogram ? plot_distribution (&o, out, st)
+	: ingest_files (&o, out, st);
+      if (out != stdout && fclose (out) != 0)
 	{
-	  perror ("");
+	  perror (o.output);
 	  exit (EXIT_FAILURE);
 	}
+      stats_report (st, stderr);
+      stats_destroy (st);
+      exit (ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
 
+  /* A grid saved beside the file by an earlier run replaces reading it */
+  char *sidecar = NULL, sidecar_key[512];
+  struct sidecar_identity identity;
+  if (o.sidecar && sidecar_identify (o.file_name, &identity) == 0
+      && (sidecar = sidecar_path (o.file_name)))
+    {
+      options_sidecar_key (&o, sidecar_key, sizeof sidecar_key);
+      if (plot_from_sidecar (&o, sidecar, &identity, sidecar_key, out, st))
+	{
+	  free (sidecar);
+	  if (out != stdout && fclose (out) != 0)
+	    {
+	      perror (o.output);
+	      exit (EXIT_FAILURE);
+	    }
+	  stats_report (st, stderr);
+	  stats_destroy (st);
+	  exit (EXIT_SUCCESS);
+	}
     }
-  else if (read_from_file)
+
+  plot_info_t *const p = &o.plot;
+  size_t npoints, nread = 0;
+  point_t *points = NULL;
+  cache_entry_t cached = {.map = NULL };
+  expression_t exp;
+  bool parsed = false;
+  struct expression_range range;
+  bool ranged = false;		/* range was found before, as for the cache */
+
+  /* --auto-range quantiles are sketched while the points are read */
+  sketch_t x_sketch, y_sketch;
+  bool sketched = false;
+  if (o.auto_range && o.source != INPUT_EXPRESSION)
     {
-      FILE *const file = fopen (file_name, "r");
-      if (!file)
+      if (sketch_init (&x_sketch, SKETCH_DEFAULT_K) != 0
+	  || sketch_init (&y_sketch, SKETCH_DEFAULT_K) != 0)
 	{
 	  perror ("");
 	  exit (EXIT_FAILURE);
 	}
+      sketched = true;
+    }
 
+  if (o.source == INPUT_STDIN)
+    {
       npoints = 0;
-      points = read_points (file, &npoints);
+      points = read_input (stdin, "stdin", &o, &npoints, &nread,
+			   sketched ? &x_sketch : NULL, &y_sketch);
       if (!points)
 	{
-	  fclose (file);
-	  perror ("");
+	  fprintf (stderr, "stdin: %s\n", csv_strerror (&o.csv, errno));
 	  exit (EXIT_FAILURE);
 	}
-
-      fclose (file);
+      stats_end (st, STATS_READ);
     }
-  else if (from_expression)
+  else if (o.source == INPUT_FILE)
     {
-      FILE *const file =
-	fmemopen (source_expression, strlen (source_expression), "r");
+      FILE *const file = fopen (o.file_name, "r");
       if (!file)
 	{
 	  perror ("");
 	  exit (EXIT_FAILURE);
 	}
 
-      const expression_t exp = next_expression (file);
-      if (!check_parser_errors (exp))
-	{
-	  fputs ("Could not parse expression", stderr);
-	  fclose (file);
-	  expression_destroy (exp);
-	  exit (EXIT_FAILURE);
-	}
-      else if (!check_variables (exp))
+      npoints = 0;
+      points = read_input (file, o.file_name, &o, &npoints, &nread,
+			   sketched ? &x_sketch : NULL, &y_sketch);
+      if (!points)
 	{
-	  fputs ("Unknown variable in expression", stderr);
+	  fprintf (stderr, "%s: %s\n", o.file_name,
+		   csv_strerror (&o.csv, errno));
 	  fclose (file);
-	  expression_destroy (exp);
 	  exit (EXIT_FAILURE);
 	}
 
-      npoints = 50 * p.ncolumns;
-      points = malloc (npoints * sizeof (*points));
-      if (!points)
+      fclose (file);
+      stats_end (st, STATS_READ);
+    }
+  else if (o.source == INPUT_EXPRESSION)
+    {
+      o.x_min_set = true;
+      o.x_max_set = true;
+
+      /* A hit holds the y-range along with the samples, so the expression
+       * need not even be parsed */
+      char *key = NULL;
+      if (o.cache.dir && !o.implicit)
 	{
-	  perror ("");
-	  fclose (file);
+	  key = cache_make_key (o.expression, p->x_min, p->x_max,
+				p->ncolumns, samples_per_column (*p), o.math);
+	  if (key && cache_lookup (&o.cache, key, &cached))
+	    {
+	      points = cached.points;
+	      npoints = cached.npoints;
+	      range = cached.range;
+	      ranged = cached.ranged;
+	      free (key);
+	      key = NULL;
+	    }
+	  stats_end (st, STATS_READ);
 	}
 
-      x_min_set = true;
-      x_max_set = true;
-      for (size_t i = 0; i < npoints; ++i)
+      if (!points || (!ranged && options_wants_expression_range (&o)))
 	{
-	  points[i].x = i * (p.x_max - p.x_min) / npoints + p.x_min;
-	  points[i].y = evaluate_expression (exp, points[i].x);
+	  exp = parse_expression (o.expression, strlen (o.expression));
+	  parsed = true;
+	  if (!check_parser_errors (exp))
+	    {
+	      fputs ("Could not parse expression", stderr);
+	      expression_destroy (exp);
+	      exit (EXIT_FAILURE);
+	    }
+	  else if (!(o.implicit ? check_implicit_variables (exp)
+		     : check_variables (exp)))
+	    {
+	      fputs ("Unknown variable in expression", stderr);
+	      expression_destroy (exp);
+	      exit (EXIT_FAILURE);
+	    }
+	  stats_end (st, STATS_PARSE);
 	}
 
-      expression_destroy (exp);
-      fclose (file);
-    }
-
-  if (!x_min_set)
-    p.x_min = find_x_min (points, npoints);
-  if (!x_max_set)
-    p.x_max = find_x_max (points, npoints);
-  if (!y_min_set)
-    p.y_min = find_y_min (points, npoints);
-  if (!y_max_set)
-    p.y_max = find_y_max (points, npoints);
-
-  plot (stdout, p, points, npoints);
-  free (points);
-
-  exit (EXIT_SUCCESS);
-}
-
-enum plot_color
-process_color (const char *const color)
-{
-  const char *colors_text[] = {
-    "black", "red", "green", "orange", "blue", "purple", "cyan", "light-gray",
-    "dark-gray", "light-red",
-    "light-green", "yellow", "light-blue", "light-purple", "light-cyan",
-    "white", "no-color"
-  };
+      /* The points are the cells the curve crosses, in no particular order */
+      if (o.implicit)
+	{
+	  o.y_min_set = true;
+	  o.y_max_set = true;
+	  p->lines = false;
+
+	  /* Images resolve the curve to about two pixels rather than to the
+	   * terminal's cells */
+	  plot_info_t cells = *p;
+	  if (o.image)
+	    {
+	      cells.ncolumns = o.image_width / 2 < USHRT_MAX
+		? o.image_width / 2 : USHRT_MAX;
+	      cells.nrows = o.image_height / 2 < USHRT_MAX
+		? o.image_height / 2 : USHRT_MAX;
+	    }
 
-  enum plot_color colors[] =
-  {
-    BLACK, RED, GREEN, ORANGE, BLUE, PURPLE, CYAN, LIGHT_GRAY, DARK_GRAY,
-    LIGHT_RED,
-    LIGHT_GREEN, YELLOW, LIGHT_BLUE, LIGHT_PURPLE, LIGHT_CYAN, WHITE, NO_COLOR
-  };
+	  points = sample_implicit (exp, cells, 0, &npoints, NULL);
+	  expression_destroy (exp);
+	  parsed = false;
+	  if (!points)
+	    {
+	      perror ("");
+	      exit (EXIT_FAILURE);
+	    }
+	  stats_end (st, STATS_EVALUATE);
+	}
 
-  for (size_t i = 0; i < NELEMS (colors_text); ++i)
-    if (strcmp (colors_text[i], color) == 0)
-      return colors[i];
+      if (!points)
+	{
+	  npoints = samples_per_column (*p) * p->ncolumns;
+	  points = malloc (npoints * sizeof (*points));
+	  if (!points)
+	    {
+	      perror ("");
+	      expression_destroy (exp);
+	      exit (EXIT_FAILURE);
+	    }
 
-  return NO_COLOR;
-}
+	  sample_expression_math (exp, p->x_min, p->x_max, 0, o.math, points,
+				  npoints);
+	  stats_end (st, STATS_EVALUATE);
 
-point_t *
-read_points (FILE * const in, size_t * npoints)
-{
-  size_t size = 8;
-  size_t index = 0;
-  point_t *points = malloc (size * sizeof (*points));
-  if (!points)
-    return NULL;
-
-  point_t p;
-  while (fscanf (in, "%lf %lf", &p.x, &p.y) == 2)
-    {
-      if (index == size)
-	{
-	  size *= 2;
-	  point_t *const buf = realloc (points, size * sizeof (*points));
-	  if (!buf)
+	  /* Entries keep the range whether or not this run wants it */
+	  if (key)
 	    {
-	      *npoints = index;
-	      return points;
+	      find_expression_range (exp, p->x_min, last_sample_x (*p), 0,
+				     &range);
+	      ranged = true;
+	      if (cache_store (&o.cache, key, points, npoints, &range) != 0)
+		perror ("Could not write cache entry");
+	      stats_end (st, STATS_WRITE);
 	    }
-	  points = buf;
 	}
-      points[index++] = p;
-    }
-
-  *npoints = index;
-  return points;
-}
 
-bool
-check_parser_errors (const expression_t expression)
-{
-  switch (expression.type)
-    {
-    case EXPRESSION_FUNCTION:
-      return check_parser_errors (expression.operands[0]);
-    case EXPRESSION_OPERATOR:
-      {
-	bool ret = check_parser_errors (expression.operands[0]);
-	if (expression.operator != 'N')
-	  {
-	    ret &= check_parser_errors (expression.operands[1]);
-	  }
-	return ret;
-      }
-    case EXPRESSION_NUMBER:
-      return true;
-    case EXPRESSION_ERROR:
-      return false;
-    case EXPRESSION_VARIABLE:
-      return true;
+      free (key);
     }
 
-  return false;
-}
+  if (st)
+    st->points_read = o.source == INPUT_EXPRESSION ? npoints : nread;
 
-bool
-check_variables (const expression_t expression)
-{
-  switch (expression.type)
-    {
-    case EXPRESSION_FUNCTION:
-      return check_variables (expression.operands[0]);
-    case EXPRESSION_OPERATOR:
-      {
-	bool ret = check_variables (expression.operands[0]);
-	if (expression.operator != 'N')
-	  {
-	    ret &= check_variables (expression.operands[1]);
-	  }
-	return ret;
-      }
-    case EXPRESSION_NUMBER:
-      return true;
-    case EXPRESSION_ERROR:
-      return false;
-    case EXPRESSION_VARIABLE:
-      return strcmp (expression.s, "x") == 0;
+  if (parsed || ranged)
+    {
+      bool report = true;
+      if (ranged)
+	report = options_fit_found_range (&o, &range);
+      else
+	options_fit_expression (&o, exp, 0, &range);
+      if (parsed)
+	expression_destroy (exp);
+
+      for (size_t i = 0; report && i < range.nsingularities
+	   && i < EXPRESSION_MAX_SINGULARITIES; ++i)
+	fprintf (stderr, "%s: pole near x=%g\n", o.expression,
+		 range.singularities[i]);
     }
 
-  return false;
-}
-
-double
-dummy (double d)
-{
-  d = 0;
-  return d;
-}
-
-typedef double (*mfptr) (double);
-
-mfptr
-get_trig_function (const char *const name)
-{
-  static const char *function_names[] = {
-    "sin", "tan", "cos", "arcsin", "arctan", "arccos", "ln"
-  };
-  static const mfptr trig_functions[] = {
-    sin, tan, cos, asin, atan, acos, log
-  };
-
-  for (size_t i = 0; i < NELEMS (function_names); ++i)
-    if (strcmp (name, function_names[i]) == 0)
-      return trig_functions[i];
-
-  return dummy;
-}
-
-double
-evaluate_expression (const expression_t exp, const double x)
-{
-  switch (exp.type)
-    {
-    case EXPRESSION_FUNCTION:
-      return
-	get_trig_function (exp.s) (evaluate_expression (exp.operands[0], x));
-      break;
-    case EXPRESSION_OPERATOR:
-      switch (exp.operator)
-	{
-	case '+':
-	  return evaluate_expression (exp.operands[0],
-				      x) +
-	    evaluate_expression (exp.operands[1], x);
-	case '-':
-	  return evaluate_expression (exp.operands[0],
-				      x) -
-	    evaluate_expression (exp.operands[1], x);
-	case '/':
-	  return evaluate_expression (exp.operands[0],
-				      x) /
-	    evaluate_expression (exp.operands[1], x);
-	case '*':
-	  return evaluate_expression (exp.operands[0],
-				      x) *
-	    evaluate_expression (exp.operands[1], x);
-	case '^':
-	  return pow (evaluate_expression (exp.operands[0], x),
-		      evaluate_expression (exp.operands[1], x));
-	case 'N':
-	  return -evaluate_expression (exp.operands[0], x);
-	default:
-	  return 0;
-	}
-    case EXPRESSION_NUMBER:
-      return exp.d;
-    case EXPRESSION_VARIABLE:
-      return x;
-    default:
-      return 0;
+  if (sketched)
+    {
+      options_fit_sketches (&o, &x_sketch, &y_sketch);
+      sketch_destroy (&x_sketch);
+      sketch_destroy (&y_sketch);
     }
-}
+  else
+    options_fit_ranges (&o, points, npoints);
+  stats_end (st, STATS_RANGE);
 
-double
-find_x_min (const point_t * const points, const size_t npoints)
-{
-  if (npoints > 0)
+  if (o.interactive)
     {
-      double min = points[0].x;
-      for (size_t i = 1; i < npoints; ++i)
-	min = (points[i].x < min) ? points[i].x : min;
-
-      return min;
+      if (explore (&o, points, npoints, out) != 0)
+	exit (EXIT_FAILURE);
     }
-
-  return -10;
-}
-
-double
-find_x_max (const point_t * const points, const size_t npoints)
-{
-  if (npoints > 0)
+  else if (o.image)
     {
-      double max = points[0].x;
-      for (size_t i = 1; i < npoints; ++i)
-	max = (points[i].x > max) ? points[i].x : max;
-
-      return max;
+      if (write_image (&o, points, npoints, st) != 0)
+	exit (EXIT_FAILURE);
     }
-
-  return 10;
-}
-
-double
-find_y_min (const point_t * const points, const size_t npoints)
-{
-  if (npoints > 0)
+  else if (sidecar)
+    plot_to_sidecar (&o, sidecar, &identity, sidecar_key, points, npoints,
+		     nread, out, st);
+  else
+    plot_stats (out, *p, points, npoints, st);
+  free (sidecar);
+  if (out != stdout && fclose (out) != 0)
     {
-      double min = points[0].y;
-      for (size_t i = 1; i < npoints; ++i)
-	min = (points[i].y < min) ? points[i].y : min;
-
-      return min;
+      perror (o.output);
+      exit (EXIT_FAILURE);
     }
+  if (cached.map)
+    cache_release (&cached);
+  else
+    free (points);
 
-  return -10;
-}
-
-double
-find_y_max (const point_t * const points, const size_t npoints)
-{
-  if (npoints > 0)
+  if (o.cache_stats)
     {
-      double max = points[0].y;
-      for (size_t i = 1; i < npoints; ++i)
-	max = (points[i].y > max) ? points[i].y : max;
-
-      return max;
+      struct cache_stats totals;
+      if (!o.cache.dir)
+	fputs ("cache: no --cache-dir given\n", stderr);
+      else if (cache_get_stats (&o.cache, &totals) != 0)
+	perror ("cache");
+      else
+	fprintf (stderr,
+		 "cache: hits=%llu misses=%llu entries=%llu bytes=%llu\n",
+		 totals.hits, totals.misses, totals.entries, totals.bytes);
     }
 
-  return 10;
+  stats_report (st, stderr);
+  stats_destroy (st);
+
+  exit (EXIT_SUCCESS);
 }
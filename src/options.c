@@ -0,0 +1,780 @@
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "options.h"
+#include "points.h"
+#include "evaluator.h"
+
+#define NELEMS(arr) (sizeof(arr)/sizeof(arr[0]))
+#define DEFAULT_CACHE_SIZE (64 * 1024 * 1024)
+
+enum command_line_options
+{
+  file, expression, x_min, x_max, y_min, y_max, x_ticks, y_ticks,
+  x_number_color, y_number_color, axes_color, mark_color, rows, columns,
+  x_number_width, y_number_width, x_precision, y_precision, mark_char,
+  cache_dir, cache_max_size, cache_stats, serve, threads, batch, output, stats,
+  t_min, t_max, fps, auto_range, delimiter, x_col, y_col, skip_header, image,
+  image_size, lines, math, implicit, sample, seed, x_time, panels,
+  shared_axes, sidecar, interactive, histogram, bin_width, log_bins, x_expr, y_expr, help
+};
+
+static const struct option long_options[] = {
+  {"file", required_argument, NULL, file},
+  {"expression", required_argument, NULL, expression},
+  {"x-min", required_argument, NULL, x_min},
+  {"x-max", required_argument, NULL, x_max},
+  {"y-min", required_argument, NULL, y_min},
+  {"y-max", required_argument, NULL, y_max},
+  {"x-ticks", required_argument, NULL, x_ticks},
+  {"y-ticks", required_argument, NULL, y_ticks},
+  {"x-number-color", required_argument, NULL, x_number_color},
+  {"y-number-color", required_argument, NULL, y_number_color},
+  {"axes-color", required_argument, NULL, axes_color},
+  {"mark-color", required_argument, NULL, mark_color},
+  {"rows", required_argument, NULL, rows},
+  {"columns", required_argument, NULL, columns},
+  {"x-number-width", required_argument, NULL, x_number_width},
+  {"y-number-width", required_argument, NULL, y_number_width},
+  {"x-precision", required_argument, NULL, x_precision},
+  {"y-precision", required_argument, NULL, y_precision},
+  {"mark-char", required_argument, NULL, mark_char},
+  {"cache-dir", required_argument, NULL, cache_dir},
+  {"cache-max-size", required_argument, NULL, cache_max_size},
+  {"cache-stats", no_argument, NULL, cache_stats},
+  {"serve", required_argument, NULL, serve},
+  {"threads", required_argument, NULL, threads},
+  {"batch", required_argument, NULL, batch},
+  {"output", required_argument, NULL, output},
+  {"stats", no_argument, NULL, stats},
+  {"t-min", required_argument, NULL, t_min},
+  {"t-max", required_argument, NULL, t_max},
+  {"fps", required_argument, NULL, fps},
+  {"auto-range", required_argument, NULL, auto_range},
+  {"delimiter", required_argument, NULL, delimiter},
+  {"x-col", required_argument, NULL, x_col},
+  {"y-col", required_argument, NULL, y_col},
+  {"skip-header", no_argument, NULL, skip_header},
+  {"image", required_argument, NULL, image},
+  {"image-size", required_argument, NULL, image_size},
+  {"lines", no_argument, NULL, lines},
+  {"math", required_argument, NULL, math},
+  {"implicit", no_argument, NULL, implicit},
+  {"sample", required_argument, NULL, sample},
+  {"seed", required_argument, NULL, seed},
+  {"x-time", required_argument, NULL, x_time},
+  {"panels", required_argument, NULL, panels},
+  {"shared-axes", no_argument, NULL, shared_axes},
+  {"sidecar", no_argument, NULL, sidecar},
+  {"interactive", no_argument, NULL, interactive},
+  {"histogram", no_argument, NULL, histogram},
+  {"bin-width", required_argument, NULL, bin_width},
+  {"log-bins", no_argument, NULL, log_bins},
+  {"x-expr", required_argument, NULL, x_expr},
+  {"y-expr", required_argument, NULL, y_expr},
+  {"help", no_argument, NULL, help},
+  {0, 0, 0, 0}
+};
+
+void
+options_init (struct options *const o)
+{
+  memset (o, 0, sizeof *o);
+
+  o->plot.x_min = -10;
+  o->plot.x_max = 10;
+  o->plot.y_min = -10;
+  o->plot.y_max = 10;
+  o->plot.nxticks = 6;
+  o->plot.nyticks = 6;
+  o->plot.x_number_color = RED;
+  o->plot.y_number_color = BLUE;
+  o->plot.axes_color = GREEN;
+  o->plot.mark_color = WHITE;
+  o->plot.mark_char = '+';
+  o->plot.nrows = 22;
+  o->plot.ncolumns = 42;
+  o->plot.x_number_width = 8;
+  o->plot.y_number_width = 8;
+  o->plot.x_precision = 3;
+  o->plot.y_precision = 3;
+
+  o->source = INPUT_STDIN;
+  o->cache.max_size = DEFAULT_CACHE_SIZE;
+
+  o->fps = 30;
+  o->seed = RESERVOIR_DEFAULT_SEED;
+  o->image_width = 1600;
+  o->image_height = 800;
+  csv_format_init (&o->csv);
+
+  const long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  o->nthreads = ncpus > 0 ? ncpus : 1;
+}
+
+/* Exact names win; otherwise an unambiguous prefix is accepted, as getopt_long does. */
+static const struct option *
+find_option (const char *const name, const size_t len)
+{
+  const struct option *match = NULL;
+  size_t nmatches = 0;
+
+  for (size_t i = 0; long_options[i].name; ++i)
+    if (strncmp (long_options[i].name, name, len) == 0)
+      {
+	if (long_options[i].name[len] == '\0')
+	  return &long_options[i];
+
+	match = &long_options[i];
+	++nmatches;
+      }
+
+  return nmatches == 1 ? match : NULL;
+}
+
+/* Parses "p1,p99" into the fractions 0.01 and 0.99. */
+static int
+parse_percentiles (const char *s, double *const low, double *const high)
+{
+  char *end;
+
+  if (*s == 'p')
+    ++s;
+  *low = strtod (s, &end) / 100;
+  if (end == s || *end != ',')
+    return -1;
+
+  s = end + 1;
+  if (*s == 'p')
+    ++s;
+  *high = strtod (s, &end) / 100;
+  if (end == s || *end != '\0')
+    return -1;
+
+  return 0 <= *low && *low < *high && *high <= 1 ? 0 : -1;
+}
+
+/* Accepts a single character, or "\\t" or "tab" for a tab. */
+static int
+parse_delimiter (const char *const s, char *const delimiter)
+{
+  if (strcmp (s, "\\t") == 0 || strcmp (s, "tab") == 0)
+    *delimiter = '\t';
+  else if (s[0] != '\0' && s[1] == '\0' && s[0] != '\n')
+    *delimiter = s[0];
+  else
+    return -1;
+
+  return 0;
+}
+
+static int
+parse_column (const char *const s, unsigned int *const column)
+{
+  char *end;
+  const unsigned long n = strtoul (s, &end, 10);
+  if (end == s || *end != '\0' || n == 0 || n > 1000000)
+    return -1;
+
+  *column = n;
+  return 0;
+}
+
+static int
+parse_count (const char *const s, unsigned long long *const count)
+{
+  char *end;
+  errno = 0;
+  const unsigned long long n = strtoull (s, &end, 10);
+  if (end == s || *end != '\0' || errno != 0 || s[0] == '-')
+    return -1;
+
+  *count = n;
+  return 0;
+}
+
+/* Parses "1600x800", with neither part 0 nor above max. */
+static int
+parse_dimensions (const char *const s, unsigned int *const width,
+		  unsigned int *const height, const unsigned long max)
+{
+  char *end;
+  const unsigned long w = strtoul (s, &end, 10);
+  if (end == s || *end != 'x')
+    return -1;
+
+  const char *const h_start = end + 1;
+  const unsigned long h = strtoul (h_start, &end, 10);
+  if (end == h_start || *end != '\0' || w == 0 || h == 0
+      || w > max || h > max)
+    return -1;
+
+  *width = w;
+  *height = h;
+  return 0;
+}
+
+/* Returns -1 if arg is not a valid value for the option. */
+static int
+set_option (struct options *const o, const int option, const char *const arg)
+{
+  plot_info_t *const p = &o->plot;
+
+  switch (option)
+    {
+    case file:
+      if (o->nfiles == OPTIONS_MAX_FILES)
+	return -1;
+      o->source = INPUT_FILE;
+      o->file_names[o->nfiles++] = arg;
+      o->file_name = o->file_names[0];
+      break;
+    case expression:
+      o->source = INPUT_EXPRESSION;
+      o->expression = arg;
+      break;
+    case x_min:
+      sscanf (arg, "%lf", &p->x_min);
+      o->x_min_set = true;
+      break;
+    case x_max:
+      sscanf (arg, "%lf", &p->x_max);
+      o->x_max_set = true;
+      break;
+    case y_min:
+      sscanf (arg, "%lf", &p->y_min);
+      o->y_min_set = true;
+      break;
+    case y_max:
+      sscanf (arg, "%lf", &p->y_max);
+      o->y_max_set = true;
+      break;
+    case x_ticks:
+      sscanf (arg, "%hu", &p->nxticks);
+      break;
+    case y_ticks:
+      sscanf (arg, "%hu", &p->nyticks);
+      break;
+    case x_number_color:
+      p->x_number_color = process_color (arg);
+      break;
+    case y_number_color:
+      p->y_number_color = process_color (arg);
+      break;
+    case axes_color:
+      p->axes_color = process_color (arg);
+      break;
+    case mark_color:
+      p->mark_color = process_color (arg);
+      break;
+    case rows:
+      sscanf (arg, "%hu", &p->nrows);
+      break;
+    case columns:
+      sscanf (arg, "%hu", &p->ncolumns);
+      break;
+    case x_number_width:
+      sscanf (arg, "%hu", &p->x_number_width);
+      break;
+    case y_number_width:
+      sscanf (arg, "%hu", &p->y_number_width);
+      break;
+    case x_precision:
+      sscanf (arg, "%hu", &p->x_precision);
+      break;
+    case y_precision:
+      sscanf (arg, "%hu", &p->y_precision);
+      break;
+    case mark_char:
+      p->mark_char = arg[0];
+      break;
+    case cache_dir:
+      o->cache.dir = arg;
+      break;
+    case cache_max_size:
+      o->cache.max_size = process_size (arg);
+      break;
+    case cache_stats:
+      o->cache_stats = true;
+      break;
+    case serve:
+      o->serve_path = arg;
+      break;
+    case threads:
+      sscanf (arg, "%u", &o->nthreads);
+      if (o->nthreads == 0)
+	o->nthreads = 1;
+      break;
+    case batch:
+      o->batch_manifest = arg;
+      break;
+    case output:
+      o->output = arg;
+      break;
+    case stats:
+      o->stats = true;
+      break;
+    case t_min:
+      sscanf (arg, "%lf", &o->t_min);
+      break;
+    case t_max:
+      sscanf (arg, "%lf", &o->t_max);
+      o->t_max_set = true;
+      break;
+    case fps:
+      sscanf (arg, "%lf", &o->fps);
+      if (!(o->fps > 0))
+	o->fps = 30;
+      break;
+    case auto_range:
+      o->auto_range = true;
+      return parse_percentiles (arg, &o->auto_range_low,
+				&o->auto_range_high);
+    case delimiter:
+      o->csv_set = true;
+      return parse_delimiter (arg, &o->csv.delimiter);
+    case x_col:
+      o->csv_set = true;
+      return parse_column (arg, &o->csv.x_column);
+    case y_col:
+      o->csv_set = true;
+      return parse_column (arg, &o->csv.y_column);
+    case skip_header:
+      o->csv_set = true;
+      o->csv.skip_header = true;
+      break;
+    case x_expr:
+      o->csv_set = true;
+      o->csv.x_expr = arg;
+      break;
+    case y_expr:
+      o->csv_set = true;
+      o->csv.y_expr = arg;
+      break;
+    case image:
+      o->image = arg;
+      break;
+    case image_size:
+      return parse_dimensions (arg, &o->image_width, &o->image_height, 32768);
+    case lines:
+      p->lines = true;
+      break;
+    case math:
+      if (strcmp (arg, "fast") == 0)
+	o->math = o->csv.math = MATH_FAST;
+      else if (strcmp (arg, "precise") == 0)
+	o->math = o->csv.math = MATH_PRECISE;
+      else
+	return -1;
+      break;
+    case implicit:
+      o->implicit = true;
+      break;
+    case sample:
+      {
+	unsigned long long k;
+	if (parse_count (arg, &k) != 0 || k == 0 || k > SIZE_MAX / 64)
+	  return -1;
+	o->sample = k;
+	break;
+      }
+    case seed:
+      {
+	unsigned long long s;
+	if (parse_count (arg, &s) != 0)
+	  return -1;
+	o->seed = s;
+	break;
+      }
+    case x_time:
+      if (strcmp (arg, "iso") == 0)
+	o->csv.x_time = TIME_ISO;
+      else if (strcmp (arg, "s") == 0)
+	o->csv.x_time = TIME_SECONDS;
+      else if (strcmp (arg, "ms") == 0)
+	o->csv.x_time = TIME_MILLISECONDS;
+      else
+	return -1;
+      o->csv_set = true;
+      p->x_time = true;
+      break;
+    case panels:
+      if (parse_dimensions (arg, &o->panel_rows, &o->panel_columns,
+			    OPTIONS_MAX_FILES) != 0
+	  || o->panel_rows * o->panel_columns > OPTIONS_MAX_FILES)
+	return -1;
+      break;
+    case shared_axes:
+      o->shared_axes = true;
+      break;
+    case sidecar:
+      o->sidecar = true;
+      break;
+    case interactive:
+      o->interactive = true;
+      break;
+    case histogram:
+      o->histogram = true;
+      break;
+    case bin_width:
+      {
+	char *end;
+	o->bin_width = strtod (arg, &end);
+	if (end == arg || *end != '\0' || !(o->bin_width > 0)
+	    || !isfinite (o->bin_width))
+	  return -1;
+	o->histogram = true;
+	break;
+      }
+    case log_bins:
+      o->log_bins = true;
+      o->histogram = true;
+      break;
+    case help:
+      o->help = true;
+      break;
+    }
+
+  return 0;
+}
+
+int
+options_parse (struct options *const o, const int argc, char *const argv[],
+	       char *const error, const size_t error_size)
+{
+  for (int i = 0; i < argc; ++i)
+    {
+      const char *const arg = argv[i];
+      if (strncmp (arg, "--", 2) != 0)
+	{
+	  snprintf (error, error_size, "unexpected argument '%s'", arg);
+	  return -1;
+	}
+
+      const char *const name = arg + 2;
+      const char *const equals = strchr (name, '=');
+      const size_t len = equals ? (size_t) (equals - name) : strlen (name);
+
+      const struct option *const opt = find_option (name, len);
+      if (!opt)
+	{
+	  snprintf (error, error_size, "unrecognized option '%s'", arg);
+	  return -1;
+	}
+
+      const char *value = NULL;
+      if (opt->has_arg == required_argument)
+	{
+	  if (equals)
+	    value = equals + 1;
+	  else if (i + 1 < argc)
+	    value = argv[++i];
+	  else
+	    {
+	      snprintf (error, error_size, "option '--%s' requires an argument",
+			opt->name);
+	      return -1;
+	    }
+	}
+      else if (equals)
+	{
+	  snprintf (error, error_size, "option '--%s' doesn't allow an argument",
+		    opt->name);
+	  return -1;
+	}
+
+      if (set_option (o, opt->val, value) != 0)
+	{
+	  snprintf (error, error_size, "invalid argument '%s' for '--%s'",
+		    value, opt->name);
+	  return -1;
+	}
+    }
+
+  return 0;
+}
+
+static unsigned long long
+hash_text (const char *const s)
+{
+  unsigned long long h = 14695981039346656037ULL;	/* FNV-1a */
+  for (const unsigned char *c = (const unsigned char *) s; s && *c; ++c)
+    {
+      h ^= *c;
+      h *= 1099511628211ULL;
+    }
+
+  return h;
+}
+
+struct csv_format
+options_input_format (const struct options *const o)
+{
+  if (o->csv_set)
+    return o->csv;
+
+  struct csv_format format;
+  csv_format_init (&format);
+  format.delimiter = ' ';
+  return format;
+}
+
+/* Everything that decides which cells the points of a file fall in */
+void
+options_sidecar_key (const struct options *const o, char *const key,
+		     const size_t size)
+{
+  const plot_info_t p = o->plot;
+  const double values[4] = { p.x_min, p.x_max, p.y_min, p.y_max };
+  const bool set[4] = {
+    o->x_min_set, o->x_max_set, o->y_min_set, o->y_max_set
+  };
+  char ranges[4][32];
+  for (int i = 0; i < 4; ++i)
+    if (set[i])
+      snprintf (ranges[i], sizeof ranges[i], "%a", values[i]);
+    else
+      strcpy (ranges[i], "-");
+
+  snprintf (key, size,
+	    "%hux%hu|%hu|%hu|%s|%s|%s|%s|%d|%d|%d|%u|%u|%d|%d|%d|%a|%a|%zu|%llu|%llx|%llx|%d",
+	    p.nrows, p.ncolumns, p.x_precision, p.y_precision, ranges[0],
+	    ranges[1], ranges[2], ranges[3], p.lines, o->csv_set,
+	    o->csv.delimiter, o->csv.x_column, o->csv.y_column,
+	    o->csv.skip_header, (int) o->csv.x_time, o->auto_range,
+	    o->auto_range_low, o->auto_range_high, o->sample,
+	    (unsigned long long) o->seed, hash_text (o->csv.x_expr),
+	    hash_text (o->csv.y_expr), (int) o->csv.math);
+}
+
+/* Only main carries these out; jobs read a single input into a single plot.
+ * Requests are replied to, and only take the points they carry or an
+ * expression, as the daemon is not to open files for whoever connects. */
+const char *
+options_job_unsupported (const struct options *const o, const bool served)
+{
+  if (served && o->source == INPUT_FILE)
+    return "--file";
+  if (served && o->output)
+    return "--output";
+  if (served && o->implicit)
+    return "--implicit";
+  if (o->panel_rows > 0)
+    return "--panels";
+  if (o->nfiles > 1)
+    return "--file given more than once";
+  if (o->image)
+    return "--image";
+  if (o->histogram)
+    return "--histogram";
+  if (o->sidecar)
+    return "--sidecar";
+  if (o->interactive)
+    return "--interactive";
+  if (o->t_max_set)
+    return "--t-max";
+  if (o->cache.dir)
+    return "--cache-dir";
+  if (o->cache_stats)
+    return "--cache-stats";
+  if (o->stats)
+    return "--stats";
+  if (o->serve_path)
+    return "--serve";
+  if (o->batch_manifest)
+    return "--batch";
+  if (o->source == INPUT_EXPRESSION && o->sample > 0)
+    return "--sample with --expression";
+  if (o->source == INPUT_EXPRESSION && (o->csv.x_expr || o->csv.y_expr))
+    return "--x-expr or --y-expr with --expression";
+  return NULL;
+}
+
+/* Splits line into words in place. Single and double quotes group words and are removed. */
+int
+options_split (char *const line, char *argv[], const int max_args)
+{
+  int argc = 0;
+  char *in = line;
+  char *out = line;
+
+  for (;;)
+    {
+      while (isspace ((unsigned char) *in))
+	++in;
+      if (!*in)
+	break;
+
+      if (argc == max_args)
+	return -1;
+      argv[argc++] = out;
+
+      char quote = '\0';
+      while (*in && (quote || !isspace ((unsigned char) *in)))
+	{
+	  if (quote && *in == quote)
+	    quote = '\0';
+	  else if (!quote && (*in == '\'' || *in == '"'))
+	    quote = *in;
+	  else
+	    *out++ = *in;
+	  ++in;
+	}
+
+      if (quote)
+	return -1;
+
+      /* out never overtakes in, so the terminator cannot clobber unread input */
+      if (*in)
+	++in;
+      *out++ = '\0';
+    }
+
+  return argc;
+}
+
+static double
+quantile_or (const sketch_t * const sketch, const double q,
+	     const double fallback)
+{
+  const double value = sketch_quantile (sketch, q);
+  return isnan (value) ? fallback : value;
+}
+
+void
+options_fit_sketches (struct options *const o, const sketch_t * const x,
+		      const sketch_t * const y)
+{
+  if (!o->x_min_set)
+    o->plot.x_min = quantile_or (x, o->auto_range_low, -10);
+  if (!o->x_max_set)
+    o->plot.x_max = quantile_or (x, o->auto_range_high, 10);
+  if (!o->y_min_set)
+    o->plot.y_min = quantile_or (y, o->auto_range_low, -10);
+  if (!o->y_max_set)
+    o->plot.y_max = quantile_or (y, o->auto_range_high, 10);
+}
+
+void
+options_fit_ranges (struct options *const o, const point_t * const points,
+		    const size_t npoints)
+{
+  if (o->auto_range)
+    {
+      sketch_t x, y;
+      bool built = sketch_init (&x, SKETCH_DEFAULT_K) == 0;
+      built = sketch_init (&y, SKETCH_DEFAULT_K) == 0 && built;
+      for (size_t i = 0; built && i < npoints; ++i)
+	built = sketch_add (&x, points[i].x) == 0
+	  && sketch_add (&y, points[i].y) == 0;
+
+      if (built)
+	options_fit_sketches (o, &x, &y);
+      sketch_destroy (&x);
+      sketch_destroy (&y);
+      if (built)
+	return;
+    }
+
+  if (!o->x_min_set)
+    o->plot.x_min = find_x_min (points, npoints);
+  if (!o->x_max_set)
+    o->plot.x_max = find_x_max (points, npoints);
+  if (!o->y_min_set)
+    o->plot.y_min = find_y_min (points, npoints);
+  if (!o->y_max_set)
+    o->plot.y_max = find_y_max (points, npoints);
+}
+
+bool
+options_wants_expression_range (const struct options *const o)
+{
+  return !o->auto_range && !(o->y_min_set && o->y_max_set);
+}
+
+bool
+options_fit_found_range (struct options *const o,
+			 const struct expression_range *const range)
+{
+  if (!options_wants_expression_range (o))
+    return false;
+
+  if (range->y_min <= range->y_max)
+    {
+      if (!o->y_min_set)
+	o->plot.y_min = range->y_min;
+      if (!o->y_max_set)
+	o->plot.y_max = range->y_max;
+      o->y_min_set = o->y_max_set = true;
+    }
+  return true;
+}
+
+void
+options_fit_expression (struct options *const o, const expression_t exp,
+			const double t, struct expression_range *const range)
+{
+  range->nsingularities = 0;
+  if (!options_wants_expression_range (o))
+    return;
+
+  find_expression_range (exp, o->plot.x_min, last_sample_x (o->plot), t,
+			 range);
+  options_fit_found_range (o, range);
+}
+
+enum plot_color
+process_color (const char *const color)
+{
+  const char *colors_text[] = {
+    "black", "red", "green", "orange", "blue", "purple", "cyan", "light-gray",
+    "dark-gray", "light-red",
+    "light-green", "yellow", "light-blue", "light-purple", "light-cyan",
+    "white", "no-color"
+  };
+
+  enum plot_color colors[] =
+  {
+    BLACK, RED, GREEN, ORANGE, BLUE, PURPLE, CYAN, LIGHT_GRAY, DARK_GRAY,
+    LIGHT_RED,
+    LIGHT_GREEN, YELLOW, LIGHT_BLUE, LIGHT_PURPLE, LIGHT_CYAN, WHITE, NO_COLOR
+  };
+
+  for (size_t i = 0; i < NELEMS (colors_text); ++i)
+    if (strcmp (colors_text[i], color) == 0)
+      return colors[i];
+
+  return NO_COLOR;
+}
+
+size_t
+process_size (const char *const size)
+{
+  char *end;
+  unsigned long long n = strtoull (size, &end, 10);
+  switch (*end)
+    {
+    case 'G':
+    case 'g':
+      n *= 1024;
+      /* fall through */
+    case 'M':
+    case 'm':
+      n *= 1024;
+      /* fall through */
+    case 'K':
+    case 'k':
+      n *= 1024;
+      break;
+    default:
+      break;
+    }
+
+  return n;
+}
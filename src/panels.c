@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "panels.h"
+#include "pool.h"
+
+#define PANEL_GAP 3
+
+/* A panel rendered on its own, before it is copied into the frame */
+struct rendered
+{
+  const struct plot_panel *panel;
+  char *text;
+  ssize_t len;
+  size_t nlines;
+  size_t width;			/* of the widest line, in columns */
+  const char *next;		/* the line compose copies next */
+};
+
+struct frame
+{
+  char *data;
+  size_t size;
+  size_t len;
+};
+
+static void
+frame_write (struct frame *const f, const char *const s, const size_t n)
+{
+  if (f->len + 1 < f->size)
+    {
+      const size_t room = f->size - f->len - 1;
+      memcpy (f->data + f->len, s, n < room ? n : room);
+    }
+
+  f->len += n;
+}
+
+static void
+frame_pad (struct frame *const f, size_t n)
+{
+  static const char spaces[] = "                                ";
+  while (n > 0)
+    {
+      const size_t chunk = n < sizeof spaces - 1 ? n : sizeof spaces - 1;
+      frame_write (f, spaces, chunk);
+      n -= chunk;
+    }
+}
+
+/* The columns a line takes on the terminal; color escapes and the ones
+ * switching to line drawing and back take none */
+static size_t
+line_width (const char *s, const char *const end)
+{
+  size_t width = 0;
+  while (s < end)
+    if (*s == '\033' && end - s > 1 && s[1] == '[')
+      {
+	s += 2;
+	while (s < end && !(*s >= 0x40 && *s <= 0x7e))
+	  ++s;
+	s += s < end;
+      }
+    else if (*s == '\033')
+      s += end - s < 3 ? end - s : 3;
+    else
+      {
+	++width;
+	++s;
+      }
+
+  return width;
+}
+
+static void
+render_panel (void *const arg, const size_t worker)
+{
+  (void) worker;
+  struct rendered *const r = arg;
+  const struct plot_panel *const panel = r->panel;
+  if (!panel->grid)
+    return;
+
+  const struct plot_series series = {
+    .grid = panel->grid,.color = panel->plot.mark_color
+  };
+  /* Panels are already rendered a thread each */
+  plot_info_t plot = panel->plot;
+  plot.nthreads = 1;
+  for (size_t size = 16384;;)
+    {
+      char *const text = realloc (r->text, size);
+      if (!text)
+	{
+	  r->len = -1;
+	  return;
+	}
+      r->text = text;
+
+      r->len = plot_render_series (text, size, plot, &series, 1);
+      if (r->len < 0 || (size_t) r->len < size)
+	break;
+      size = r->len + 1;
+    }
+  if (r->len < 0)
+    return;
+
+  /* The color reset plots end with is not a line of its own */
+  const char *const end = r->text + r->len;
+  for (const char *line = r->text; line < end;)
+    {
+      const char *newline = memchr (line, '\n', end - line);
+      if (!newline)
+	newline = end;
+
+      const size_t width = line_width (line, newline);
+      if (width > 0 || newline < end)
+	++r->nlines;
+      if (width > r->width)
+	r->width = width;
+      line = newline + 1;
+    }
+}
+
+static int
+render_panels (struct rendered rendered[], const struct plot_panel panels[],
+	       const size_t npanels, const unsigned int nthreads)
+{
+  memset (rendered, 0, npanels * sizeof (*rendered));
+  for (size_t i = 0; i < npanels; ++i)
+    rendered[i].panel = &panels[i];
+
+  pool_t *const pool = nthreads > 1 && npanels > 1
+    ? pool_create (nthreads < npanels ? nthreads : npanels) : NULL;
+  for (size_t i = 0; i < npanels; ++i)
+    if (!pool || pool_submit (pool, render_panel, &rendered[i]) != 0)
+      render_panel (&rendered[i], 0);
+  if (pool)
+    pool_destroy (pool);
+
+  for (size_t i = 0; i < npanels; ++i)
+    if (rendered[i].len < 0)
+      return -1;
+
+  return 0;
+}
+
+/* Copies the rendered panels into place, a row of panels at a time and a
+ * line of each at a time */
+static size_t
+compose (char *const buf, const size_t size,
+	 struct rendered rendered[], const size_t npanels,
+	 const unsigned short ncolumns)
+{
+  struct frame f = {.data = buf,.size = size,.len = 0 };
+
+  size_t width = 0, nlines = 0;
+  for (size_t i = 0; i < npanels; ++i)
+    {
+      width = rendered[i].width > width ? rendered[i].width : width;
+      nlines = rendered[i].nlines > nlines ? rendered[i].nlines : nlines;
+    }
+
+  for (size_t first = 0; first < npanels; first += ncolumns)
+    {
+      const size_t n = npanels - first < ncolumns ? npanels - first : ncolumns;
+      if (first > 0)
+	frame_write (&f, "\n", 1);
+
+      /* Titles start over the y-axis, where they fit */
+      for (size_t c = 0; c < n; ++c)
+	{
+	  const struct plot_panel *const panel = rendered[first + c].panel;
+	  const char *const title = panel->title ? panel->title : "";
+	  size_t indent = panel->plot.y_number_width + 1;
+	  indent = indent < width ? indent : 0;
+	  size_t len = strlen (title);
+	  len = len < width - indent ? len : width - indent;
+
+	  frame_pad (&f, indent);
+	  frame_write (&f, title, len);
+	  if (c + 1 < n)
+	    frame_pad (&f, width - indent - len + PANEL_GAP);
+	  rendered[first + c].next = rendered[first + c].text;
+	}
+      frame_write (&f, "\n", 1);
+
+      for (size_t l = 0; l < nlines; ++l)
+	{
+	  for (size_t c = 0; c < n; ++c)
+	    {
+	      struct rendered *const r = &rendered[first + c];
+	      size_t used = 0;
+	      if (l < r->nlines)
+		{
+		  const char *const end = r->text + r->len;
+		  const char *newline = memchr (r->next, '\n', end - r->next);
+		  if (!newline)
+		    newline = end;
+
+		  frame_write (&f, r->next, newline - r->next);
+		  frame_write (&f, "\033[0m", 4);
+		  used = line_width (r->next, newline);
+		  r->next = newline + (newline < end);
+		}
+
+	      if (c + 1 < n)
+		frame_pad (&f, width - used + PANEL_GAP);
+	    }
+	  frame_write (&f, "\n", 1);
+	}
+    }
+
+  if (size > 0)
+    buf[f.len < size ? f.len : size - 1] = '\0';
+  return f.len;
+}
+
+ssize_t
+plot_render_panels (char *const buf, const size_t size,
+		    const struct plot_panel panels[], const size_t npanels,
+		    const unsigned short ncolumns, const unsigned int nthreads)
+{
+  if (npanels == 0 || ncolumns == 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  struct rendered *const rendered = malloc (npanels * sizeof (*rendered));
+  if (!rendered)
+    return -1;
+
+  ssize_t len = -1;
+  if (render_panels (rendered, panels, npanels, nthreads) == 0)
+    len = compose (buf, size, rendered, npanels, ncolumns);
+
+  for (size_t i = 0; i < npanels; ++i)
+    free (rendered[i].text);
+  free (rendered);
+  return len;
+}
+
+void
+plot_write_panels (FILE * const stream, const struct plot_panel panels[],
+		   const size_t npanels, const unsigned short ncolumns,
+		   const unsigned int nthreads, stats_t * const stats)
+{
+  struct rendered *const rendered = npanels > 0 && ncolumns > 0
+    ? malloc (npanels * sizeof (*rendered)) : NULL;
+  if (!rendered || render_panels (rendered, panels, npanels, nthreads) != 0)
+    {
+      fputs ("Error: could not render plot.\n", stream);
+      if (rendered)
+	for (size_t i = 0; i < npanels; ++i)
+	  free (rendered[i].text);
+      free (rendered);
+      return;
+    }
+
+  /* Measured first, so the panels are rendered only once */
+  const size_t len = compose (NULL, 0, rendered, npanels, ncolumns);
+  char *const frame = malloc (len + 1);
+  if (frame)
+    compose (frame, len + 1, rendered, npanels, ncolumns);
+  stats_end (stats, STATS_RENDER);
+
+  if (frame)
+    {
+      fwrite (frame, 1, len, stream);
+      fflush (stream);
+      stats_end (stats, STATS_WRITE);
+      if (stats)
+	stats->bytes_emitted += len;
+    }
+  else
+    fputs ("Error: out of memory.\n", stream);
+
+  for (size_t i = 0; i < npanels; ++i)
+    free (rendered[i].text);
+  free (rendered);
+  free (frame);
+}
@@ -1,252 +1,338 @@
-#include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include "tokenizer.h"
 #include "parser.h"
 
+/* Left operands are taken apart in a loop and right ones from a stack of
+ * their own, so trees as deep as the expression is long need no recursion */
 void
 expression_destroy (const expression_t e)
 {
-  switch (e.type)
+  expression_t *right = NULL;
+  size_t nright = 0, size = 0;
+
+  for (expression_t next = e;;)
+    {
+      size_t arity = 0;
+      switch (next.type)
+	{
+	case EXPRESSION_FUNCTION:
+	  free (next.s);
+	  arity = 1;
+	  break;
+	case EXPRESSION_OPERATOR:
+	  arity = next.operator == 'N' ? 1 : 2;
+	  break;
+	case EXPRESSION_VARIABLE:
+	  free (next.s);
+	  break;
+	default:
+	  break;
+	}
+
+      if (arity > 0)
+	{
+	  const expression_t *const operands = next.operands;
+	  if (arity == 2)
+	    {
+	      if (nright == size)
+		{
+		  const size_t bigger = size ? 2 * size : 16;
+		  expression_t *const grown =
+		    realloc (right, bigger * sizeof (*right));
+		  if (grown)
+		    {
+		      right = grown;
+		      size = bigger;
+		    }
+		}
+
+	      if (nright < size)
+		right[nright++] = operands[1];
+	      else
+		expression_destroy (operands[1]);
+	    }
+
+	  next = operands[0];
+	  free ((void *) operands);
+	  continue;
+	}
+
+      if (nright == 0)
+	break;
+      next = right[--nright];
+    }
+
+  free (right);
+}
+
+/* Operators waiting for their operands: binary ones, negation ('N'), functions
+ * ('F', with their names) and open parentheses */
+struct pending
+{
+  char operator;
+  char *s;
+};
+
+/* The parse is driven by two explicit stacks rather than by recursion, so
+ * expressions of any length parse in linear time and constant stack */
+struct parser
+{
+  expression_t *operands;
+  size_t noperands, operands_size;
+  struct pending *operators;
+  size_t noperators, operators_size;
+};
+
+static int
+grow (void **const array, size_t * const size, const size_t n,
+      const size_t element_size)
+{
+  if (n < *size)
+    return 0;
+
+  const size_t bigger = *size ? 2 * *size : 16;
+  void *const resized = realloc (*array, bigger * element_size);
+  if (!resized)
+    return -1;
+
+  *array = resized;
+  *size = bigger;
+  return 0;
+}
+
+static int
+push_operand (struct parser *const p, const expression_t e)
+{
+  if (grow ((void **) &p->operands, &p->operands_size, p->noperands,
+	    sizeof (*p->operands)) != 0)
+    {
+      expression_destroy (e);
+      return -1;
+    }
+
+  p->operands[p->noperands++] = e;
+  return 0;
+}
+
+static int
+push_operator (struct parser *const p, const char operator, char *const s)
+{
+  if (grow ((void **) &p->operators, &p->operators_size, p->noperators,
+	    sizeof (*p->operators)) != 0)
+    {
+      free (s);
+      return -1;
+    }
+
+  p->operators[p->noperators].operator = operator;
+  p->operators[p->noperators++].s = s;
+  return 0;
+}
+
+/* Binds at most as tightly as a 0, which parentheses, negation and functions
+ * get, stops reductions */
+static int
+precedence (const char operator)
+{
+  switch (operator)
+    {
+    case '+':
+    case '-':
+      return 1;
+    case '*':
+    case '/':
+      return 2;
+    case '^':
+      return 3;
+    default:
+      return 0;
+    }
+}
+
+/* Replaces the operator on top of the stack and its operands by a node */
+static int
+reduce (struct parser *const p)
+{
+  const struct pending top = p->operators[--p->noperators];
+  const size_t arity = top.operator == 'N' || top.operator == 'F' ? 1 : 2;
+  if (p->noperands < arity)
+    {
+      free (top.s);
+      return -1;
+    }
+
+  expression_t e;
+  e.operands = malloc (arity * sizeof (*e.operands));
+  if (!e.operands)
+    {
+      free (top.s);
+      return -1;
+    }
+
+  p->noperands -= arity;
+  for (size_t i = 0; i < arity; ++i)
+    e.operands[i] = p->operands[p->noperands + i];
+
+  if (top.operator == 'F')
     {
-    case EXPRESSION_FUNCTION:
-      free (e.s);
-      expression_destroy (e.operands[0]);
-      free (e.operands);
-      break;
-    case EXPRESSION_OPERATOR:
-      expression_destroy (e.operands[0]);
-      if (e.operator != 'N')
-	expression_destroy (e.operands[1]);
-
-      free (e.operands);
-      break;
-    case EXPRESSION_VARIABLE:
-      free (e.s);
-      break;
+      e.type = EXPRESSION_FUNCTION;
+      e.s = top.s;
+    }
+  else
+    {
+      e.type = EXPRESSION_OPERATOR;
+      e.operator = top.operator;
+    }
+
+  p->operands[p->noperands++] = e;
+  return 0;
+}
+
+/* Negation and functions take the operand that was just completed, binding
+ * more tightly than any binary operator */
+static int
+reduce_prefixes (struct parser *const p)
+{
+  while (p->noperators > 0
+	 && (p->operators[p->noperators - 1].operator == 'N'
+	     || p->operators[p->noperators - 1].operator == 'F'))
+    if (reduce (p) != 0)
+      return -1;
+
+  return 0;
+}
+
+/* An operand: a number, a variable, or a parenthesized expression, after any
+ * number of negations and functions. Returns 1 once one is complete. */
+static int
+parse_operand (struct parser *const p, const token_t tok)
+{
+  expression_t e;
+  switch (tok.type)
+    {
+    case TOKEN_NUMBER:
+      e.type = EXPRESSION_NUMBER;
+      e.d = tok.d;
+      return push_operand (p, e) == 0 && reduce_prefixes (p) == 0 ? 1 : -1;
+    case TOKEN_STRING:
+      e.type = EXPRESSION_VARIABLE;
+      e.s = tok.s;
+      return push_operand (p, e) == 0 && reduce_prefixes (p) == 0 ? 1 : -1;
+    case TOKEN_FUNCTION:
+      return push_operator (p, 'F', tok.s);
+    case TOKEN_ARITHMETIC_OPERATOR:
+      if (tok.operator == '(')
+	return push_operator (p, '(', NULL);
+      else if (tok.operator == '-')
+	return push_operator (p, 'N', NULL);
+      return -1;
     default:
-      break;
+      token_destroy (tok);
+      return -1;
     }
 }
 
+/* What follows an operand: a binary operator, a closing parenthesis or the
+ * end. Returns 1 at the end. */
+static int
+parse_operator (struct parser *const p, const token_t tok)
+{
+  if (tok.type == TOKEN_END)
+    return 1;
+  else if (tok.type != TOKEN_ARITHMETIC_OPERATOR)
+    {
+      token_destroy (tok);
+      return -1;
+    }
+
+  if (tok.operator == ')')
+    {
+      while (p->noperators > 0
+	     && p->operators[p->noperators - 1].operator != '(')
+	if (reduce (p) != 0)
+	  return -1;
+      if (p->noperators == 0)
+	return -1;
+
+      --p->noperators;
+      return reduce_prefixes (p);
+    }
+
+  const int level = precedence (tok.operator);
+  if (level == 0)
+    return -1;
+
+  /* ^ groups to the right, the others to the left */
+  while (p->noperators > 0)
+    {
+      const int top = precedence (p->operators[p->noperators - 1].operator);
+      if (top < level || (top == level && tok.operator == '^'))
+	break;
+      if (reduce (p) != 0)
+	return -1;
+    }
+
+  return push_operator (p, tok.operator, NULL);
+}
+
 expression_t
-get_nth_level_expression (FILE * const stream, const int n)
+next_expression (tokenizer_t * const t)
 {
-  switch (n)
+  struct parser p = {.operands = NULL };
+  bool operand = true;
+  int ret;
+
+  /* Operands and operators alternate, and the end may only follow an operand */
+  do
     {
-    case 0:
-      {
-	expression_t left = get_nth_level_expression (stream, n + 1);
-	token_t tok = next_token (stream);
-	if (tok.type != TOKEN_END)
-	  {
-	    expression_destroy (left);
-	    left.type = EXPRESSION_ERROR;
-	  }
-
-	return left;
-      }
-    case 1:
-      {
-	expression_t left = get_nth_level_expression (stream, n + 1);
-	if (errno || left.type == EXPRESSION_ERROR)
-	  return left;
-
-	token_t tok = next_token (stream);
-	if (tok.type == TOKEN_ARITHMETIC_OPERATOR &&
-	    (tok.operator== '+' || tok.operator == '-'))
-	  {
-	    expression_t right = get_nth_level_expression (stream, n);
-	    expression_t e;
-	    e.type = EXPRESSION_OPERATOR;
-	    e.operator = tok.operator;
-	    e.operands = malloc (2 * sizeof (*e.operands));
-	    if (!e.operands)
-	      {
-		expression_destroy (left);
-		expression_destroy (right);
-		e.type = EXPRESSION_ERROR;
-		return e;
-	      }
-	    e.operands[0] = left;
-	    e.operands[1] = right;
-
-	    return e;
-	  }
-	else
-	  {
-	    push_back_token (tok);
-	    return left;
-	  }
-      }
-    case 2:
-      {
-	expression_t left = get_nth_level_expression (stream, n + 1);
-	if (errno || left.type == EXPRESSION_ERROR)
-	  return left;
-
-	token_t tok = next_token (stream);
-	if (tok.type == TOKEN_ARITHMETIC_OPERATOR &&
-	    (tok.operator== '*' || tok.operator == '/'))
-	  {
-	    expression_t right = get_nth_level_expression (stream, n);
-	    expression_t e;
-	    e.type = EXPRESSION_OPERATOR;
-	    e.operator = tok.operator;
-	    e.operands = malloc (2 * sizeof (*e.operands));
-	    if (!e.operands)
-	      {
-		expression_destroy (left);
-		expression_destroy (right);
-		e.type = EXPRESSION_ERROR;
-		return e;
-	      }
-	    e.operands[0] = left;
-	    e.operands[1] = right;
-
-	    return e;
-	  }
-	else
-	  {
-	    push_back_token (tok);
-	    return left;
-	  }
-      }
-    case 3:
-      {
-	expression_t left = get_nth_level_expression (stream, n + 1);
-	if (errno || left.type == EXPRESSION_ERROR)
-	  return left;
-
-	token_t tok = next_token (stream);
-	if (tok.type == TOKEN_ARITHMETIC_OPERATOR && tok.operator == '^')
-	  {
-	    expression_t right = get_nth_level_expression (stream, n);
-	    expression_t e;
-	    e.type = EXPRESSION_OPERATOR;
-	    e.operator = tok.operator;
-	    e.operands = malloc (2 * sizeof (*e.operands));
-	    if (!e.operands)
-	      {
-		expression_destroy (left);
-		expression_destroy (right);
-		e.type = EXPRESSION_ERROR;
-		return e;
-	      }
-	    e.operands[0] = left;
-	    e.operands[1] = right;
-
-	    return e;
-	  }
-	else
-	  {
-	    push_back_token (tok);
-	    return left;
-	  }
-      }
-    case 4:
-      {
-	token_t tok = next_token (stream);
-	expression_t e;
-	switch (tok.type)
-	  {
-	  case TOKEN_NUMBER:
-	    e.type = EXPRESSION_NUMBER;
-	    e.d = tok.d;
-	    return e;
-	  case TOKEN_STRING:
-	    e.type = EXPRESSION_VARIABLE;
-	    e.s = tok.s;
-	    return e;
-	  case TOKEN_FUNCTION:
-	    e.type = EXPRESSION_FUNCTION;
-	    e.s = tok.s;
-	    expression_t operand = get_nth_level_expression (stream, n);
-	    if (operand.type == EXPRESSION_ERROR)
-	      {
-		free (e.s);
-		e.type = EXPRESSION_ERROR;
-		return e;
-	      }
-
-	    e.operands = malloc (sizeof (*e.operands));
-	    if (!e.operands)
-	      {
-		free (e.s);
-		expression_destroy (operand);
-		e.type = EXPRESSION_ERROR;
-		return e;
-	      }
-
-	    e.operands[0] = operand;
-
-	    return e;
-	  case TOKEN_ARITHMETIC_OPERATOR:
-	    if (tok.operator == '(')
-	      {
-		e = get_nth_level_expression (stream, 1);
-
-		if (e.type == EXPRESSION_ERROR)
-		  return e;
-
-		token_t paren = next_token (stream);
-		if (paren.type != TOKEN_ARITHMETIC_OPERATOR
-		    || paren.operator != ')')
-		  {
-		    token_destroy (paren);
-		    expression_destroy (e);
-		    e.type = EXPRESSION_ERROR;
-		  }
-
-		return e;
-	      }
-	    else if (tok.operator == '-')
-	      {
-		e.type = EXPRESSION_OPERATOR;
-		e.operator = 'N';
-
-		expression_t operand = get_nth_level_expression (stream, n);
-		if (operand.type == EXPRESSION_ERROR)
-		  {
-		    e.type = EXPRESSION_ERROR;
-		    return e;
-		  }
-
-		e.operands = malloc (sizeof (*e.operands));
-		if (!e.operands)
-		  {
-		    expression_destroy (operand);
-		    e.type = EXPRESSION_ERROR;
-		    return e;
-		  }
-
-		e.operands[0] = operand;
-
-		return e;
-	      }
-	    else
-	      {
-		e.type = EXPRESSION_ERROR;
-		return e;
-	      }
-
-	    break;
-	  case TOKEN_UNKNOWN:
-	  case TOKEN_ERROR:
-	  case TOKEN_END:
-	    e.type = EXPRESSION_ERROR;
-	    return e;
-	  }
-      }
+      const token_t tok = next_token (t);
+      ret = operand ? parse_operand (&p, tok) : parse_operator (&p, tok);
+      if (operand && ret == 1)
+	{
+	  operand = false;
+	  ret = 0;
+	}
+      else if (!operand && ret == 0)
+	operand = !(tok.type == TOKEN_ARITHMETIC_OPERATOR
+		    && tok.operator == ')');
     }
+  while (ret == 0);
+
+  while (ret == 1 && p.noperators > 0)
+    if (p.operators[p.noperators - 1].operator == '(' || reduce (&p) != 0)
+      ret = -1;
 
   expression_t e;
-  e.type = EXPRESSION_ERROR;
+  if (ret == 1 && p.noperands == 1)
+    e = p.operands[0];
+  else
+    {
+      for (size_t i = 0; i < p.noperands; ++i)
+	expression_destroy (p.operands[i]);
+      for (size_t i = 0; i < p.noperators; ++i)
+	free (p.operators[i].s);
+      e.type = EXPRESSION_ERROR;
+    }
+
+  free (p.operands);
+  free (p.operators);
   return e;
 }
 
 expression_t
-next_expression (FILE * const stream)
+parse_expression (const char *const s, const size_t len)
+{
+  tokenizer_t t;
+  tokenizer_init (&t, s, len);
+  return next_expression (&t);
+}
+
+expression_t
+parse_column_expression (const char *const s, const size_t len)
 {
-  return get_nth_level_expression (stream, 0);
+  tokenizer_t t;
+  tokenizer_init (&t, s, len);
+  t.long_names = true;
+  return next_expression (&t);
 }
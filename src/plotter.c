@@ -1,34 +1,77 @@
 #include "plotter.h"
+#include "stats.h"
+#include "timestamp.h"
+#include "pool.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <math.h>
 #include <stdbool.h>
-#include <assert.h>
+#include <errno.h>
 
-static int
-point_cmp (const void *const p1, const void *const p2)
+/* Plot areas with this many cells are drawn in bands of lines on nthreads threads */
+#define PLOT_BAND_CELLS (1 << 16)
+
+/* snprintf-style output: len keeps counting once size is exhausted */
+struct plot_buffer
 {
-  const point_t *const a1 = (const point_t *) p1;
-  const point_t *const a2 = (const point_t *) p2;
+  char *data;
+  size_t size;
+  size_t len;
+};
 
-  if (a1->y > a2->y)
-    return -1;
-  else if (a1->y == a2->y)
+static void
+buffer_write (struct plot_buffer *const b, const char *const s,
+	      const size_t n)
+{
+  if (b->len + 1 < b->size)
     {
-      if (a1->x < a2->x)
-	return -1;
-      else if (a1->x == a2->x)
-	return 0;
-      else
-	return 1;
+      const size_t room = b->size - b->len - 1;
+      memcpy (b->data + b->len, s, n < room ? n : room);
     }
+
+  b->len += n;
+}
+
+static inline void
+buffer_puts (struct plot_buffer *const b, const char *const s)
+{
+  buffer_write (b, s, strlen (s));
+}
+
+static inline void
+buffer_putc (struct plot_buffer *const b, const char c)
+{
+  buffer_write (b, &c, 1);
+}
+
+static void
+buffer_printf (struct plot_buffer *const b, const char *const format, ...)
+{
+  va_list ap;
+  va_start (ap, format);
+
+  int n;
+  if (b->len < b->size)
+    n = vsnprintf (b->data + b->len, b->size - b->len, format, ap);
   else
-    return 1;
+    n = vsnprintf (NULL, 0, format, ap);
+
+  va_end (ap);
+  if (n > 0)
+    b->len += n;
+}
+
+static void
+buffer_terminate (struct plot_buffer *const b)
+{
+  if (b->size > 0)
+    b->data[b->len < b->size ? b->len : b->size - 1] = '\0';
 }
 
 static void
-set_color (FILE * const stream, enum plot_color color)
+set_color (struct plot_buffer *const b, enum plot_color color)
 {
   char *color_code = NULL;
   switch (color)
@@ -88,73 +131,75 @@ set_color (FILE * const stream, enum plot_color color)
       break;
     }
 
-  fprintf (stream, "\033[%sm", color_code);
+  buffer_puts (b, "\033[");
+  buffer_puts (b, color_code);
+  buffer_putc (b, 'm');
 }
 
 static inline void
-print_top_left_corner (FILE * const stream)
+print_top_left_corner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x6c\033(B");
+  buffer_puts (b, "\033(0\x6c\033(B");
 }
 
 static inline void
-print_top_right_corner (FILE * const stream)
+print_top_right_corner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x6b\033(B");
+  buffer_puts (b, "\033(0\x6b\033(B");
 }
 
 static inline void
-print_bottom_left_corner (FILE * const stream)
+print_bottom_left_corner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x6d\033(B");
+  buffer_puts (b, "\033(0\x6d\033(B");
 }
 
 static inline void
-print_bottom_right_corner (FILE * const stream)
+print_bottom_right_corner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x6a\033(B");
+  buffer_puts (b, "\033(0\x6a\033(B");
 }
 
 static inline void
-print_double_adjoiner (FILE * const stream)
+print_double_adjoiner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x6e\033(B");
+  buffer_puts (b, "\033(0\x6e\033(B");
 }
 
 static inline void
-print_left_adjoiner (FILE * const stream)
+print_left_adjoiner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x75\033(B");
+  buffer_puts (b, "\033(0\x75\033(B");
 }
 
 static inline void
-print_right_adjoiner (FILE * const stream)
+print_right_adjoiner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x74\033(B");
+  buffer_puts (b, "\033(0\x74\033(B");
 }
 
 static inline void
-print_bottom_adjoiner (FILE * const stream)
+print_bottom_adjoiner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x77\033(B");
+  buffer_puts (b, "\033(0\x77\033(B");
 }
 
 static inline void
-print_top_adjoiner (FILE * const stream)
+print_top_adjoiner (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x76\033(B");
+  buffer_puts (b, "\033(0\x76\033(B");
 }
 
 static inline void
-print_horizontal_line (FILE * const stream)
+print_horizontal_line (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x71\033(B");
+  buffer_puts (b, "\033(0\x71\033(B");
 }
 
 static inline void
-print_vertical_line (FILE * const stream)
+print_vertical_line (struct plot_buffer *const b)
 {
-  fprintf (stream, "\033(0\x78\033(B");
+  buffer_puts (b, "\033(0\x78\033(B");
 }
 
 static inline double
@@ -205,195 +250,767 @@ x_should_draw_tick (const plot_info_t plot, const unsigned short column)
     || column == columns_left - 1;
 }
 
-static inline bool
-x_should_draw_point (const plot_info_t plot,
-		     const unsigned short row,
-		     const unsigned short column, const point_t point)
+bool
+plot_x_tick (const plot_info_t p, const unsigned short column)
 {
+  return x_should_draw_tick (p, column);
+}
 
-  const double mx = pow (10, plot.x_precision);
-  const double my = pow (10, plot.y_precision);
+bool
+plot_y_tick (const plot_info_t p, const unsigned short row)
+{
+  return row == 0 || row == p.nrows - 2 || y_should_draw_tick (p, row);
+}
 
-  const unsigned short rows_left = plot.nrows - 1;
-  const unsigned short columns_left = plot.ncolumns - 1;
+double
+plot_column_x (const plot_info_t p, const unsigned short column)
+{
+  return get_lower_x (p, column);
+}
+
+double
+plot_row_y (const plot_info_t p, const unsigned short row)
+{
+  return get_lower_y (p, row);
+}
 
-  const double lower_y = get_lower_y (plot, row);
-  const double upper_y = get_upper_y (plot, row);
+int
+plot_x_label (const plot_info_t p, const double x, char *const buf,
+	      const size_t size)
+{
+  if (p.x_time)
+    return timestamp_format (buf, size, x, p.x_min, p.x_max);
+  else if (p.x_log)
+    return snprintf (buf, size, "%.*g", p.x_precision, pow (10, x));
+  return snprintf (buf, size, "%.*f", p.x_precision, x);
+}
 
-  const double lower_x = get_lower_x (plot, column);
-  const double upper_x = get_upper_x (plot, column);
+/* Every time label for a span has the same length, one short of the width */
+unsigned short
+plot_x_label_width (const plot_info_t p)
+{
+  if (!p.x_time)
+    return p.x_number_width;
 
-  return floor (point.y * my) >= floor (lower_y * my)
-    && floor (point.x * mx) >= floor (lower_x * mx)
-    && (floor (point.x * mx) < floor (upper_x * mx)
-	|| (floor (point.x * mx) == floor (upper_x * mx)
-	    && column == columns_left - 1))
-    && (floor (point.y * my) < floor (upper_y * my)
-	|| (floor (point.y * my) == floor (upper_y * my)
-	    && row == rows_left - 1));
+  char label[64];
+  const int len = plot_x_label (p, p.x_min, label, sizeof label);
+  return len >= p.x_number_width ? len + 1 : p.x_number_width;
 }
 
-static inline bool
-y_should_skip_point (const plot_info_t plot,
-		     const unsigned short row, const point_t point)
+const char *
+plot_check_info (const plot_info_t p)
 {
-  const double my = pow (10, plot.y_precision);
-  const unsigned short rows_left = plot.nrows - 1;	/* -1 for the x-axis */
-  const double upper_y = get_upper_y (plot, row);
+  if (p.nxticks > p.ncolumns)
+    return "Error: too many x-ticks.\n";
+  else if (p.nyticks > p.nrows)
+    return "Error: too many y-ticks.\n";
+  else if (p.nxticks < 2)
+    return "Error: too few x-ticks.\n";
+  else if (p.nyticks < 2)
+    return "error: too few y-ticks.\n";
+
+  return NULL;
+}
+
+/* Returns the cell i with bounds[i] <= q < bounds[i + 1], where the last cell
+ * also takes its upper edge, or -1. estimate is only a starting point. */
+static inline long
+find_cell (const double *const bounds, const unsigned short n,
+	   const double q, const double estimate)
+{
+  long i = 0;
+  if (estimate >= n)
+    i = n - 1;
+  else if (estimate > 0)
+    i = (long) estimate;
+
+  while (i > 0 && bounds[i] > q)
+    --i;
+  while (i < n - 1 && bounds[i + 1] <= q)
+    ++i;
+
+  if (bounds[i] <= q && (q < bounds[i + 1]
+			 || (i == n - 1 && q == bounds[i + 1])))
+    return i;
+
+  return -1;
+}
+
+int
+plot_grid_init (plot_grid_t * const grid, const plot_info_t p)
+{
+  if (p.nrows < 2 || p.ncolumns < 2)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  grid->nrows = p.nrows - 1;	/* -1 for the x-axis */
+  grid->ncolumns = p.ncolumns - 1;
+  grid->x_scale = pow (10, p.x_precision);
+  grid->y_scale = pow (10, p.y_precision);
+  grid->x_min = p.x_min;
+  grid->y_min = p.y_min;
+  grid->x_step = (grid->ncolumns - 1) / (p.x_max - p.x_min);
+  grid->y_step = (grid->nrows - 1) / (p.y_max - p.y_min);
+  grid->lines = p.lines;
+  grid->pen_down = false;
+
+  grid->cells =
+    calloc ((size_t) grid->nrows * grid->ncolumns, sizeof (*grid->cells));
+  grid->x_bounds = malloc ((grid->ncolumns + 1) * sizeof (*grid->x_bounds));
+  grid->y_bounds = malloc ((grid->nrows + 1) * sizeof (*grid->y_bounds));
+  if (!grid->cells || !grid->x_bounds || !grid->y_bounds)
+    {
+      plot_grid_destroy (grid);
+      return -1;
+    }
+
+  for (unsigned int j = 0; j <= grid->ncolumns; ++j)
+    grid->x_bounds[j] = floor (get_lower_x (p, j) * grid->x_scale);
+  for (unsigned int i = 0; i <= grid->nrows; ++i)
+    grid->y_bounds[i] = floor (get_lower_y (p, i) * grid->y_scale);
+
+  return 0;
+}
 
-  return floor (point.y * my) >= floor (upper_y * my)
-    && !(row == rows_left - 1
-	 && floor (point.y * my) == floor (upper_y * my));
+/* Finds the cell holding the point, as plot_grid_add bins it */
+static inline bool
+locate (const plot_grid_t * const grid, const point_t point, long *const row,
+	long *const column)
+{
+  *row = find_cell (grid->y_bounds, grid->nrows,
+		    floor (point.y * grid->y_scale),
+		    (point.y - grid->y_min) * grid->y_step);
+  if (*row < 0)
+    return false;
+
+  *column = find_cell (grid->x_bounds, grid->ncolumns,
+		       floor (point.x * grid->x_scale),
+		       (point.x - grid->x_min) * grid->x_step);
+  return *column >= 0;
 }
 
+/* Clips t in [*t0, *t1] to where p * t <= q, as in Liang-Barsky */
 static inline bool
-past_end_point (const plot_info_t plot,
-		const unsigned short row, const point_t point)
+clip_edge (const double p, const double q, double *const t0,
+	   double *const t1)
 {
-  const double my = pow (10, plot.y_precision);
-  const double lower_y = get_lower_y (plot, row);
+  if (p == 0)
+    return q >= 0;
 
-  return floor (point.y * my) < floor (lower_y * my);
+  const double r = q / p;
+  if (p < 0)
+    {
+      if (r > *t1)
+	return false;
+      if (r > *t0)
+	*t0 = r;
+    }
+  else
+    {
+      if (r < *t0)
+	return false;
+      if (r < *t1)
+	*t1 = r;
+    }
+
+  return true;
 }
 
-static size_t
-draw_column (FILE * const stream,
-	     const plot_info_t plot,
-	     const point_t points[],
-	     const size_t npoints, const unsigned short row, size_t index)
+static inline long
+clamp_cell (const double coordinate, const unsigned short n)
 {
-  const unsigned short columns_left = plot.ncolumns - 1;
+  const double cell = floor (coordinate);
+  return cell < 0 ? 0 : cell > n - 1 ? n - 1 : (long) cell;
+}
+
+/* Marks the cells a Bresenham line passes through between the cells of a and
+ * b, once the segment is clipped to the plot area. Ends inside the plot area
+ * are already marked, and are given by their cells so the line meets them. */
+static void
+draw_line (plot_grid_t * const grid, const point_t a, const point_t b,
+	   const bool a_inside, long row, long column,
+	   const bool b_inside, long end_row, long end_column)
+{
+  const double u0 = (a.x - grid->x_min) * grid->x_step;
+  const double v0 = (a.y - grid->y_min) * grid->y_step;
+  const double du = (b.x - grid->x_min) * grid->x_step - u0;
+  const double dv = (b.y - grid->y_min) * grid->y_step - v0;
+
+  double t0 = 0, t1 = 1;
+  if (!clip_edge (-du, u0, &t0, &t1)
+      || !clip_edge (du, grid->ncolumns - u0, &t0, &t1)
+      || !clip_edge (-dv, v0, &t0, &t1)
+      || !clip_edge (dv, grid->nrows - v0, &t0, &t1))
+    return;
+
+  if (!a_inside)
+    {
+      column = clamp_cell (u0 + t0 * du, grid->ncolumns);
+      row = clamp_cell (v0 + t0 * dv, grid->nrows);
+    }
+  if (!b_inside)
+    {
+      end_column = clamp_cell (u0 + t1 * du, grid->ncolumns);
+      end_row = clamp_cell (v0 + t1 * dv, grid->nrows);
+    }
 
-  while (index < npoints && y_should_skip_point (plot, row, points[index]))
-    ++index;
+  const long dx = labs (end_column - column), sx = column < end_column ? 1 : -1;
+  const long dy = -labs (end_row - row), sy = row < end_row ? 1 : -1;
+  long error = dx + dy;
+  bool first = true;
 
-  for (unsigned short j = 0; j < columns_left; ++j)
+  for (;;)
     {
-      bool drew = false;
-      for (size_t i = index;
-	   i < npoints && !drew && !past_end_point (plot, row, points[i]);
-	   ++i)
-	if (x_should_draw_point (plot, row, j, points[i]))
-	  {
-	    set_color (stream, plot.mark_color);
-	    fputc (plot.mark_char, stream);
-	    drew = true;
-	  }
-
-      if (!drew)
-	fputc (' ', stream);
+      const bool last = column == end_column && row == end_row;
+      if (!(first && a_inside) && !(last && b_inside))
+	++grid->cells[row * grid->ncolumns + column];
+      if (last)
+	break;
+
+      first = false;
+      if (2 * error >= dy)
+	{
+	  error += dy;
+	  column += sx;
+	}
+      if (2 * error <= dx)
+	{
+	  error += dx;
+	  row += sy;
+	}
     }
+}
+
+size_t
+plot_grid_add (plot_grid_t * const grid, const point_t points[],
+	       const size_t npoints)
+{
+  size_t nbinned = 0;
+  long pen_row = -1, pen_column = -1;
+  bool pen_inside = grid->lines && grid->pen_down
+    && locate (grid, grid->pen, &pen_row, &pen_column);
+
+  for (size_t i = 0; i < npoints; ++i)
+    {
+      long row = -1, column = -1;
+      const bool inside = locate (grid, points[i], &row, &column);
+      if (inside)
+	{
+	  ++grid->cells[row * grid->ncolumns + column];
+	  ++nbinned;
+	}
+
+      if (!grid->lines)
+	continue;
+
+      /* Lines break at points that are not numbers */
+      if (!isfinite (points[i].x) || !isfinite (points[i].y))
+	{
+	  grid->pen_down = false;
+	  continue;
+	}
+
+      if (grid->pen_down)
+	draw_line (grid, grid->pen, points[i], pen_inside, pen_row,
+		   pen_column, inside, row, column);
 
-  fputc ('\n', stream);
+      grid->pen = points[i];
+      grid->pen_down = true;
+      pen_inside = inside;
+      pen_row = row;
+      pen_column = column;
+    }
 
-  return index;
+  return nbinned;
 }
 
 void
-plot (FILE * const stream, const plot_info_t p, point_t points[],
-      const size_t npoints)
+plot_grid_clear (plot_grid_t * const grid)
 {
-  if (p.nxticks > p.ncolumns)
+  memset (grid->cells, 0,
+	  (size_t) grid->nrows * grid->ncolumns * sizeof (*grid->cells));
+  grid->pen_down = false;
+}
+
+void
+plot_grid_destroy (plot_grid_t * const grid)
+{
+  free (grid->cells);
+  free (grid->x_bounds);
+  free (grid->y_bounds);
+  grid->cells = NULL;
+  grid->x_bounds = grid->y_bounds = NULL;
+}
+
+/* A cell shared by several series takes the mark of the first of them */
+static void
+draw_row (struct plot_buffer *const b, const struct plot_series series[],
+	  const size_t nseries, char marks[][16],
+	  const unsigned short row)
+{
+  const unsigned short ncolumns = series[0].grid->ncolumns;
+  const size_t offset = (size_t) row * ncolumns;
+
+  for (unsigned short j = 0; j < ncolumns; ++j)
     {
-      fputs ("Error: too many x-ticks.\n", stream);
-      return;
+      size_t s = 0;
+      while (s < nseries && !series[s].grid->cells[offset + j])
+	++s;
+
+      if (s < nseries)
+	buffer_puts (b, marks[s]);
+      else
+	buffer_putc (b, ' ');
     }
-  else if (p.nyticks > p.nrows)
+
+  buffer_putc (b, '\n');
+}
+
+/* What every line of the plot area needs, shared by the bands drawing them */
+struct plot_lines
+{
+  plot_info_t p;
+  const struct plot_series *series;
+  size_t nseries;
+  char (*marks)[16];
+  const char *ynformat, *ysformat;
+};
+
+/* Line i of nlines, counted from the top, with its y-label and the axis */
+static void
+draw_axis_line (struct plot_buffer *const b,
+		const struct plot_lines *const l, const unsigned short i,
+		const unsigned short nlines)
+{
+  const plot_info_t p = l->p;
+  const unsigned short rows_left = p.nrows - 1;
+
+  if (i == 0)
     {
-      fputs ("Error: too many y-ticks.\n", stream);
+      set_color (b, p.y_number_color);
+      buffer_printf (b, l->ynformat, p.y_max * 1.0);
+      set_color (b, p.axes_color);
+      print_top_left_corner (b);
+      draw_row (b, l->series, l->nseries, l->marks, rows_left - 1);
       return;
     }
-  else if (p.nxticks < 2)
+  else if (i == nlines - 1)
     {
-      fputs ("Error: too few x-ticks.\n", stream);
+      set_color (b, p.y_number_color);
+      buffer_printf (b, l->ynformat, p.y_min * 1.0);
+      set_color (b, p.axes_color);
+      print_right_adjoiner (b);
+      draw_row (b, l->series, l->nseries, l->marks, 0);
       return;
     }
-  else if (p.nyticks < 2)
+
+  if (y_should_draw_tick (p, p.nrows - i - 2))
     {
-      fputs ("error: too few y-ticks.\n", stream);
-      return;
+      set_color (b, p.y_number_color);
+      buffer_printf (b, l->ynformat, get_lower_y (p, rows_left - 1 - i));
+      set_color (b, p.axes_color);
+      print_right_adjoiner (b);
+    }
+  else
+    {
+      set_color (b, NO_COLOR);
+      buffer_printf (b, l->ysformat, " ");
+      set_color (b, p.axes_color);
+      print_vertical_line (b);
     }
-  char xnformat[20], ynformat[20], ysformat[20];
+  draw_row (b, l->series, l->nseries, l->marks, p.nrows - i - 2);
+}
+
+struct plot_band
+{
+  const struct plot_lines *lines;
+  unsigned short first, last, nlines;
+  struct plot_buffer b;
+};
+
+static void
+draw_band (void *const arg, const size_t worker)
+{
+  (void) worker;
+  struct plot_band *const band = arg;
+  for (unsigned short i = band->first; i < band->last; ++i)
+    draw_axis_line (&band->b, band->lines, i, band->nlines);
+}
+
+/* The bytes a line takes at most, unless its y-label outgrows y_number_width */
+static size_t
+line_bound (const struct plot_lines *const l)
+{
+  size_t mark = 1;
+  for (size_t s = 0; s < l->nseries; ++s)
+    if (strlen (l->marks[s]) > mark)
+      mark = strlen (l->marks[s]);
+
+  return 64 + l->p.y_number_width + (size_t) (l->p.ncolumns - 1) * mark;
+}
+
+/* Each band of lines is drawn on a thread into its own slice of one buffer,
+ * and the slices are then copied out in order. */
+static int
+draw_bands (struct plot_buffer *const b, const struct plot_lines *const l,
+	    const unsigned short nlines)
+{
+  const unsigned int nthreads = l->p.nthreads;
+  const size_t per_band = (nlines + 4 * nthreads - 1) / (4 * nthreads);
+  const size_t nbands = (nlines + per_band - 1) / per_band;
+  const size_t bound = line_bound (l);
+
+  struct plot_band *const bands = malloc (nbands * sizeof (*bands));
+  char *const slices = malloc (nlines * bound);
+  pool_t *const pool = bands && slices
+    ? pool_create (nthreads < nbands ? nthreads : nbands) : NULL;
+  if (!pool)
+    {
+      free (bands);
+      free (slices);
+      return -1;
+    }
+
+  for (size_t k = 0; k < nbands; ++k)
+    {
+      struct plot_band *const band = &bands[k];
+      band->lines = l;
+      band->nlines = nlines;
+      band->first = k * per_band;
+      band->last = k + 1 < nbands ? (k + 1) * per_band : nlines;
+      band->b.data = slices + band->first * bound;
+      band->b.size = (band->last - band->first) * bound;
+      band->b.len = 0;
+      if (pool_submit (pool, draw_band, band) != 0)
+	draw_band (band, 0);
+    }
+  pool_destroy (pool);
+
+  /* A band whose labels overflowed its slice is drawn again in place */
+  for (size_t k = 0; k < nbands; ++k)
+    if (bands[k].b.len < bands[k].b.size)
+      buffer_write (b, bands[k].b.data, bands[k].b.len);
+    else
+      for (unsigned short i = bands[k].first; i < bands[k].last; ++i)
+	draw_axis_line (b, l, i, nlines);
+
+  free (bands);
+  free (slices);
+  return 0;
+}
+
+static void
+draw_axis_lines (struct plot_buffer *const b,
+		 const struct plot_lines *const l, const unsigned short nlines)
+{
+  if (l->p.nthreads > 1
+      && (size_t) nlines * (l->p.ncolumns - 1) >= PLOT_BAND_CELLS
+      && draw_bands (b, l, nlines) == 0)
+    return;
+
+  for (unsigned short i = 0; i < nlines; ++i)
+    draw_axis_line (b, l, i, nlines);
+}
+
+ssize_t
+plot_render_series (char *const buf, const size_t size, const plot_info_t p,
+		    const struct plot_series series[], const size_t nseries)
+{
+  struct plot_buffer b = {.data = buf,.size = size,.len = 0 };
+
+  const char *const error = plot_check_info (p);
+  if (error)
+    {
+      buffer_puts (&b, error);
+      buffer_terminate (&b);
+      return b.len;
+    }
+  else if (nseries == 0 || nseries > PLOT_MAX_SERIES)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  for (size_t s = 0; s < nseries; ++s)
+    if (series[s].grid->nrows != p.nrows - 1
+	|| series[s].grid->ncolumns != p.ncolumns - 1)
+      {
+	errno = EINVAL;
+	return -1;
+      }
+
+  char ynformat[20], ysformat[20], xlabel[64];
+  const unsigned short xlabel_width = plot_x_label_width (p);
 
 
   // TODO: figure out string lengths
-  snprintf (xnformat, sizeof xnformat, "%%-%hu.%hulf", p.x_number_width,
-	    p.x_precision);
   snprintf (ynformat, sizeof ynformat, "%%%hu.%hulf", p.y_number_width,
 	    p.y_precision);
   snprintf (ysformat, sizeof ysformat, "%%%hus", p.y_number_width);
 
+  char marks[PLOT_MAX_SERIES][16];
+  for (size_t s = 0; s < nseries; ++s)
+    {
+      struct plot_buffer m = {.data = marks[s],.size = sizeof marks[s],.len = 0 };
+      set_color (&m, series[s].color);
+      buffer_putc (&m, p.mark_char);
+      buffer_terminate (&m);
+    }
 
   const unsigned short rows_left = p.nrows - 1;
   const unsigned short columns_left = p.ncolumns - 1;
 
-  qsort (points, npoints, sizeof *points, point_cmp);
-
-  set_color (stream, p.y_number_color);
-  fprintf (stream, ynformat, p.y_max * 1.0);
-  set_color (stream, p.axes_color);
-  print_top_left_corner (stream);
-  size_t index = draw_column (stream, p, points, npoints, rows_left - 1, 0);
-  for (unsigned short i = 1; i < rows_left - 1; ++i)
-    {
-      const double lower_y = get_lower_y (p, rows_left - 1 - i);
-      if (y_should_draw_tick (p, p.nrows - i - 2))
-	{
-	  set_color (stream, p.y_number_color);
-	  fprintf (stream, ynformat, lower_y);
-	  set_color (stream, p.axes_color);
-	  print_right_adjoiner (stream);
-	}
-      else
-	{
-	  set_color (stream, NO_COLOR);
-	  fprintf (stream, ysformat, " ");
-	  set_color (stream, p.axes_color);
-	  print_vertical_line (stream);
-	}
-      index =
-	draw_column (stream, p, points, npoints, p.nrows - i - 2, index);
-    }
-
-  set_color (stream, p.y_number_color);
-  fprintf (stream, ynformat, p.y_min * 1.0);
-  set_color (stream, p.axes_color);
-  print_right_adjoiner (stream);
-  index = draw_column (stream, p, points, npoints, 0, index);
+  const struct plot_lines lines = {
+    .p = p,.series = series,.nseries = nseries,.marks = marks,
+    .ynformat = ynformat,.ysformat = ysformat
+  };
+  draw_axis_lines (&b, &lines, rows_left < 2 ? 2 : rows_left);
 
-  set_color (stream, NO_COLOR);
-  fprintf (stream, ysformat, " ");
-  set_color (stream, p.axes_color);
-  print_bottom_left_corner (stream);
+  set_color (&b, NO_COLOR);
+  buffer_printf (&b, ysformat, " ");
+  set_color (&b, p.axes_color);
+  print_bottom_left_corner (&b);
 
-  set_color (stream, p.axes_color);
-  print_top_adjoiner (stream);
+  set_color (&b, p.axes_color);
+  print_top_adjoiner (&b);
   for (unsigned short i = 1; i < columns_left - 1; ++i)
     if (x_should_draw_tick (p, i))
-      print_top_adjoiner (stream);
+      print_top_adjoiner (&b);
     else
-      print_horizontal_line (stream);
-  print_bottom_right_corner (stream);
-  fputc ('\n', stream);
+      print_horizontal_line (&b);
+  print_bottom_right_corner (&b);
+  buffer_putc (&b, '\n');
 
-  set_color (stream, NO_COLOR);
-  fprintf (stream, ysformat, " ");
-  fputc (' ', stream);
+  set_color (&b, NO_COLOR);
+  buffer_printf (&b, ysformat, " ");
+  buffer_putc (&b, ' ');
   for (unsigned short i = 0; i < columns_left - 1; ++i)
     if (x_should_draw_tick (p, i))
       {
-	set_color (stream, p.x_number_color);
-	fprintf (stream, xnformat, get_lower_x (p, i));
-	i += p.x_number_width - 1;
+	set_color (&b, p.x_number_color);
+	plot_x_label (p, get_lower_x (p, i), xlabel, sizeof xlabel);
+	buffer_printf (&b, "%-*s", xlabel_width, xlabel);
+	i += xlabel_width - 1;
       }
     else
       {
-	set_color (stream, NO_COLOR);
-	fputc (' ', stream);
+	set_color (&b, NO_COLOR);
+	buffer_putc (&b, ' ');
       }
-  set_color (stream, p.x_number_color);
-  fprintf (stream, xnformat, get_lower_x (p, columns_left - 1));
+  set_color (&b, p.x_number_color);
+  plot_x_label (p, get_lower_x (p, columns_left - 1), xlabel, sizeof xlabel);
+  buffer_printf (&b, "%-*s", xlabel_width, xlabel);
+
+  buffer_putc (&b, '\n');
+  set_color (&b, NO_COLOR);
+
+  if (nseries > 1)
+    {
+      for (size_t s = 0; s < nseries; ++s)
+	{
+	  buffer_puts (&b, marks[s]);
+	  set_color (&b, NO_COLOR);
+	  buffer_printf (&b, " %s  ", series[s].name ? series[s].name : "");
+	}
+      buffer_putc (&b, '\n');
+    }
+
+  buffer_terminate (&b);
+  return b.len;
+}
+
+ssize_t
+plot_render_grid (char *const buf, const size_t size, const plot_info_t p,
+		  const plot_grid_t * const grid)
+{
+  const struct plot_series series = {.grid = grid,.color = p.mark_color };
+  return plot_render_series (buf, size, p, &series, 1);
+}
+
+ssize_t
+plot_render_diff (char *const buf, const size_t size, const plot_info_t p,
+		  const plot_grid_t * const prev, const plot_grid_t * const next)
+{
+  struct plot_buffer b = {.data = buf,.size = size,.len = 0 };
+
+  if (prev->nrows != next->nrows || prev->ncolumns != next->ncolumns
+      || next->nrows != p.nrows - 1 || next->ncolumns != p.ncolumns - 1)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  char mark[16];
+  struct plot_buffer m = {.data = mark,.size = sizeof mark,.len = 0 };
+  set_color (&m, p.mark_color);
+  buffer_putc (&m, p.mark_char);
+  buffer_terminate (&m);
+
+  /* Cells start after the y label and the axis; row 0 is on the last plot line */
+  const unsigned int first_column = p.y_number_width + 2;
+  for (unsigned short i = 0; i < next->nrows; ++i)
+    {
+      const unsigned short row = next->nrows - 1 - i;
+      const unsigned int *const before =
+	prev->cells + (size_t) row * prev->ncolumns;
+      const unsigned int *const after =
+	next->cells + (size_t) row * next->ncolumns;
+
+      /* The cursor advances by itself across a run of changed cells */
+      bool in_place = false;
+      for (unsigned short j = 0; j < next->ncolumns; ++j)
+	{
+	  if (!before[j] == !after[j])
+	    {
+	      in_place = false;
+	      continue;
+	    }
+
+	  if (!in_place)
+	    buffer_printf (&b, "\033[%u;%uH", i + 1u, first_column + j);
+	  if (after[j])
+	    buffer_puts (&b, mark);
+	  else
+	    buffer_putc (&b, ' ');
+	  in_place = true;
+	}
+    }
+
+  buffer_terminate (&b);
+  return b.len;
+}
+
+ssize_t
+plot_render (char *const buf, const size_t size, const plot_info_t p,
+	     const point_t points[], const size_t npoints)
+{
+  const char *const error = plot_check_info (p);
+  if (error)
+    return snprintf (buf, size, "%s", error);
+
+  plot_grid_t grid;
+  if (plot_grid_init (&grid, p) != 0)
+    return -1;
+
+  plot_grid_add (&grid, points, npoints);
+  const ssize_t len = plot_render_grid (buf, size, p, &grid);
+  plot_grid_destroy (&grid);
+
+  return len;
+}
+
+/* Enough for any frame of the plot's size, unless a label outgrows its width */
+static size_t
+frame_bound (const plot_info_t p, const struct plot_series series[],
+	     const size_t nseries)
+{
+  size_t bound = (size_t) (p.nrows + 2)
+    * (80 + 2 * (p.x_number_width + p.y_number_width) + 16 * p.ncolumns);
+  for (size_t s = 0; s < nseries; ++s)
+    bound += 32 + (series[s].name ? strlen (series[s].name) : 0);
+
+  return bound;
+}
+
+void
+plot_write_series (FILE * const stream, const plot_info_t p,
+		   const struct plot_series series[], const size_t nseries,
+		   stats_t * const stats)
+{
+  /* Large frames are rendered straight into a buffer of the bound rather than
+   * measured first and rendered twice */
+  char small[16384];
+  char *frame = small;
+  size_t size = sizeof small;
+  const size_t bound = frame_bound (p, series, nseries);
+  if (bound > sizeof small && (frame = malloc (bound)))
+    size = bound;
+  else
+    frame = small;
+
+  ssize_t len = plot_render_series (frame, size, p, series, nseries);
+  if (frame != small && (len < 0 || (size_t) len >= size))
+    {
+      free (frame);
+      frame = small;
+    }
+
+  if (len < 0)
+    {
+      fputs ("Error: could not render plot.\n", stream);
+      return;
+    }
+  else if ((size_t) len >= size)
+    {
+      frame = malloc (len + 1);
+      if (!frame)
+	{
+	  fputs ("Error: out of memory.\n", stream);
+	  return;
+	}
+
+      plot_render_series (frame, len + 1, p, series, nseries);
+    }
+  stats_end (stats, STATS_RENDER);
+
+  fwrite (frame, 1, len, stream);
+  fflush (stream);
+  stats_end (stats, STATS_WRITE);
+
+  if (stats)
+    stats->bytes_emitted += len;
+  if (frame != small)
+    free (frame);
+}
+
+static void
+write_grid (FILE * const stream, const plot_info_t p,
+	    const plot_grid_t * const grid, stats_t * const stats)
+{
+  const struct plot_series series = {.grid = grid,.color = p.mark_color };
+  plot_write_series (stream, p, &series, 1, stats);
+}
+
+void
+plot_write_grid (FILE * const stream, const plot_info_t p,
+		 const plot_grid_t * const grid)
+{
+  write_grid (stream, p, grid, NULL);
+}
 
-  fputc ('\n', stream);
-  set_color (stream, NO_COLOR);
+void
+plot_stats (FILE * const stream, const plot_info_t p, const point_t points[],
+	    const size_t npoints, stats_t * const stats)
+{
+  const char *const error = plot_check_info (p);
+  if (error)
+    {
+      fputs (error, stream);
+      return;
+    }
+
+  stats_begin (stats);
+  plot_grid_t grid;
+  if (plot_grid_init (&grid, p) != 0)
+    {
+      fputs ("Error: out of memory.\n", stream);
+      return;
+    }
+
+  const size_t nbinned = plot_grid_add (&grid, points, npoints);
+  if (stats)
+    stats->points_dropped += npoints - nbinned;
+  stats_end (stats, STATS_BIN);
+
+  write_grid (stream, p, &grid, stats);
+  plot_grid_destroy (&grid);
+}
+
+void
+plot (FILE * const stream, const plot_info_t p, const point_t points[],
+      const size_t npoints)
+{
+  plot_stats (stream, p, points, npoints, NULL);
 }
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include "csv.h"
+#include "points.h"
+
+/* "x y" pairs are read as delimited text split at blanks, one pair a line */
+point_t *
+read_points (FILE * const in, size_t * npoints)
+{
+  struct csv_format format;
+  csv_format_init (&format);
+  format.delimiter = ' ';
+
+  size_t nmalformed;
+  return csv_read_points (in, format, npoints, &nmalformed);
+}
+
+double
+find_x_min (const point_t * const points, const size_t npoints)
+{
+  if (npoints > 0)
+    {
+      double min = points[0].x;
+      for (size_t i = 1; i < npoints; ++i)
+	min = (points[i].x < min) ? points[i].x : min;
+
+      return min;
+    }
+
+  return -10;
+}
+
+double
+find_x_max (const point_t * const points, const size_t npoints)
+{
+  if (npoints > 0)
+    {
+      double max = points[0].x;
+      for (size_t i = 1; i < npoints; ++i)
+	max = (points[i].x > max) ? points[i].x : max;
+
+      return max;
+    }
+
+  return 10;
+}
+
+double
+find_y_min (const point_t * const points, const size_t npoints)
+{
+  if (npoints > 0)
+    {
+      double min = points[0].y;
+      for (size_t i = 1; i < npoints; ++i)
+	min = (points[i].y < min) ? points[i].y : min;
+
+      return min;
+    }
+
+  return -10;
+}
+
+double
+find_y_max (const point_t * const points, const size_t npoints)
+{
+  if (npoints > 0)
+    {
+      double max = points[0].y;
+      for (size_t i = 1; i < npoints; ++i)
+	max = (points[i].y > max) ? points[i].y : max;
+
+      return max;
+    }
+
+  return 10;
+}
+
+size_t
+parse_points (const char *s, point_t ** const points, size_t * const size)
+{
+  size_t index = 0;
+  for (;;)
+    {
+      char *end;
+      point_t p;
+
+      p.x = strtod (s, &end);
+      if (end == s)
+	break;
+      s = end;
+
+      p.y = strtod (s, &end);
+      if (end == s)
+	break;
+      s = end;
+
+      if (index == *size)
+	{
+	  const size_t new_size = *size ? 2 * *size : 64;
+	  point_t *const buf = realloc (*points, new_size * sizeof (**points));
+	  if (!buf)
+	    break;
+	  *points = buf;
+	  *size = new_size;
+	}
+      (*points)[index++] = p;
+    }
+
+  return index;
+}
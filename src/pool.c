@@ -0,0 +1,160 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "pool.h"
+
+struct pool_job
+{
+  pool_task_t task;
+  void *arg;
+  struct pool_job *next;
+};
+
+struct pool_worker
+{
+  pool_t *pool;
+  size_t index;
+  pthread_t thread;
+};
+
+struct pool
+{
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready;
+  pthread_cond_t idle;
+
+  struct pool_job *head, *tail;
+  size_t nbusy;
+  bool stopping;
+
+  size_t nworkers;
+  struct pool_worker *workers;
+};
+
+static void *
+work (void *const arg)
+{
+  struct pool_worker *const worker = arg;
+  pool_t *const pool = worker->pool;
+
+  pthread_mutex_lock (&pool->lock);
+  for (;;)
+    {
+      while (!pool->head && !pool->stopping)
+	pthread_cond_wait (&pool->job_ready, &pool->lock);
+
+      struct pool_job *const job = pool->head;
+      if (!job)
+	break;
+
+      pool->head = job->next;
+      if (!pool->head)
+	pool->tail = NULL;
+      ++pool->nbusy;
+      pthread_mutex_unlock (&pool->lock);
+
+      job->task (job->arg, worker->index);
+      free (job);
+
+      pthread_mutex_lock (&pool->lock);
+      if (--pool->nbusy == 0 && !pool->head)
+	pthread_cond_broadcast (&pool->idle);
+    }
+  pthread_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+pool_t *
+pool_create (const size_t nworkers)
+{
+  pool_t *const pool = calloc (1, sizeof (*pool));
+  if (!pool)
+    return NULL;
+
+  pool->workers = calloc (nworkers ? nworkers : 1, sizeof (*pool->workers));
+  if (!pool->workers)
+    {
+      free (pool);
+      return NULL;
+    }
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->job_ready, NULL);
+  pthread_cond_init (&pool->idle, NULL);
+
+  for (size_t i = 0; i < (nworkers ? nworkers : 1); ++i)
+    {
+      pool->workers[i].pool = pool;
+      pool->workers[i].index = i;
+      const int err = pthread_create (&pool->workers[i].thread, NULL, work,
+				      &pool->workers[i]);
+      if (err)
+	{
+	  pool_destroy (pool);
+	  errno = err;
+	  return NULL;
+	}
+      ++pool->nworkers;
+    }
+
+  return pool;
+}
+
+size_t
+pool_size (const pool_t * const pool)
+{
+  return pool->nworkers;
+}
+
+int
+pool_submit (pool_t * const pool, const pool_task_t task, void *const arg)
+{
+  struct pool_job *const job = malloc (sizeof (*job));
+  if (!job)
+    return -1;
+
+  job->task = task;
+  job->arg = arg;
+  job->next = NULL;
+
+  pthread_mutex_lock (&pool->lock);
+  if (pool->tail)
+    pool->tail->next = job;
+  else
+    pool->head = job;
+  pool->tail = job;
+  pthread_cond_signal (&pool->job_ready);
+  pthread_mutex_unlock (&pool->lock);
+
+  return 0;
+}
+
+void
+pool_wait (pool_t * const pool)
+{
+  pthread_mutex_lock (&pool->lock);
+  while (pool->head || pool->nbusy)
+    pthread_cond_wait (&pool->idle, &pool->lock);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/* Queued tasks still run before the workers exit. */
+void
+pool_destroy (pool_t * const pool)
+{
+  pthread_mutex_lock (&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast (&pool->job_ready);
+  pthread_mutex_unlock (&pool->lock);
+
+  for (size_t i = 0; i < pool->nworkers; ++i)
+    pthread_join (pool->workers[i].thread, NULL);
+
+  pthread_mutex_destroy (&pool->lock);
+  pthread_cond_destroy (&pool->job_ready);
+  pthread_cond_destroy (&pool->idle);
+  free (pool->workers);
+  free (pool);
+}
@@ -0,0 +1,240 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pyramid.h"
+
+static int
+compare_x (const void *const a, const void *const b)
+{
+  const double x1 = ((const point_t *) a)->x;
+  const double x2 = ((const point_t *) b)->x;
+  return (x1 > x2) - (x1 < x2);
+}
+
+int
+pyramid_build (pyramid_t * const pyramid, point_t points[],
+	       const size_t npoints)
+{
+  memset (pyramid, 0, sizeof *pyramid);
+
+  /* NaNs have no place in the order. Series usually come sorted already. */
+  size_t n = 0;
+  bool sorted = true;
+  for (size_t i = 0; i < npoints; ++i)
+    if (!isnan (points[i].x))
+      {
+	if (n > 0 && points[i].x < points[n - 1].x)
+	  sorted = false;
+	points[n++] = points[i];
+      }
+  if (!sorted)
+    qsort (points, n, sizeof (*points), compare_x);
+
+  pyramid->points = points;
+  pyramid->npoints = n;
+
+  const size_t nblocks = (n + PYRAMID_BLOCK - 1) / PYRAMID_BLOCK;
+  for (size_t m = nblocks; m > 0; m = m > 1 ? (m + 1) / 2 : 0)
+    ++pyramid->nlevels;
+  if (pyramid->nlevels == 0)
+    return 0;
+
+  pyramid->levels = calloc (pyramid->nlevels, sizeof (*pyramid->levels));
+  if (!pyramid->levels)
+    return -1;
+
+  size_t m = nblocks;
+  for (unsigned int l = 0; l < pyramid->nlevels; ++l, m = (m + 1) / 2)
+    {
+      struct pyramid_level *const level = &pyramid->levels[l];
+      level->n = m;
+      level->y_min = malloc (m * sizeof (*level->y_min));
+      level->y_max = malloc (m * sizeof (*level->y_max));
+      if (!level->y_min || !level->y_max)
+	{
+	  pyramid_destroy (pyramid);
+	  errno = ENOMEM;
+	  return -1;
+	}
+
+      /* y-values that are not numbers are never lower or higher */
+      for (size_t k = 0; k < m; ++k)
+	{
+	  double lo = INFINITY, hi = -INFINITY;
+	  if (l == 0)
+	    {
+	      const size_t end = (k + 1) * PYRAMID_BLOCK < n
+		? (k + 1) * PYRAMID_BLOCK : n;
+	      for (size_t i = k * PYRAMID_BLOCK; i < end; ++i)
+		{
+		  lo = points[i].y < lo ? points[i].y : lo;
+		  hi = points[i].y > hi ? points[i].y : hi;
+		}
+	    }
+	  else
+	    {
+	      const struct pyramid_level *const below = level - 1;
+	      for (size_t b = 2 * k; b < 2 * k + 2 && b < below->n; ++b)
+		{
+		  lo = below->y_min[b] < lo ? below->y_min[b] : lo;
+		  hi = below->y_max[b] > hi ? below->y_max[b] : hi;
+		}
+	    }
+
+	  level->y_min[k] = lo;
+	  level->y_max[k] = hi;
+	}
+    }
+
+  return 0;
+}
+
+void
+pyramid_destroy (pyramid_t * const pyramid)
+{
+  for (unsigned int l = 0; pyramid->levels && l < pyramid->nlevels; ++l)
+    {
+      free (pyramid->levels[l].y_min);
+      free (pyramid->levels[l].y_max);
+    }
+
+  free (pyramid->levels);
+  pyramid->levels = NULL;
+  pyramid->nlevels = 0;
+}
+
+/* The first point with an x of at least x */
+static size_t
+lower_bound (const pyramid_t * const pyramid, const double x)
+{
+  size_t lo = 0, hi = pyramid->npoints;
+  while (lo < hi)
+    {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (pyramid->points[mid].x < x)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+static inline void
+take (struct pyramid_extent *const e, const double lo, const double hi)
+{
+  e->y_min = lo < e->y_min ? lo : e->y_min;
+  e->y_max = hi > e->y_max ? hi : e->y_max;
+}
+
+/* Points i to j are taken one by one up to the first whole block and back
+ * from the last, and then level by level from the blocks between: a block
+ * that is the second of its pair, or the first at the end, is taken whole,
+ * and the rest are left to their parents. */
+static struct pyramid_extent
+extent_of (const pyramid_t * const pyramid, size_t i, size_t j)
+{
+  struct pyramid_extent e = {
+    .count = j > i ? j - i : 0,.y_min = INFINITY,.y_max = -INFINITY
+  };
+  const point_t *const points = pyramid->points;
+
+  for (; i < j && i % PYRAMID_BLOCK; ++i)
+    take (&e, points[i].y, points[i].y);
+  if (i >= j)
+    return e;
+
+  /* The last block may be short, and then is whole if it ends at j */
+  size_t bj;
+  if (j == pyramid->npoints)
+    bj = pyramid->levels[0].n;
+  else
+    {
+      for (; j > i && j % PYRAMID_BLOCK; --j)
+	take (&e, points[j - 1].y, points[j - 1].y);
+      bj = j / PYRAMID_BLOCK;
+    }
+
+  size_t bi = i / PYRAMID_BLOCK;
+  for (unsigned int l = 0; bi < bj && l < pyramid->nlevels; ++l)
+    {
+      const struct pyramid_level *const level = &pyramid->levels[l];
+      if (bi & 1)
+	{
+	  take (&e, level->y_min[bi], level->y_max[bi]);
+	  ++bi;
+	}
+      if (bj & 1)
+	{
+	  --bj;
+	  take (&e, level->y_min[bj], level->y_max[bj]);
+	}
+      bi /= 2;
+      bj /= 2;
+    }
+
+  return e;
+}
+
+struct pyramid_extent
+pyramid_extent (const pyramid_t * const pyramid, const double x0,
+		const double x1)
+{
+  return extent_of (pyramid, lower_bound (pyramid, x0),
+		    lower_bound (pyramid, x1));
+}
+
+size_t
+pyramid_view (const pyramid_t * const pyramid, plot_grid_t * const grid,
+	      const plot_info_t p)
+{
+  plot_grid_clear (grid);
+
+  /* Beyond this many points, a column could not show them apart anyway */
+  const size_t sparse = 2 * (size_t) grid->nrows;
+  const size_t first = lower_bound (pyramid, plot_column_x (p, 0));
+
+  size_t i = first;
+  for (unsigned short c = 0; c < grid->ncolumns; ++c)
+    {
+      const size_t j = lower_bound (pyramid, plot_column_x (p, c + 1));
+      if (j - i <= sparse)
+	{
+	  plot_grid_add (grid, pyramid->points + i, j - i);
+	  i = j;
+	  continue;
+	}
+
+      const struct pyramid_extent e = extent_of (pyramid, i, j);
+      if (!(e.y_max >= p.y_min && e.y_min <= p.y_max))
+	{
+	  i = j;
+	  continue;
+	}
+
+      /* Both ends are binned as points would be, and the cells between are
+       * filled in */
+      const point_t ends[2] = {
+	{pyramid->points[i].x, e.y_min > p.y_min ? e.y_min : p.y_min},
+	{pyramid->points[i].x, e.y_max < p.y_max ? e.y_max : p.y_max}
+      };
+      plot_grid_add (grid, ends, 2);
+
+      long low = -1, high = -1;
+      for (long r = 0; r < grid->nrows; ++r)
+	if (grid->cells[(size_t) r * grid->ncolumns + c])
+	  {
+	    low = low < 0 ? r : low;
+	    high = r;
+	  }
+      for (long r = low; low >= 0 && r <= high; ++r)
+	if (!grid->cells[(size_t) r * grid->ncolumns + c])
+	  grid->cells[(size_t) r * grid->ncolumns + c] = 1;
+
+      i = j;
+    }
+
+  return i - first;
+}
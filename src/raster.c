@@ -0,0 +1,420 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+#include "raster.h"
+
+#define BAND_ROWS 64
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 7
+
+/* xterm's palette, in enum plot_color order; NO_COLOR is the foreground */
+static const unsigned char colors[][3] = {
+  {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0}, {0, 0, 238},
+  {205, 0, 205}, {0, 205, 205}, {229, 229, 229}, {127, 127, 127},
+  {255, 0, 0}, {0, 255, 0}, {255, 255, 0}, {92, 92, 255}, {255, 0, 255},
+  {0, 255, 255}, {255, 255, 255}, {229, 229, 229}
+};
+
+/* Rows of 5x7 glyphs, most significant bit leftmost, for everything printf
+ * or a time may write in a tick label */
+static const struct glyph
+{
+  char c;
+  unsigned char rows[GLYPH_HEIGHT];
+} glyphs[] = {
+  {'0', {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}},
+  {'1', {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+  {'2', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}},
+  {'3', {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},
+  {'4', {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}},
+  {'5', {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},
+  {'6', {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}},
+  {'7', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+  {'8', {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}},
+  {'9', {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},
+  {'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}},
+  {'-', {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}},
+  {'+', {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}},
+  {'e', {0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E}},
+  {'i', {0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E}},
+  {'n', {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11}},
+  {'f', {0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08}},
+  {'a', {0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F}},
+  {':', {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}},
+};
+
+/* Pixels outside [x0, x1) x [y0, y1) are left alone */
+struct clip
+{
+  int x0, y0, x1, y1;
+};
+
+/* Where things go, in pixels; the plot area spans [left, right] x [top, bottom] */
+struct layout
+{
+  int scale;
+  int char_width, char_height;
+  int tick, thickness;
+  double left, right, top, bottom;
+};
+
+struct render
+{
+  raster_t *image;
+  plot_info_t plot;
+  const point_t *pixels;		/* the points, placed on the image */
+  size_t npoints;
+  bool lines;
+  struct layout l;
+};
+
+struct band
+{
+  const struct render *r;
+  int y0, y1;
+};
+
+static inline void
+blend (raster_t * const image, const int x, const int y,
+       const enum plot_color color, const double alpha)
+{
+  unsigned char *const pixel = image->pixels + 3 * ((size_t) y * image->width + x);
+  const int a = alpha * 256;
+  for (int i = 0; i < 3; ++i)
+    pixel[i] += ((colors[color][i] - pixel[i]) * a + 128) >> 8;
+}
+
+static inline void
+set_pixel (raster_t * const image, const int x, const int y,
+	   const enum plot_color color)
+{
+  memcpy (image->pixels + 3 * ((size_t) y * image->width + x), colors[color],
+	  3);
+}
+
+static void
+fill_rect (raster_t * const image, const struct clip *const clip, int x0,
+	   int y0, int x1, int y1, const enum plot_color color)
+{
+  x0 = x0 < clip->x0 ? clip->x0 : x0;
+  y0 = y0 < clip->y0 ? clip->y0 : y0;
+  x1 = x1 > clip->x1 ? clip->x1 : x1;
+  y1 = y1 > clip->y1 ? clip->y1 : y1;
+
+  for (int y = y0; y < y1; ++y)
+    for (int x = x0; x < x1; ++x)
+      memcpy (image->pixels + 3 * ((size_t) y * image->width + x),
+	      colors[color], 3);
+}
+
+static void
+draw_text (raster_t * const image, const struct clip *const clip,
+	   const struct layout *const l, int x, const int y,
+	   const char *text, const enum plot_color color)
+{
+  if (y >= clip->y1 || y + GLYPH_HEIGHT * l->scale <= clip->y0)
+    return;
+
+  for (; *text; ++text, x += l->char_width)
+    for (size_t g = 0; g < sizeof glyphs / sizeof glyphs[0]; ++g)
+      if (glyphs[g].c == *text)
+	{
+	  for (int row = 0; row < GLYPH_HEIGHT; ++row)
+	    for (int column = 0; column < GLYPH_WIDTH; ++column)
+	      if (glyphs[g].rows[row] & (0x10 >> column))
+		fill_rect (image, clip, x + column * l->scale,
+			   y + row * l->scale, x + (column + 1) * l->scale,
+			   y + (row + 1) * l->scale, color);
+	  break;
+	}
+}
+
+/* Coverage falls off over one pixel at the edge of the dot; pixels well
+ * inside it are set without taking a square root */
+static void
+draw_dot (raster_t * const image, const struct clip *const clip,
+	  const double cx, const double cy, const double radius,
+	  const enum plot_color color)
+{
+  const double reach = radius + 0.5;
+  const double inner = radius > 0.5 ? (radius - 0.5) * (radius - 0.5) : 0;
+  int x0 = floor (cx - reach), x1 = ceil (cx + reach) + 1;
+  int y0 = floor (cy - reach), y1 = ceil (cy + reach) + 1;
+  x0 = x0 < clip->x0 ? clip->x0 : x0;
+  y0 = y0 < clip->y0 ? clip->y0 : y0;
+  x1 = x1 > clip->x1 ? clip->x1 : x1;
+  y1 = y1 > clip->y1 ? clip->y1 : y1;
+
+  for (int y = y0; y < y1; ++y)
+    for (int x = x0; x < x1; ++x)
+      {
+	const double d2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+	if (d2 <= inner)
+	  set_pixel (image, x, y, color);
+	else if (d2 < reach * reach)
+	  blend (image, x, y, color, reach - sqrt (d2));
+      }
+}
+
+static inline double
+segment_distance (const double px, const double py, const double ax,
+		  const double ay, const double dx, const double dy,
+		  const double length2)
+{
+  double t = ((px - ax) * dx + (py - ay) * dy) / length2;
+  t = t < 0 ? 0 : t > 1 ? 1 : t;
+  const double ex = px - ax - t * dx, ey = py - ay - t * dy;
+  return sqrt (ex * ex + ey * ey);
+}
+
+/* Walks the segment along its major axis, shading the few pixels across it
+ * by their distance from it, so only pixels near the line are visited */
+static void
+draw_segment (raster_t * const image, const struct clip *const clip,
+	      const double ax, const double ay, const double bx,
+	      const double by, const double half_width,
+	      const enum plot_color color)
+{
+  const double dx = bx - ax, dy = by - ay;
+  const double length2 = dx * dx + dy * dy;
+  if (length2 == 0)
+    {
+      draw_dot (image, clip, ax, ay, half_width, color);
+      return;
+    }
+
+  const bool steep = fabs (dy) > fabs (dx);
+  const double reach = half_width + 0.5;
+  const double across = reach * M_SQRT2 + 1;
+
+  /* major runs along y for steep segments and along x otherwise */
+  const double a_major = steep ? ay : ax, b_major = steep ? by : bx;
+  const double a_minor = steep ? ax : ay, d_minor = steep ? dx : dy;
+  const double d_major = steep ? dy : dx;
+  const int clip_lo = steep ? clip->y0 : clip->x0;
+  const int clip_hi = steep ? clip->y1 : clip->x1;
+  const int minor_lo = steep ? clip->x0 : clip->y0;
+  const int minor_hi = steep ? clip->x1 : clip->y1;
+
+  double lo = fmin (a_major, b_major) - reach, hi = fmax (a_major, b_major) + reach;
+  lo = lo < clip_lo ? clip_lo : floor (lo);
+  hi = hi > clip_hi - 1 ? clip_hi - 1 : ceil (hi);
+
+  for (int major = lo; major <= hi; ++major)
+    {
+      double t = (major - a_major) / d_major;
+      t = t < 0 ? 0 : t > 1 ? 1 : t;
+      const double center = a_minor + t * d_minor;
+
+      int m0 = floor (center - across), m1 = ceil (center + across);
+      m0 = m0 < minor_lo ? minor_lo : m0;
+      m1 = m1 > minor_hi - 1 ? minor_hi - 1 : m1;
+      for (int minor = m0; minor <= m1; ++minor)
+	{
+	  const int x = steep ? minor : major, y = steep ? major : minor;
+	  const double coverage =
+	    reach - segment_distance (x, y, ax, ay, dx, dy, length2);
+	  if (coverage > 0)
+	    blend (image, x, y, color, coverage > 1 ? 1 : coverage);
+	}
+    }
+}
+
+static inline double
+to_x (const struct render *const r, const double x)
+{
+  return r->l.left + (x - r->plot.x_min) * (r->l.right - r->l.left)
+    / (r->plot.x_max - r->plot.x_min);
+}
+
+static inline double
+to_y (const struct render *const r, const double y)
+{
+  return r->l.bottom - (y - r->plot.y_min) * (r->l.bottom - r->l.top)
+    / (r->plot.y_max - r->plot.y_min);
+}
+
+static void
+draw_axes (const struct render *const r, const struct clip *const clip)
+{
+  raster_t *const image = r->image;
+  const plot_info_t p = r->plot;
+  const struct layout *const l = &r->l;
+  const int left = l->left, bottom = l->bottom;
+  const int th = l->thickness;
+  char label[64];
+
+  fill_rect (image, clip, left - th, l->top, left, bottom + th + 1,
+	     p.axes_color);
+  fill_rect (image, clip, left - th, bottom + 1, l->right + 1,
+	     bottom + th + 1, p.axes_color);
+
+  for (unsigned short row = 0; row < p.nrows - 1; ++row)
+    if (plot_y_tick (p, row))
+      {
+	const double value = plot_row_y (p, row);
+	const int y = lround (to_y (r, value));
+	fill_rect (image, clip, left - th - l->tick, y - th / 2,
+		   left - th, y - th / 2 + th, p.axes_color);
+
+	const int len = snprintf (label, sizeof label, "%.*f", p.y_precision,
+				  value);
+	draw_text (image, clip, l,
+		   left - th - l->tick - l->scale - len * l->char_width,
+		   y - GLYPH_HEIGHT * l->scale / 2, label, p.y_number_color);
+      }
+
+  const unsigned short columns_left = p.ncolumns - 1;
+  for (unsigned short column = 0; column < columns_left; ++column)
+    if (plot_x_tick (p, column))
+      {
+	const double value = plot_column_x (p, column);
+	const int x = lround (to_x (r, value));
+	fill_rect (image, clip, x - th / 2, bottom + th + 1,
+		   x - th / 2 + th, bottom + th + 1 + l->tick, p.axes_color);
+
+	plot_x_label (p, value, label, sizeof label);
+	draw_text (image, clip, l, x, bottom + th + l->tick + 2 * l->scale,
+		   label, p.x_number_color);
+
+	/* as on the terminal, a label hides the ticks it covers */
+	column += plot_x_label_width (p) - 1;
+      }
+}
+
+static void
+draw_band (void *const arg, const size_t worker)
+{
+  (void) worker;
+  const struct band *const band = arg;
+  const struct render *const r = band->r;
+  const struct layout *const l = &r->l;
+
+  const struct clip whole = { 0, band->y0, r->image->width, band->y1 };
+  draw_axes (r, &whole);
+
+  struct clip area = {
+    ceil (l->left), ceil (l->top), floor (l->right) + 1, floor (l->bottom) + 1
+  };
+  area.y0 = area.y0 < band->y0 ? band->y0 : area.y0;
+  area.y1 = area.y1 > band->y1 ? band->y1 : area.y1;
+  if (area.y0 >= area.y1)
+    return;
+
+  const double half_width = l->scale * 0.5;
+  const double radius = l->scale * 0.75;
+  const double margin = (r->lines ? half_width : radius) + 1;
+  const enum plot_color color = r->plot.mark_color;
+
+  const point_t *const pixels = r->pixels;
+  for (size_t i = 0; i < r->npoints; ++i)
+    {
+      const double x = pixels[i].x, y = pixels[i].y;
+
+      if (!r->lines)
+	{
+	  if (y + margin >= area.y0 && y - margin < area.y1)
+	    draw_dot (r->image, &area, x, y, radius, color);
+	}
+      else if (i > 0)
+	{
+	  const double px = pixels[i - 1].x, py = pixels[i - 1].y;
+	  if (fmax (py, y) + margin >= area.y0 && fmin (py, y) - margin < area.y1
+	      && isfinite (px) && isfinite (py) && isfinite (x) && isfinite (y))
+	    draw_segment (r->image, &area, px, py, x, y, half_width, color);
+	}
+    }
+}
+
+int
+raster_init (raster_t * const image, const unsigned int width,
+	     const unsigned int height)
+{
+  image->width = width;
+  image->height = height;
+  image->pixels = calloc ((size_t) width * height, 3);
+
+  return image->pixels ? 0 : -1;
+}
+
+void
+raster_destroy (raster_t * const image)
+{
+  free (image->pixels);
+  image->pixels = NULL;
+}
+
+int
+plot_raster (raster_t * const image, const plot_info_t p,
+	     const point_t points[], const size_t npoints, const bool lines,
+	     const unsigned int nthreads)
+{
+  struct render r = {
+    .image = image,.plot = p,.npoints = npoints,.lines = lines
+  };
+
+  /* Everything scales with the image, from a 5x7 font at 800x400 */
+  struct layout *const l = &r.l;
+  const unsigned int by_width = image->width / 800, by_height = image->height / 400;
+  l->scale = by_width < by_height ? by_width : by_height;
+  l->scale = l->scale < 1 ? 1 : l->scale;
+  l->char_width = (GLYPH_WIDTH + 1) * l->scale;
+  l->char_height = (GLYPH_HEIGHT + 2) * l->scale;
+  l->tick = 3 * l->scale;
+  l->thickness = l->scale;
+
+  l->left = (p.y_number_width + 1) * l->char_width + l->tick + l->thickness;
+  l->right =
+    (double) image->width - 1 - plot_x_label_width (p) * l->char_width;
+  l->top = l->char_height;
+  l->bottom = (double) image->height - 1 - l->thickness - l->tick
+    - 2 * l->char_height;
+
+  if (plot_check_info (p) || l->right - l->left < 2 || l->bottom - l->top < 2)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  memset (image->pixels, 0, (size_t) image->width * image->height * 3);
+
+  const size_t nbands = (image->height + BAND_ROWS - 1) / BAND_ROWS;
+  struct band *const bands = malloc (nbands * sizeof (*bands));
+  point_t *const pixels = malloc (npoints * sizeof (*pixels) + 1);
+  if (!bands || !pixels)
+    {
+      free (bands);
+      free (pixels);
+      return -1;
+    }
+
+  /* Every band looks at every point, so they are placed only once */
+  for (size_t i = 0; i < npoints; ++i)
+    {
+      pixels[i].x = to_x (&r, points[i].x);
+      pixels[i].y = to_y (&r, points[i].y);
+    }
+  r.pixels = pixels;
+
+  for (size_t i = 0; i < nbands; ++i)
+    {
+      bands[i].r = &r;
+      bands[i].y0 = i * BAND_ROWS;
+      bands[i].y1 = i + 1 == nbands ? (int) image->height
+	: (int) ((i + 1) * BAND_ROWS);
+    }
+
+  pool_t *const pool = nthreads > 1 ? pool_create (nthreads) : NULL;
+  for (size_t i = 0; i < nbands; ++i)
+    if (!pool || pool_submit (pool, draw_band, &bands[i]) != 0)
+      draw_band (&bands[i], 0);
+  if (pool)
+    pool_destroy (pool);
+
+  free (bands);
+  free (pixels);
+  return 0;
+}
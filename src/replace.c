@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+#include "replace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEMP_ATTEMPTS 100
+
+/* Fills the letters at the end of name from the process, the time and a
+ * count of calls, which differ between any two writers */
+static void
+fill_letters (char *const letters)
+{
+  static const char alphabet[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  static uint64_t calls;
+
+  struct timespec now;
+  clock_gettime (CLOCK_REALTIME, &now);
+  uint64_t v = (uint64_t) getpid () << 32 ^ (uint64_t) now.tv_sec << 30
+    ^ (uint64_t) now.tv_nsec
+    ^ __atomic_fetch_add (&calls, 1, __ATOMIC_RELAXED) * 0x9E3779B97F4A7C15ULL;
+
+  /* splitmix64's finalizer spreads every input bit over the letters */
+  v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  v = (v ^ (v >> 27)) * 0x94D049BB133111EBULL;
+  v ^= v >> 31;
+
+  for (int i = 0; i < REPLACE_TEMP_LETTERS; ++i, v /= sizeof alphabet - 1)
+    letters[i] = alphabet[v % (sizeof alphabet - 1)];
+}
+
+static int
+write_all (const int fd, const char *p, size_t n)
+{
+  while (n > 0)
+    {
+      const ssize_t written = write (fd, p, n);
+      if (written < 0 && errno == EINTR)
+	continue;
+      else if (written < 0)
+	return -1;
+
+      p += written;
+      n -= written;
+    }
+
+  return 0;
+}
+
+int
+replace_file (const char *const path, const struct iovec parts[],
+	      const size_t nparts)
+{
+  char *tmp_path;
+  if (asprintf (&tmp_path, "%s.%0*d", path, REPLACE_TEMP_LETTERS, 0) < 0)
+    return -1;
+
+  /* Unlike mkstemp, open leaves the mode to the umask */
+  char *const letters = tmp_path + strlen (tmp_path) - REPLACE_TEMP_LETTERS;
+  int fd = -1;
+  for (int attempt = 0; fd < 0 && attempt < TEMP_ATTEMPTS; ++attempt)
+    {
+      fill_letters (letters);
+      fd = open (tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+      if (fd < 0 && errno != EEXIST)
+	break;
+    }
+  if (fd < 0)
+    {
+      free (tmp_path);
+      return -1;
+    }
+
+  int ret = 0;
+  for (size_t i = 0; ret == 0 && i < nparts; ++i)
+    ret = write_all (fd, parts[i].iov_base, parts[i].iov_len);
+
+  if (close (fd) != 0)
+    ret = -1;
+
+  if (ret == 0 && rename (tmp_path, path) != 0)
+    ret = -1;
+
+  if (ret != 0)
+    {
+      const int saved_errno = errno;
+      unlink (tmp_path);
+      errno = saved_errno;
+    }
+
+  free (tmp_path);
+  return ret;
+}
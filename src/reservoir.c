@@ -0,0 +1,110 @@
+#include <math.h>
+#include <stdlib.h>
+#include "reservoir.h"
+
+/* splitmix64, so nearby seeds still give unrelated streams */
+static uint64_t
+next_random (reservoir_t * const r)
+{
+  uint64_t z = (r->random += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* Uniform in (0, 1), never 0, so its logarithm is finite */
+static double
+uniform (reservoir_t * const r)
+{
+  return ((next_random (r) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/* Moves w, the largest of k uniform keys in the sample, and the position of
+ * the next point whose key would be smaller than it */
+static void
+skip (reservoir_t * const r)
+{
+  r->w *= exp (log (uniform (r)) / r->k);
+
+  const double gap = floor (log (uniform (r)) / log1p (-r->w));
+  r->next += gap < (double) (UINT64_MAX / 2) ? (uint64_t) gap + 1
+    : UINT64_MAX / 2;
+}
+
+int
+reservoir_init (reservoir_t * const r, const size_t k, const uint64_t seed)
+{
+  r->items = malloc ((k ? k : 1) * sizeof (*r->items));
+  if (!r->items)
+    return -1;
+
+  r->k = k;
+  r->n = 0;
+  r->seen = 0;
+  r->random = seed;
+  r->w = 1;
+  r->next = k - 1;
+  return 0;
+}
+
+void
+reservoir_add (reservoir_t * const r, const point_t points[],
+	       const size_t npoints)
+{
+  if (r->k == 0)
+    {
+      r->seen += npoints;
+      return;
+    }
+
+  size_t i = 0;
+  for (; i < npoints && r->n < r->k; ++i)
+    {
+      const struct reservoir_item item = { r->seen + i, points[i] };
+      r->items[r->n++] = item;
+    }
+  if (r->n == r->k && r->seen + i > r->next)
+    skip (r);			/* the reservoir just filled */
+
+  /* Only the points skip lands on are looked at */
+  for (; r->next < r->seen + npoints; skip (r))
+    {
+      const struct reservoir_item item = {
+	r->next, points[r->next - r->seen]
+      };
+      r->items[next_random (r) % r->k] = item;
+    }
+
+  r->seen += npoints;
+}
+
+static int
+position_cmp (const void *const p1, const void *const p2)
+{
+  const uint64_t a = ((const struct reservoir_item *) p1)->position;
+  const uint64_t b = ((const struct reservoir_item *) p2)->position;
+  return (a > b) - (a < b);
+}
+
+point_t *
+reservoir_take (reservoir_t * const r, size_t *const npoints)
+{
+  point_t *const points = malloc ((r->n ? r->n : 1) * sizeof (*points));
+  if (!points)
+    return NULL;
+
+  qsort (r->items, r->n, sizeof (*r->items), position_cmp);
+  for (size_t i = 0; i < r->n; ++i)
+    points[i] = r->items[i].point;
+
+  *npoints = r->n;
+  r->n = 0;
+  return points;
+}
+
+void
+reservoir_destroy (reservoir_t * const r)
+{
+  free (r->items);
+  r->items = NULL;
+}
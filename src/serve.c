@@ -0,0 +1,550 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cplot.h"
+#include "input.h"
+#include "options.h"
+#include "pool.h"
+#include "serve.h"
+
+#define EXPRESSION_CACHE_SLOTS 256
+#define MAX_REQUEST_ARGS 128
+#define MAX_REQUEST_SIZE (256 * 1024 * 1024)
+/* A connection that sends or takes nothing for this long is closed, so idle
+ * clients cannot hold on to every worker */
+#define IDLE_TIMEOUT_SECONDS 10
+
+struct compiled_expression
+{
+  char *text;
+  expression_t exp;
+  unsigned int refs;
+};
+
+/* Buffers are kept between requests, so a warmed-up worker does not allocate. */
+struct serve_worker
+{
+  int fd;			/* connection being served, or -1 */
+
+  char *request;
+  size_t request_size;
+  point_t *points;
+  size_t points_size;
+  char *frame;
+  size_t frame_size;
+};
+
+struct server
+{
+  pthread_mutex_t lock;		/* guards everything below */
+  bool stopping;
+  struct compiled_expression *expressions[EXPRESSION_CACHE_SLOTS];
+  struct serve_worker *workers;
+  size_t nworkers;
+};
+
+struct connection
+{
+  struct server *server;
+  int fd;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void
+request_stop (const int signal)
+{
+  (void) signal;
+  stop_requested = 1;
+}
+
+static uint64_t
+hash_text (const char *const s)
+{
+  uint64_t h = 14695981039346656037ULL;	/* FNV-1a */
+  for (const unsigned char *c = (const unsigned char *) s; *c; ++c)
+    {
+      h ^= *c;
+      h *= 1099511628211ULL;
+    }
+
+  return h;
+}
+
+static void
+compiled_expression_destroy (struct compiled_expression *const c)
+{
+  expression_destroy (c->exp);
+  free (c->text);
+  free (c);
+}
+
+/* The cache is direct-mapped; an expression that collides replaces the old
+ * one, which lives on until its last user releases it. */
+static struct compiled_expression *
+acquire_expression (struct server *const s, const char *const text,
+		    char *const error, const size_t error_size)
+{
+  const size_t slot = hash_text (text) % EXPRESSION_CACHE_SLOTS;
+
+  pthread_mutex_lock (&s->lock);
+  struct compiled_expression *c = s->expressions[slot];
+  if (c && strcmp (c->text, text) == 0)
+    {
+      ++c->refs;
+      pthread_mutex_unlock (&s->lock);
+      return c;
+    }
+  pthread_mutex_unlock (&s->lock);
+
+  const expression_t exp = parse_expression (text, strlen (text));
+  if (!check_parser_errors (exp))
+    {
+      snprintf (error, error_size, "could not parse expression");
+      expression_destroy (exp);
+      return NULL;
+    }
+  else if (!check_variables (exp))
+    {
+      snprintf (error, error_size, "unknown variable in expression");
+      expression_destroy (exp);
+      return NULL;
+    }
+
+  c = malloc (sizeof (*c));
+  if (!c || !(c->text = strdup (text)))
+    {
+      snprintf (error, error_size, "%s", strerror (errno));
+      free (c);
+      expression_destroy (exp);
+      return NULL;
+    }
+  c->exp = exp;
+  c->refs = 2;			/* one for the cache, one for the caller */
+
+  pthread_mutex_lock (&s->lock);
+  struct compiled_expression *const old = s->expressions[slot];
+  s->expressions[slot] = c;
+  if (old && --old->refs == 0)
+    compiled_expression_destroy (old);
+  pthread_mutex_unlock (&s->lock);
+
+  return c;
+}
+
+static void
+release_expression (struct server *const s,
+		    struct compiled_expression *const c)
+{
+  pthread_mutex_lock (&s->lock);
+  if (--c->refs == 0)
+    compiled_expression_destroy (c);
+  pthread_mutex_unlock (&s->lock);
+}
+
+static int
+write_all (const int fd, const char *buf, size_t len)
+{
+  while (len > 0)
+    {
+      const ssize_t n = send (fd, buf, len, MSG_NOSIGNAL);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      buf += n;
+      len -= n;
+    }
+
+  return 0;
+}
+
+static int
+send_error (const int fd, const char *const message)
+{
+  char reply[512];
+  const int len = snprintf (reply, sizeof reply, "ERR %s\n", message);
+
+  return write_all (fd, reply, (size_t) len < sizeof reply ? (size_t) len
+		    : sizeof reply - 1);
+}
+
+static bool
+reserve_points (struct serve_worker *const w, const size_t npoints)
+{
+  if (npoints <= w->points_size)
+    return true;
+
+  point_t *const buf = realloc (w->points, npoints * sizeof (*buf));
+  if (!buf)
+    return false;
+
+  w->points = buf;
+  w->points_size = npoints;
+  return true;
+}
+
+static ssize_t
+render (struct serve_worker *const w, const plot_info_t p,
+	const point_t * const points, const size_t npoints)
+{
+  ssize_t len = plot_render (w->frame, w->frame_size, p, points, npoints);
+  if (len >= 0 && (size_t) len >= w->frame_size)
+    {
+      char *const buf = realloc (w->frame, len + 1);
+      if (!buf)
+	return -1;
+
+      w->frame = buf;
+      w->frame_size = len + 1;
+      len = plot_render (w->frame, w->frame_size, p, points, npoints);
+    }
+
+  return len;
+}
+
+/* request holds len bytes: the options line, the point lines and the empty line. */
+static int
+process_request (struct server *const s, struct serve_worker *const w,
+		 char *const request, const size_t len)
+{
+  char error[256];
+  char *argv[MAX_REQUEST_ARGS];
+
+  char *const newline = memchr (request, '\n', len);
+  *newline = '\0';
+  char *const body = newline + 1;
+  request[len - 1] = '\0';
+
+  const int argc = options_split (request, argv, MAX_REQUEST_ARGS);
+  if (argc < 0)
+    return send_error (w->fd, "malformed options line");
+
+  struct options o;
+  options_init (&o);
+  if (options_parse (&o, argc, argv, error, sizeof error) != 0)
+    return send_error (w->fd, error);
+  const char *const unsupported = options_job_unsupported (&o, true);
+  if (unsupported)
+    {
+      snprintf (error, sizeof error, "%s is not served", unsupported);
+      return send_error (w->fd, error);
+    }
+
+  point_t *points = w->points;
+  point_t *file_points = NULL;
+  size_t npoints = 0, nread;
+
+  switch (o.source)
+    {
+    case INPUT_EXPRESSION:
+      {
+	struct compiled_expression *const c =
+	  acquire_expression (s, o.expression, error, sizeof error);
+	if (!c)
+	  return send_error (w->fd, error);
+
+	npoints = samples_per_column (o.plot) * o.plot.ncolumns;
+	if (!reserve_points (w, npoints))
+	  {
+	    release_expression (s, c);
+	    return send_error (w->fd, strerror (errno));
+	  }
+
+	points = w->points;
+	sample_expression_math (c->exp, o.plot.x_min, o.plot.x_max, 0, o.math,
+				points, npoints);
+	struct expression_range range;
+	options_fit_expression (&o, c->exp, 0, &range);
+	release_expression (s, c);
+
+	o.x_min_set = true;
+	o.x_max_set = true;
+	break;
+      }
+    case INPUT_FILE:		/* refused by options_job_unsupported */
+      break;
+    case INPUT_STDIN:
+      {
+	if (!o.csv_set && o.sample == 0)
+	  {
+	    npoints = parse_points (body, &w->points, &w->points_size);
+	    points = w->points;
+	    break;
+	  }
+
+	/* delimited text and samples are read as from a file */
+	FILE *const in = fmemopen (body, strlen (body), "r");
+	if (!in)
+	  return send_error (w->fd, strerror (errno));
+
+	file_points = read_input (in, "request", &o, &npoints, &nread, NULL,
+				  NULL);
+	fclose (in);
+	if (!file_points)
+	  return send_error (w->fd, csv_strerror (&o.csv, errno));
+
+	points = file_points;
+	break;
+      }
+    }
+
+  options_fit_ranges (&o, points, npoints);
+  const ssize_t frame_len = render (w, o.plot, points, npoints);
+  free (file_points);
+
+  if (frame_len < 0)
+    return send_error (w->fd, strerror (errno));
+
+  char header[32];
+  const int header_len =
+    snprintf (header, sizeof header, "OK %zd\n", frame_len);
+  if (write_all (w->fd, header, header_len) != 0)
+    return -1;
+
+  return write_all (w->fd, w->frame, frame_len);
+}
+
+/* Returns the length of the first complete request in buf, or 0. *scanned
+ * remembers how far the search got, so each byte is looked at once. */
+static size_t
+find_request_end (const char *const buf, const size_t len,
+		  size_t *const scanned)
+{
+  const char *const newline = memchr (buf, '\n', len);
+  if (!newline)
+    return 0;
+
+  size_t start = newline - buf;
+  if (*scanned > start)
+    start = *scanned;
+
+  const char *const end = memmem (buf + start, len - start, "\n\n", 2);
+  if (end)
+    return end - buf + 2;
+
+  *scanned = len > 0 ? len - 1 : 0;
+  return 0;
+}
+
+static void
+handle_connection (void *const arg, const size_t worker)
+{
+  struct connection *const c = arg;
+  struct server *const s = c->server;
+  struct serve_worker *const w = &s->workers[worker];
+  const int fd = c->fd;
+  free (c);
+
+  pthread_mutex_lock (&s->lock);
+  const bool stopping = s->stopping;
+  if (!stopping)
+    w->fd = fd;
+  pthread_mutex_unlock (&s->lock);
+
+  const struct timeval timeout = {.tv_sec = IDLE_TIMEOUT_SECONDS };
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+
+  size_t len = 0;
+  size_t scanned = 0;
+  while (!stopping)
+    {
+      size_t end;
+      while ((end = find_request_end (w->request, len, &scanned)) == 0)
+	{
+	  if (len + 1 >= w->request_size)
+	    {
+	      const size_t size =
+		w->request_size ? 2 * w->request_size : 64 * 1024;
+	      char *const buf = size <= MAX_REQUEST_SIZE
+		? realloc (w->request, size) : NULL;
+	      if (!buf)
+		{
+		  send_error (fd, "request too large");
+		  goto done;
+		}
+	      w->request = buf;
+	      w->request_size = size;
+	    }
+
+	  const ssize_t n =
+	    read (fd, w->request + len, w->request_size - len - 1);
+	  if (n < 0 && errno == EINTR)
+	    continue;
+	  else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    {
+	      send_error (fd, "idle for too long");
+	      goto done;
+	    }
+	  else if (n <= 0)
+	    goto done;
+	  len += n;
+	}
+
+      if (process_request (s, w, w->request, end) != 0)
+	break;
+
+      memmove (w->request, w->request + end, len - end);
+      len -= end;
+      scanned = 0;
+    }
+
+done:
+  pthread_mutex_lock (&s->lock);
+  w->fd = -1;
+  pthread_mutex_unlock (&s->lock);
+  close (fd);
+}
+
+static int
+open_socket (const char *const path)
+{
+  struct sockaddr_un addr = {.sun_family = AF_UNIX };
+  if (strlen (path) >= sizeof addr.sun_path)
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+  strcpy (addr.sun_path, path);
+
+  const int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  /* Only a socket left behind by an earlier run is replaced; the socket
+   * itself is made reachable by its owner alone, whatever the umask. */
+  struct stat st;
+  if (lstat (path, &st) == 0 && !S_ISSOCK (st.st_mode))
+    {
+      close (fd);
+      errno = EEXIST;
+      return -1;
+    }
+  unlink (path);
+  if (bind (fd, (struct sockaddr *) &addr, sizeof addr) != 0
+      || chmod (path, 0600) != 0 || listen (fd, SOMAXCONN) != 0)
+    {
+      const int saved_errno = errno;
+      close (fd);
+      errno = saved_errno;
+      return -1;
+    }
+
+  return fd;
+}
+
+int
+serve (const char *const path, const unsigned int nthreads)
+{
+  const int listen_fd = open_socket (path);
+  if (listen_fd < 0)
+    {
+      perror (path);
+      return -1;
+    }
+
+  struct server s = {.stopping = false,.nworkers = nthreads };
+  pthread_mutex_init (&s.lock, NULL);
+  s.workers = calloc (nthreads, sizeof (*s.workers));
+  if (!s.workers)
+    {
+      perror ("");
+      close (listen_fd);
+      unlink (path);
+      return -1;
+    }
+  for (size_t i = 0; i < nthreads; ++i)
+    s.workers[i].fd = -1;
+
+  /* only the accepting thread should see the stop signals */
+  sigset_t stop_signals, old_mask;
+  sigemptyset (&stop_signals);
+  sigaddset (&stop_signals, SIGINT);
+  sigaddset (&stop_signals, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &stop_signals, &old_mask);
+  pool_t *const pool = pool_create (nthreads);
+  pthread_sigmask (SIG_SETMASK, &old_mask, NULL);
+
+  int ret = 0;
+  if (!pool)
+    {
+      perror ("");
+      ret = -1;
+      stop_requested = 1;
+    }
+
+  struct sigaction sa;
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = request_stop;	/* no SA_RESTART, so accept is interrupted */
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+
+  while (!stop_requested)
+    {
+      const int fd = accept4 (listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (fd < 0)
+	{
+	  if (errno == EINTR || errno == ECONNABORTED)
+	    continue;
+
+	  perror ("accept");
+	  ret = -1;
+	  break;
+	}
+
+      struct connection *const c = malloc (sizeof (*c));
+      if (!c)
+	{
+	  close (fd);
+	  continue;
+	}
+
+      c->server = &s;
+      c->fd = fd;
+      if (pool_submit (pool, handle_connection, c) != 0)
+	{
+	  free (c);
+	  close (fd);
+	}
+    }
+
+  pthread_mutex_lock (&s.lock);
+  s.stopping = true;
+  for (size_t i = 0; i < s.nworkers; ++i)
+    if (s.workers[i].fd >= 0)
+      shutdown (s.workers[i].fd, SHUT_RDWR);
+  pthread_mutex_unlock (&s.lock);
+
+  if (pool)
+    pool_destroy (pool);
+  close (listen_fd);
+  unlink (path);
+
+  for (size_t i = 0; i < EXPRESSION_CACHE_SLOTS; ++i)
+    if (s.expressions[i])
+      compiled_expression_destroy (s.expressions[i]);
+  for (size_t i = 0; i < s.nworkers; ++i)
+    {
+      free (s.workers[i].request);
+      free (s.workers[i].points);
+      free (s.workers[i].frame);
+    }
+  free (s.workers);
+  pthread_mutex_destroy (&s.lock);
+
+  return ret;
+}
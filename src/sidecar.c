@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include "sidecar.h"
+#include "replace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SIDECAR_MAGIC "CPLOTSC1"
+#define SIDECAR_SUFFIX ".cplot"
+
+struct sidecar_header
+{
+  char magic[8];
+  struct sidecar_identity identity;
+  uint64_t key_length;
+  uint64_t nrows, ncolumns;
+  double x_min, x_max, y_min, y_max;
+  uint64_t npoints, nbinned;
+};
+
+static inline size_t
+cells_offset (const size_t key_length)
+{
+  const size_t offset = sizeof (struct sidecar_header) + key_length;
+  return (offset + sizeof (uint64_t) - 1) & ~(sizeof (uint64_t) - 1);
+}
+
+static bool
+same_identity (const struct sidecar_identity *const a,
+	       const struct sidecar_identity *const b)
+{
+  return a->device == b->device && a->inode == b->inode
+    && a->size == b->size && a->mtime_sec == b->mtime_sec
+    && a->mtime_nsec == b->mtime_nsec;
+}
+
+char *
+sidecar_path (const char *const input)
+{
+  char *path;
+  if (asprintf (&path, "%s" SIDECAR_SUFFIX, input) < 0)
+    return NULL;
+
+  return path;
+}
+
+int
+sidecar_identify (const char *const input,
+		  struct sidecar_identity *const identity)
+{
+  struct stat st;
+  if (stat (input, &st) != 0)
+    return -1;
+
+  /* A FIFO or a device can give different data with the same identity */
+  if (!S_ISREG (st.st_mode))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  memset (identity, 0, sizeof *identity);
+  identity->device = st.st_dev;
+  identity->inode = st.st_ino;
+  identity->size = st.st_size;
+  identity->mtime_sec = st.st_mtim.tv_sec;
+  identity->mtime_nsec = st.st_mtim.tv_nsec;
+  return 0;
+}
+
+bool
+sidecar_load (const char *const path,
+	      const struct sidecar_identity *const identity,
+	      const char *const key, const unsigned short nrows,
+	      const unsigned short ncolumns, sidecar_t * const sidecar)
+{
+  const int fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  const size_t key_length = strlen (key);
+  const size_t ncells = (size_t) nrows * ncolumns;
+  struct stat st;
+  struct sidecar_header header;
+  bool hit = false;
+
+  if (fstat (fd, &st) == 0
+      && pread (fd, &header, sizeof header, 0) == sizeof header
+      && memcmp (header.magic, SIDECAR_MAGIC, sizeof header.magic) == 0
+      && same_identity (&header.identity, identity)
+      && header.key_length == key_length
+      && header.nrows == nrows && header.ncolumns == ncolumns
+      && (size_t) st.st_size ==
+      cells_offset (key_length) + ncells * sizeof (*sidecar->cells))
+    {
+      void *const map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+	{
+	  if (memcmp ((char *) map + sizeof header, key, key_length) == 0)
+	    {
+	      sidecar->map = map;
+	      sidecar->map_size = st.st_size;
+	      sidecar->cells = (const unsigned int *)
+		((char *) map + cells_offset (key_length));
+	      sidecar->x_min = header.x_min;
+	      sidecar->x_max = header.x_max;
+	      sidecar->y_min = header.y_min;
+	      sidecar->y_max = header.y_max;
+	      sidecar->npoints = header.npoints;
+	      sidecar->nbinned = header.nbinned;
+	      hit = true;
+	    }
+	  else
+	    munmap (map, st.st_size);
+	}
+    }
+
+  close (fd);
+  return hit;
+}
+
+int
+sidecar_store (const char *const path, const char *const input,
+	       const struct sidecar_identity *const identity,
+	       const char *const key, const plot_info_t p,
+	       const plot_grid_t * const grid, const size_t npoints,
+	       const size_t nbinned)
+{
+  /* The points may have come from a file changed while it was read */
+  struct sidecar_identity now;
+  if (sidecar_identify (input, &now) != 0)
+    return -1;
+  else if (!same_identity (&now, identity))
+    return 0;
+
+  struct sidecar_header header;
+  memset (&header, 0, sizeof header);
+  memcpy (header.magic, SIDECAR_MAGIC, sizeof header.magic);
+  header.identity = *identity;
+  header.key_length = strlen (key);
+  header.nrows = grid->nrows;
+  header.ncolumns = grid->ncolumns;
+  header.x_min = p.x_min;
+  header.x_max = p.x_max;
+  header.y_min = p.y_min;
+  header.y_max = p.y_max;
+  header.npoints = npoints;
+  header.nbinned = nbinned;
+
+  const char padding[sizeof (uint64_t)] = { 0 };
+  const size_t npadding =
+    cells_offset (header.key_length) - sizeof header - header.key_length;
+  const size_t cells_size =
+    (size_t) grid->nrows * grid->ncolumns * sizeof (*grid->cells);
+
+  const struct iovec parts[] = {
+    {&header, sizeof header},
+    {(char *) key, header.key_length},
+    {(char *) padding, npadding},
+    {grid->cells, cells_size}
+  };
+  return replace_file (path, parts, sizeof parts / sizeof *parts);
+}
+
+void
+sidecar_release (sidecar_t * const sidecar)
+{
+  munmap (sidecar->map, sidecar->map_size);
+  sidecar->map = NULL;
+  sidecar->cells = NULL;
+}
@@ -0,0 +1,311 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch.h"
+
+struct weighted
+{
+  double value;
+  size_t weight;
+};
+
+#define MIN_CAPACITY 8
+
+/* Levels further below the top hold fewer items, shrinking by 2/3 each */
+static void
+set_capacities (sketch_t * const s)
+{
+  s->compress_at = 0;
+  for (unsigned int h = 0; h < s->nlevels; ++h)
+    {
+      const double c = ceil (s->k * pow (2.0 / 3.0, s->nlevels - 1 - h));
+      s->levels[h].capacity = c < MIN_CAPACITY ? MIN_CAPACITY : (size_t) c;
+      s->compress_at += s->levels[h].capacity;
+    }
+}
+
+static bool
+random_bit (sketch_t * const s)
+{
+  /* xorshift64: the sketch need not be cryptographically random, only unbiased */
+  s->random ^= s->random << 13;
+  s->random ^= s->random >> 7;
+  s->random ^= s->random << 17;
+  return s->random & 1;
+}
+
+static int
+compare_doubles (const void *const a, const void *const b)
+{
+  const double x = *(const double *) a;
+  const double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* qsort's indirect comparisons dominate compaction, so doubles get their own
+ * quicksort, finishing small partitions by insertion */
+static void
+sort_doubles (double *const a, size_t n)
+{
+  size_t lo = 0;
+  while (n > 16)
+    {
+      const double pivot = a[lo + n / 2];
+      size_t i = lo, j = lo + n - 1;
+      for (;;)
+	{
+	  while (a[i] < pivot)
+	    ++i;
+	  while (a[j] > pivot)
+	    --j;
+	  if (i >= j)
+	    break;
+	  const double tmp = a[i];
+	  a[i++] = a[j];
+	  a[j--] = tmp;
+	}
+
+      /* recurse into the smaller side, loop on the larger */
+      const size_t left = j + 1 - lo, right = lo + n - (j + 1);
+      if (left < right)
+	{
+	  sort_doubles (a + lo, left);
+	  lo = j + 1;
+	  n = right;
+	}
+      else
+	{
+	  sort_doubles (a + j + 1, right);
+	  n = left;
+	}
+    }
+
+  for (size_t i = lo + 1; i < lo + n; ++i)
+    {
+      const double v = a[i];
+      size_t j = i;
+      for (; j > lo && a[j - 1] > v; --j)
+	a[j] = a[j - 1];
+      a[j] = v;
+    }
+}
+
+static int
+compare_weighted (const void *const a, const void *const b)
+{
+  return compare_doubles (&((const struct weighted *) a)->value,
+			  &((const struct weighted *) b)->value);
+}
+
+static int
+reserve (struct sketch_level *const l, const size_t n)
+{
+  if (l->n + n <= l->size)
+    return 0;
+
+  size_t size = l->size ? l->size : 8;
+  while (size < l->n + n)
+    size *= 2;
+
+  double *const items = realloc (l->items, size * sizeof (*items));
+  if (!items)
+    return -1;
+  l->items = items;
+  l->size = size;
+  return 0;
+}
+
+/* Merges sorted items into a sorted level, from the back so nothing moves twice */
+static int
+merge_sorted (struct sketch_level *const l, const double *const items,
+	      const size_t n)
+{
+  if (reserve (l, n) != 0)
+    return -1;
+
+  size_t i = l->n, j = n, out = l->n + n;
+  while (j > 0)
+    if (i > 0 && l->items[i - 1] > items[j - 1])
+      l->items[--out] = l->items[--i];
+    else
+      l->items[--out] = items[--j];
+  l->n += n;
+
+  return 0;
+}
+
+static int
+add_level (sketch_t * const s)
+{
+  struct sketch_level *const levels =
+    realloc (s->levels, (s->nlevels + 1) * sizeof (*levels));
+  if (!levels)
+    return -1;
+
+  s->levels = levels;
+  memset (&s->levels[s->nlevels++], 0, sizeof (*levels));
+  set_capacities (s);
+  return 0;
+}
+
+/* Halves the lowest level over its capacity into the one above, for as long
+ * as the sketch as a whole holds more than it may. Compacting lazily like
+ * this keeps the lower levels fuller, and the ranks more accurate. */
+static int
+compress (sketch_t * const s)
+{
+  while (s->nitems >= s->compress_at)
+    {
+      unsigned int h = 0;
+      while (s->levels[h].n < s->levels[h].capacity)
+	++h;
+
+      if (h + 1 == s->nlevels && add_level (s) != 0)
+	return -1;
+
+      /* Only level 0 is kept unsorted; the rest are merged into in order */
+      struct sketch_level *const l = &s->levels[h];
+      if (h == 0)
+	sort_doubles (l->items, l->n);
+
+      /* An odd item out stays behind, so the total weight is unchanged */
+      const size_t even = l->n & ~(size_t) 1;
+      const double left = l->items[l->n - 1];
+      size_t npromoted = 0;
+      for (size_t i = random_bit (s); i < even; i += 2)
+	l->items[npromoted++] = l->items[i];
+      if (merge_sorted (&s->levels[h + 1], l->items, npromoted) != 0)
+	return -1;
+
+      l->items[0] = left;
+      l->n -= even;
+      s->nitems -= even / 2;
+    }
+
+  return 0;
+}
+
+int
+sketch_init (sketch_t * const s, const unsigned int k)
+{
+  memset (s, 0, sizeof *s);
+  s->k = k < 8 ? 8 : k;
+  s->min = INFINITY;
+  s->max = -INFINITY;
+  s->random = 0x9e3779b97f4a7c15ULL;
+
+  return add_level (s);
+}
+
+int
+sketch_add (sketch_t * const s, const double value)
+{
+  if (isnan (value))
+    return 0;
+
+  struct sketch_level *const l = &s->levels[0];
+  if (reserve (l, 1) != 0)
+    return -1;
+
+  l->items[l->n++] = value;
+  ++s->nitems;
+  ++s->count;
+  if (value < s->min)
+    s->min = value;
+  if (value > s->max)
+    s->max = value;
+
+  return s->nitems >= s->compress_at ? compress (s) : 0;
+}
+
+int
+sketch_merge (sketch_t * const s, const sketch_t * const other)
+{
+  while (s->nlevels < other->nlevels)
+    if (add_level (s) != 0)
+      return -1;
+
+  for (unsigned int h = 0; h < other->nlevels; ++h)
+    {
+      const struct sketch_level *const from = &other->levels[h];
+      struct sketch_level *const to = &s->levels[h];
+      if (h > 0)
+	{
+	  if (merge_sorted (to, from->items, from->n) != 0)
+	    return -1;
+	}
+      else
+	{
+	  if (reserve (to, from->n) != 0)
+	    return -1;
+	  memcpy (to->items + to->n, from->items,
+		  from->n * sizeof (*from->items));
+	  to->n += from->n;
+	}
+      s->nitems += from->n;
+    }
+
+  s->count += other->count;
+  if (other->min < s->min)
+    s->min = other->min;
+  if (other->max > s->max)
+    s->max = other->max;
+
+  return compress (s);
+}
+
+double
+sketch_quantile (const sketch_t * const s, const double q)
+{
+  if (s->count == 0)
+    return NAN;
+  else if (q <= 0)
+    return s->min;
+  else if (q >= 1)
+    return s->max;
+
+  size_t nitems = 0;
+  for (unsigned int h = 0; h < s->nlevels; ++h)
+    nitems += s->levels[h].n;
+
+  struct weighted *const items = malloc (nitems * sizeof (*items));
+  if (!items)
+    return NAN;
+
+  size_t n = 0;
+  for (unsigned int h = 0; h < s->nlevels; ++h)
+    for (size_t i = 0; i < s->levels[h].n; ++i, ++n)
+      {
+	items[n].value = s->levels[h].items[i];
+	items[n].weight = (size_t) 1 << h;
+      }
+  qsort (items, nitems, sizeof (*items), compare_weighted);
+
+  const double rank = q * s->count;
+  size_t seen = 0;
+  double value = s->max;
+  for (size_t i = 0; i < nitems; ++i)
+    {
+      seen += items[i].weight;
+      if (seen >= rank)
+	{
+	  value = items[i].value;
+	  break;
+	}
+    }
+
+  free (items);
+  return value;
+}
+
+void
+sketch_destroy (sketch_t * const s)
+{
+  for (unsigned int h = 0; h < s->nlevels; ++h)
+    free (s->levels[h].items);
+  free (s->levels);
+  s->levels = NULL;
+  s->nlevels = 0;
+}
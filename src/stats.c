@@ -0,0 +1,154 @@
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "stats.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *const phase_names[STATS_NPHASES] = {
+  "read", "parse", "evaluate", "range", "bin", "render", "write"
+};
+
+static const char *const counter_names[STATS_NCOUNTERS] = {
+  "cycles", "instructions", "cache_misses"
+};
+
+static double
+clock_seconds (const clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime (clock, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+open_counter (const enum stats_counter counter)
+{
+#ifdef __linux__
+  static const uint64_t configs[STATS_NCOUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES
+  };
+
+  struct perf_event_attr attr;
+  memset (&attr, 0, sizeof attr);
+  attr.size = sizeof attr;
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = configs[counter];
+  attr.exclude_kernel = 1;	/* allowed at the default perf_event_paranoid level */
+  attr.exclude_hv = 1;
+  attr.inherit = 1;		/* count worker threads too */
+
+  return syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  (void) counter;
+  return -1;
+#endif
+}
+
+static uint64_t
+read_counter (const int fd)
+{
+  uint64_t value = 0;
+  if (fd < 0 || read (fd, &value, sizeof value) != sizeof value)
+    return 0;
+
+  return value;
+}
+
+void
+stats_init (stats_t * const stats)
+{
+  if (!stats)
+    return;
+
+  memset (stats, 0, sizeof *stats);
+  for (int i = 0; i < STATS_NCOUNTERS; ++i)
+    stats->counter_fds[i] = open_counter (i);
+
+  stats_begin (stats);
+}
+
+void
+stats_begin (stats_t * const stats)
+{
+  if (!stats)
+    return;
+
+  stats->start_wall = clock_seconds (CLOCK_MONOTONIC);
+  stats->start_cpu = clock_seconds (CLOCK_PROCESS_CPUTIME_ID);
+  for (int i = 0; i < STATS_NCOUNTERS; ++i)
+    stats->start_counters[i] = read_counter (stats->counter_fds[i]);
+}
+
+/* Charges everything since the last stats_begin or stats_end to phase. */
+void
+stats_end (stats_t * const stats, const enum stats_phase phase)
+{
+  if (!stats)
+    return;
+
+  struct stats_phase_totals *const t = &stats->phases[phase];
+  const double wall = clock_seconds (CLOCK_MONOTONIC);
+  const double cpu = clock_seconds (CLOCK_PROCESS_CPUTIME_ID);
+
+  ++t->calls;
+  t->wall += wall - stats->start_wall;
+  t->cpu += cpu - stats->start_cpu;
+  stats->start_wall = wall;
+  stats->start_cpu = cpu;
+
+  for (int i = 0; i < STATS_NCOUNTERS; ++i)
+    {
+      const uint64_t value = read_counter (stats->counter_fds[i]);
+      t->counters[i] += value - stats->start_counters[i];
+      stats->start_counters[i] = value;
+    }
+}
+
+void
+stats_report (const stats_t * const stats, FILE * const stream)
+{
+  if (!stats)
+    return;
+
+  for (int i = 0; i < STATS_NPHASES; ++i)
+    {
+      const struct stats_phase_totals *const t = &stats->phases[i];
+      if (!t->calls)
+	continue;
+
+      fprintf (stream, "stats phase=%s calls=%zu wall_ms=%.3f cpu_ms=%.3f",
+	       phase_names[i], t->calls, t->wall * 1e3, t->cpu * 1e3);
+      for (int j = 0; j < STATS_NCOUNTERS; ++j)
+	if (stats->counter_fds[j] >= 0)
+	  fprintf (stream, " %s=%llu", counter_names[j],
+		   (unsigned long long) t->counters[j]);
+      fputc ('\n', stream);
+    }
+
+  struct rusage usage;
+  const long peak_rss_kb =
+    getrusage (RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+
+  fprintf (stream,
+	   "stats points_read=%zu points_dropped=%zu bytes_emitted=%zu "
+	   "peak_rss_kb=%ld hardware_counters=%s\n", stats->points_read,
+	   stats->points_dropped, stats->bytes_emitted, peak_rss_kb,
+	   stats->counter_fds[0] >= 0 ? "yes" : "no");
+}
+
+void
+stats_destroy (stats_t * const stats)
+{
+  if (!stats)
+    return;
+
+  for (int i = 0; i < STATS_NCOUNTERS; ++i)
+    if (stats->counter_fds[i] >= 0)
+      close (stats->counter_fds[i]);
+}
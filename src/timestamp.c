@@ -0,0 +1,184 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "timestamp.h"
+
+#define SECONDS_PER_DAY 86400
+
+/* Days from 1970-01-01 to a date of the proleptic Gregorian calendar, counting
+ * in 400-year eras that start on March 1st so leap days fall last */
+static int64_t
+days_from_civil (int64_t y, const unsigned int m, const unsigned int d)
+{
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned int yoe = (unsigned int) (y - era * 400);
+  const unsigned int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t) doe - 719468;
+}
+
+static void
+civil_from_days (int64_t z, int64_t * const y, unsigned int *const m,
+		 unsigned int *const d)
+{
+  z += 719468;
+  const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const unsigned int doe = (unsigned int) (z - era * 146097);
+  const unsigned int yoe =
+    (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned int mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = (int64_t) yoe + era * 400 + (*m <= 2);
+}
+
+static unsigned int
+days_in_month (const unsigned int year, const unsigned int month)
+{
+  static const unsigned char days[12] = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+  };
+  const bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+  return month == 2 && leap ? 29 : days[month - 1];
+}
+
+/* Reads exactly n digits */
+static inline bool
+digits (const char *const p, const char *const end, const int n,
+	unsigned int *const value)
+{
+  if (end - p < n)
+    return false;
+
+  unsigned int v = 0;
+  for (int i = 0; i < n; ++i)
+    {
+      const unsigned int digit = (unsigned char) p[i] - '0';
+      if (digit > 9)
+	return false;
+      v = v * 10 + digit;
+    }
+
+  *value = v;
+  return true;
+}
+
+/* p has at least the ten characters of a date */
+static const char *
+parse_iso (const char *p, const char *const end, double *const seconds)
+{
+  unsigned int year, month, day;
+  if (!digits (p, end, 4, &year) || p[4] != '-'
+      || !digits (p + 5, end, 2, &month) || p[7] != '-'
+      || !digits (p + 8, end, 2, &day)
+      || month < 1 || month > 12 || day < 1
+      || day > days_in_month (year, month))
+    return NULL;
+  p += 10;
+
+  unsigned int hour = 0, minute = 0, second = 0;
+  double fraction = 0;
+  if (end - p >= 6 && (*p == 'T' || *p == ' ')
+      && digits (p + 1, end, 2, &hour) && p[3] == ':'
+      && digits (p + 4, end, 2, &minute))
+    {
+      p += 6;
+      if (end - p >= 3 && *p == ':' && digits (p + 1, end, 2, &second))
+	{
+	  p += 3;
+	  if (p < end && (*p == '.' || *p == ','))
+	    {
+	      double scale = 0.1;
+	      for (++p; p < end && (unsigned int) (*p - '0') <= 9;
+		   ++p, scale *= 0.1)
+		fraction += (*p - '0') * scale;
+	    }
+	}
+      if (hour > 24 || minute > 59 || second > 60)
+	return NULL;
+    }
+
+  /* Times without an offset are taken as UTC */
+  int offset = 0;
+  if (p < end && *p == 'Z')
+    ++p;
+  else if (end - p >= 3 && (*p == '+' || *p == '-'))
+    {
+      unsigned int hours, minutes = 0;
+      const int sign = *p == '-' ? -1 : 1;
+      if (!digits (p + 1, end, 2, &hours))
+	return NULL;
+      p += 3;
+      if (end - p >= 3 && *p == ':' && digits (p + 1, end, 2, &minutes))
+	p += 3;
+      else if (digits (p, end, 2, &minutes))
+	p += 2;
+      offset = sign * (int) (hours * 3600 + minutes * 60);
+    }
+
+  const int64_t days = days_from_civil (year, month, day);
+  *seconds = (double) (days * SECONDS_PER_DAY + hour * 3600 + minute * 60
+		       + second - offset) + fraction;
+  return p;
+}
+
+const char *
+timestamp_parse (const char *p, const char *const end, double *const seconds)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    ++p;
+
+  return end - p >= 10 && p[4] == '-' ? parse_iso (p, end, seconds) : NULL;
+}
+
+int
+timestamp_format (char *const buf, const size_t size, const double seconds,
+		  const double from, const double to)
+{
+  const double span = to - from;
+  if (!isfinite (seconds))
+    return snprintf (buf, size, "%f", seconds);
+
+  const double whole = floor (seconds);
+  const int64_t days = (int64_t) floor (whole / SECONDS_PER_DAY);
+  const unsigned int of_day =
+    (unsigned int) (whole - (double) days * SECONDS_PER_DAY);
+  const unsigned int milliseconds =
+    (unsigned int) fmin (floor ((seconds - whole) * 1000 + 0.5), 999);
+
+  int64_t year;
+  unsigned int month, day;
+  civil_from_days (days, &year, &month, &day);
+  const unsigned int hour = of_day / 3600, minute = of_day / 60 % 60;
+  const unsigned int second = of_day % 60;
+
+  /* Times of day alone would go back where the range passes midnight, and
+   * minutes alone where it passes the hour */
+  const bool days_differ =
+    floor (from / SECONDS_PER_DAY) != floor (to / SECONDS_PER_DAY);
+  const bool hours_differ = floor (from / 3600) != floor (to / 3600);
+
+  if (span > 120.0 * SECONDS_PER_DAY)
+    return snprintf (buf, size, "%04lld-%02u-%02u", (long long) year, month,
+		     day);
+  else if (span > 120 && (span > 2.0 * SECONDS_PER_DAY || days_differ))
+    return snprintf (buf, size, "%02u-%02u %02u:%02u", month, day, hour,
+		     minute);
+  else if (days_differ && span > 2)
+    return snprintf (buf, size, "%02u-%02u %02u:%02u:%02u", month, day, hour,
+		     minute, second);
+  else if (days_differ)
+    return snprintf (buf, size, "%02u-%02u %02u:%02u:%02u.%03u", month, day,
+		     hour, minute, second, milliseconds);
+  else if (span > 120)
+    return snprintf (buf, size, "%02u:%02u", hour, minute);
+  else if (span > 2)
+    return snprintf (buf, size, "%02u:%02u:%02u", hour, minute, second);
+  else if (hours_differ)
+    return snprintf (buf, size, "%02u:%02u:%02u.%03u", hour, minute, second,
+		     milliseconds);
+  return snprintf (buf, size, "%02u:%02u.%03u", minute, second, milliseconds);
+}
@@ -1,85 +1,134 @@
 #include "tokenizer.h"
 #include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 
-static token_t tok;
-static bool pushed_back = false;
-
 static bool is_defined_function (const char *const s);
 
 void
-push_back_token (const token_t token)
+tokenizer_init (tokenizer_t * const t, const char *const buf,
+		const size_t len)
+{
+  t->buf = buf;
+  t->len = len;
+  t->pos = 0;
+  t->pushed_back = false;
+  t->long_names = false;
+}
+
+void
+push_back_token (tokenizer_t * const t, const token_t token)
+{
+  t->tok = token;
+  t->pushed_back = true;
+}
+
+static inline int
+peek_char (const tokenizer_t * const t)
+{
+  return t->pos < t->len ? (unsigned char) t->buf[t->pos] : EOF;
+}
+
+static inline size_t
+skip_digits (const tokenizer_t * const t, size_t pos)
 {
-  tok = token;
-  pushed_back = true;
+  while (pos < t->len && isdigit ((unsigned char) t->buf[pos]))
+    ++pos;
+
+  return pos;
+}
+
+static token_t
+read_number (tokenizer_t * const t)
+{
+  token_t tok;
+  const size_t start = t->pos;
+  size_t end = skip_digits (t, start);
+
+  if (end < t->len && t->buf[end] == '.')
+    end = skip_digits (t, end + 1);
+
+  if (end < t->len && (t->buf[end] == 'e' || t->buf[end] == 'E'))
+    {
+      size_t exp = end + 1;
+      if (exp < t->len && (t->buf[exp] == '+' || t->buf[exp] == '-'))
+	++exp;
+
+      const size_t exp_end = skip_digits (t, exp);
+      if (exp_end > exp)
+	end = exp_end;
+    }
+
+  /* the buffer need not be NUL-terminated, so strtod works on a copy */
+  const size_t n = end - start;
+  char small[64];
+  char *const copy = n < sizeof small ? small : malloc (n + 1);
+  if (!copy)
+    {
+      tok.type = TOKEN_ERROR;
+      return tok;               /* errno can be examined to determine error */
+    }
+
+  memcpy (copy, t->buf + start, n);
+  copy[n] = '\0';
+
+  char *parsed_end;
+  tok.d = strtod (copy, &parsed_end);
+  tok.type = (parsed_end == copy + n && n > 0) ? TOKEN_NUMBER : TOKEN_ERROR;
+
+  if (copy != small)
+    free (copy);
+
+  t->pos = end;
+  return tok;
 }
 
 token_t
-next_token (FILE * const stream)
+next_token (tokenizer_t * const t)
 {
-  if (pushed_back)
+  if (t->pushed_back)
     {
-      pushed_back = false;
-      return tok;
+      t->pushed_back = false;
+      return t->tok;
     }
 
-  int c;
+  token_t tok;
+
+  while (isspace (peek_char (t)))
+    ++t->pos;
 
-  while (isspace (c = getc (stream)))
-    ;
+  const int c = peek_char (t);
 
   if (c == EOF || c == ';')
     {
+      if (c == ';')
+	++t->pos;
+
       tok.type = TOKEN_END;
       return tok;
     }
 
   if (isalpha (c))
     {
-      size_t size = 16;
-      size_t pos = 0;
-      tok.s = malloc (sizeof (*tok.s) * size);
-      tok.s[pos++] = c;
-      while (isalpha (c = getc (stream)))
-	{
-	  if (pos >= size)
-	    {
-	      size *= 2;
-	      char *const new_buf = realloc (tok.s, size);
-	      if (!new_buf)
-		{
-		  free (tok.s);
-		  tok.type = TOKEN_ERROR;
-		  return tok;	/* let user examine errno to determine that there was no more memory */
-		}
-	      tok.s = new_buf;
-	    }
-
-	  tok.s[pos++] = c;
-	}
-
-      if (pos >= size)
-	{
-	  size += sizeof (*tok.s);
-	  char *const new_buf = realloc (tok.s, size);
-	  if (!new_buf)
-	    {
-	      free (tok.s);
-	      tok.type = TOKEN_ERROR;
-	      return tok;	/* let user examine errno to determine that there was no more memory */
-	    }
-	  tok.s = new_buf;
-	}
-      tok.s[pos++] = '\0';
-
-      if (c != EOF && c != ungetc (c, stream))
+      const size_t start = t->pos;
+      while (isalpha (peek_char (t)) || (t->long_names
+					 && (isdigit (peek_char (t))
+					     || peek_char (t) == '_')))
+	++t->pos;
+
+      const size_t n = t->pos - start;
+      tok.s = malloc (sizeof (*tok.s) * (n + 1));
+      if (!tok.s)
 	{
 	  tok.type = TOKEN_ERROR;
-	  return tok;		/* errno can be examined to determine error */
+	  return tok;           /* let user examine errno to determine that there was no more memory */
 	}
 
+      memcpy (tok.s, t->buf + start, n);
+      tok.s[n] = '\0';
+
       if (is_defined_function (tok.s))
 	tok.type = TOKEN_FUNCTION;
       else
@@ -88,41 +137,28 @@ next_token (FILE * const stream)
       return tok;
     }
   else if (isdigit (c) || c == '.')
+    return read_number (t);
+  else
     {
-      if (c != ungetc (c, stream))
+      ++t->pos;
+      switch (c)
 	{
-	  tok.type = TOKEN_ERROR;
+	case '+':
+	case '-':
+	case '*':
+	case '/':
+	case '(':
+	case ')':
+	case '^':
+	  tok.operator = c;
+	  tok.type = TOKEN_ARITHMETIC_OPERATOR;
 	  return tok;
-	}
-
-      if (fscanf (stream, "%lf", &tok.d) != 1)
-	{
-	  tok.type = TOKEN_ERROR;
+	default:
+	  tok.operator = c;
+	  tok.type = TOKEN_UNKNOWN;
 	  return tok;
 	}
-
-      tok.type = TOKEN_NUMBER;
-
-      return tok;
     }
-  else
-    switch (c)
-      {
-      case '+':
-      case '-':
-      case '*':
-      case '/':
-      case '(':
-      case ')':
-      case '^':
-	tok.operator = c;
-	tok.type = TOKEN_ARITHMETIC_OPERATOR;
-	return tok;
-      default:
-	tok.operator = c;
-	tok.type = TOKEN_UNKNOWN;
-	return tok;
-      }
 }
 
 void
@@ -132,7 +168,7 @@ token_destroy (const token_t token)
     {
     case TOKEN_FUNCTION:
     case TOKEN_STRING:
-      free (tok.s);
+      free (token.s);
       break;
     default:
       break;
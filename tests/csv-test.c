@@ -0,0 +1,79 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/csv.h"
+
+#define NVALUES 200000
+#define MAX_FIELD 64
+
+/* A decimal of up to 25 digits with up to 22 after the point, sometimes signed, padded or with
+ * an exponent, so both the fast path and strtod are taken */
+static void random_decimal(char *const s) {
+  char *p = s;
+  if (rand() % 8 == 0)
+    *p++ = ' ';
+  if (rand() % 3 == 0)
+    *p++ = rand() % 2 ? '-' : '+';
+
+  const int integer = rand() % 20, fraction = rand() % 5 ? rand() % 23 : 0;
+  for (int i = 0; i < integer || (integer == 0 && fraction == 0 && i == 0); ++i)
+    *p++ = '0' + rand() % 10;
+  if (fraction > 0 || rand() % 8 == 0) {
+    *p++ = '.';
+    for (int i = 0; i < fraction; ++i)
+      *p++ = '0' + rand() % 10;
+  }
+  if (rand() % 16 == 0)
+    p += sprintf(p, "e%d", rand() % 600 - 300);
+  *p = '\0';
+}
+
+int main(void) {
+  char (*const fields)[MAX_FIELD] = malloc(NVALUES * sizeof(*fields));
+  char *text;
+  size_t size;
+  FILE *const out = open_memstream(&text, &size);
+  if (!fields || !out) {
+    perror("");
+    return 1;
+  }
+
+  srand(1);
+  for (size_t i = 0; i < NVALUES; ++i) {
+    random_decimal(fields[i]);
+    fprintf(out, "%s,%zu\n", fields[i], i);
+  }
+  /* Lines that are no points are skipped and counted */
+  fputs("1.2.3,0\nabc,0\n,0\n1e,0\n", out);
+  fclose(out);
+
+  struct csv_format format;
+  csv_format_init(&format);
+  FILE *const in = fmemopen(text, size, "r");
+  size_t npoints, nmalformed;
+  point_t *const points = in ? csv_read_points(in, format, &npoints, &nmalformed) : NULL;
+  if (!points) {
+    perror("");
+    return 1;
+  }
+
+  int failures = 0;
+  if (npoints != NVALUES || nmalformed != 4) {
+    fprintf(stderr, "%zu points and %zu malformed lines, expected %d and 4\n", npoints,
+            nmalformed, NVALUES);
+    ++failures;
+  }
+  for (size_t i = 0; i < npoints && i < NVALUES && failures < 10; ++i)
+    if (points[i].x != strtod(fields[i], NULL) || points[i].y != (double) i) {
+      fprintf(stderr, "'%s': read %.17g, strtod %.17g\n", fields[i], points[i].x,
+              strtod(fields[i], NULL));
+      ++failures;
+    }
+
+  fclose(in);
+  free(points);
+  free(text);
+  free(fields);
+  return failures ? 1 : 0;
+}
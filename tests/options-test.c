@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/options.h"
+
+/* The sidecar key of a --file plot given the options in line */
+static void key_of(const char *const line, char *const key, const size_t size) {
+  char text[256], error[256];
+  char *argv[32];
+  struct options o;
+
+  snprintf(text, sizeof text, "%s", line);
+  options_init(&o);
+  const int argc = options_split(text, argv, 32);
+  if (argc < 0 || options_parse(&o, argc, argv, error, sizeof error) != 0) {
+    fprintf(stderr, "%s: %s\n", line, argc < 0 ? "malformed" : error);
+    key[0] = '\0';
+    return;
+  }
+  options_sidecar_key(&o, key, size);
+}
+
+/* Options that change the binned cells must change the key; colours are drawn afresh each run */
+static int check_key(const char *const first, const char *const second, const int differ) {
+  char key1[512], key2[512];
+  key_of(first, key1, sizeof key1);
+  key_of(second, key2, sizeof key2);
+
+  if ((strcmp(key1, key2) != 0) == differ)
+    return 0;
+  fprintf(stderr, "sidecar keys of '%s' and '%s' should %s\n", first, second,
+          differ ? "differ" : "match");
+  return 1;
+}
+
+int main(void) {
+  const char *const base = "--file=f --sidecar";
+  int failures = 0;
+
+  failures += check_key(base, "--file=f --sidecar --x-precision=0", 1);
+  failures += check_key(base, "--file=f --sidecar --y-precision=5", 1);
+  failures += check_key("--file=f --sidecar --y-expr=c2 --math=precise",
+                        "--file=f --sidecar --y-expr=c2 --math=fast", 1);
+  failures += check_key(base, "--file=f --sidecar --columns=81", 1);
+  failures += check_key(base, "--file=f --sidecar --y-min=0", 1);
+  failures += check_key(base, "--file=f --sidecar --mark-color=red --axes-color=blue", 0);
+  failures += check_key(base, base, 0);
+
+  return failures ? 1 : 0;
+}
@@ -1,18 +1,128 @@
 #include <stdio.h>
 #include <errno.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
 #include "../include/parser.h"
+#include "../include/evaluator.h"
+
+#define DEEP_TERMS 100000
 
 void expression_print(const expression_t expression);
 
+/* Checks that s evaluates to expected at x, returning the number of failures. */
+int check_value(const char *const s, const double x, const double expected) {
+  expression_t e = parse_expression(s, strlen(s));
+  const double value = evaluate_expression(e, x);
+  expression_destroy(e);
+  if (value != expected) {
+    fprintf(stderr, "%s at x=%g: %g, expected %g\n", s, x, value, expected);
+    return 1;
+  }
+  return 0;
+}
+
+/* Checks the poles find_expression_range reports over [-10, 10], and that the range reaches
+ * y_max, returning the number of failures. */
+int check_range(const char *const s, const size_t npoles, const double y_max) {
+  expression_t e = parse_expression(s, strlen(s));
+  struct expression_range range;
+  find_expression_range(e, -10, 10, 0, &range);
+  expression_destroy(e);
+  if (range.nsingularities != npoles || range.y_max < y_max) {
+    fprintf(stderr, "%s: %zu poles up to %g, expected %zu up to %g\n", s,
+            range.nsingularities, range.y_max, npoles, y_max);
+    return 1;
+  }
+  return 0;
+}
+
+/* A sum of DEEP_TERMS x's parses into a tree as deep as it is long, which every pass over
+ * it must get through without running out of stack. */
+int check_deep(void) {
+  const size_t len = 2 * DEEP_TERMS - 1;
+  char *const s = malloc(len + 1);
+  if (!s) {
+    perror("");
+    return 1;
+  }
+  for (size_t i = 0; i < len; ++i)
+    s[i] = i % 2 ? '+' : 'x';
+  s[len] = '\0';
+
+  expression_t e = parse_expression(s, len);
+  int failures = 0;
+  if (!check_parser_errors(e) || !check_variables(e)) {
+    fputs("deep sum: does not check\n", stderr);
+    ++failures;
+  }
+
+  const double vars[NVARIABLES] = {[VARIABLE_X] = 2};
+  const dual_t dual = evaluate_expression_dual(e, vars);
+  const interval_t interval_vars[NVARIABLES] = {[VARIABLE_X] = {1, 2}};
+  const interval_t interval = evaluate_expression_interval(e, interval_vars);
+  point_t points[4];
+  sample_expression(e, 0, 4, points, 4);
+  struct expression_range range;
+  if (evaluate_expression(e, 2) != 2.0 * DEEP_TERMS || dual.value != 2.0 * DEEP_TERMS ||
+      dual.first != DEEP_TERMS || interval.lo != DEEP_TERMS || interval.hi != 2.0 * DEEP_TERMS ||
+      points[3].y != 3.0 * DEEP_TERMS || find_expression_range(e, 0, 1, 0, &range) != 0 ||
+      range.y_max != DEEP_TERMS) {
+    fputs("deep sum: wrong value\n", stderr);
+    ++failures;
+  }
+
+  expression_destroy(e);
+  free(s);
+  return failures;
+}
+
+/* Names that are no variable evaluate to NaN, or the empty interval, in every evaluator;
+ * returns the number of failures. */
+int check_unknown(void) {
+  expression_t e = parse_expression("q+x", 3);
+  const double vars[NVARIABLES] = {[VARIABLE_X] = 1};
+  const interval_t interval_vars[NVARIABLES] = {[VARIABLE_X] = {1, 2}};
+  const interval_t interval = evaluate_expression_interval(e, interval_vars);
+  point_t points[4];
+  sample_expression(e, 0, 4, points, 4);
+  const int failed = !isnan(evaluate_expression_vars(e, vars)) ||
+    !isnan(evaluate_expression_dual(e, vars).value) || interval.lo <= interval.hi ||
+    !isnan(points[3].y);
+  expression_destroy(e);
+  if (failed)
+    fputs("q+x: unknown variable has a value\n", stderr);
+  return failed;
+}
+
 int main(void) {
-  for (;;) {
-    expression_t e = next_expression(stdin);
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t len;
+
+  /* - and / associate to the left, ^ to the right */
+  int failures = check_value("x-1-2", 10, 7) + check_value("8/2/2", 0, 2) +
+    check_value("2^3^2", 0, 512) + check_value("x/2*4", 3, 6) + check_deep() +
+    check_unknown();
+
+  /* Cells holding two turns are not poles, and their peaks count */
+  failures += check_range("sin(20*x)", 0, 0.9999) +
+    check_range("sin(x)+sin(2*x)+sin(3*x)+sin(4*x)+sin(5*x)+sin(6*x)+sin(7*x)+sin(8*x)+"
+                "sin(9*x)+sin(10*x)", 0, 7.5) +
+    check_range("sin(x)+0.5*sin(40*x)", 0, 1.49) + check_range("tan(x)", 6, 0) +
+    check_range("1/(x-1)", 1, 0) + check_range("1/x^2", 1, 0);
+  if (failures > 0)
+    return 1;
+
+  while ((len = getline(&line, &size, stdin)) != -1) {
+    expression_t e = parse_expression(line, len);
     expression_print(e);
     putchar('\n');
     expression_destroy(e);
   }
 
+  free(line);
   return 0;
 }
 
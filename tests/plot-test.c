@@ -1,8 +1,8 @@
 #include <stdio.h>
-#include "../include/plot.h"
+#include "../include/plotter.h"
 
 int main(void) {
-  plot_info_t p;
+  plot_info_t p = {0};
   p.nrows = 26;
   p.ncolumns = 42;
   p.y_number_width = 8;
@@ -17,14 +17,15 @@ int main(void) {
   p.x_precision = 3;
   p.x_number_color = RED;
   p.y_number_color = BLUE;
-  p.line_color = PURPLE;
+  p.axes_color = PURPLE;
   p.mark_color = ORANGE;
+  p.mark_char = '+';
 
   point_t points[120];
 
-  for (int i = 0; i < sizeof(points)/sizeof(points[0]); ++i) {
-    points[i].x = i - 60;
-    points[i].y = i - 60;
+  for (size_t i = 0; i < sizeof(points)/sizeof(points[0]); ++i) {
+    points[i].x = i - 60.0;
+    points[i].y = i - 60.0;
   }
 
 
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/reservoir.h"
+
+#define NPOINTS 10000
+#define K 100
+#define BLOCK 37 /* blocks that do not divide the stream, so samples cross them */
+#define NTRIALS 2000
+#define NBUCKETS 10
+/* Each bucket of the stream should get K / NBUCKETS points a sample; a bucket is off by this
+ * fraction of that over all trials some seven standard deviations out. */
+#define MAX_BUCKET_ERROR 0.05
+
+/* Samples the stream 0, 1, ... n - 1 with the seed, offering it a block at a time */
+static point_t *sample(const point_t stream[], const size_t n, const size_t k,
+                       const uint64_t seed, size_t *const nsampled) {
+  reservoir_t r;
+  if (reservoir_init(&r, k, seed) != 0)
+    return NULL;
+  for (size_t i = 0; i < n; i += BLOCK)
+    reservoir_add(&r, stream + i, n - i < BLOCK ? n - i : BLOCK);
+  point_t *const points = reservoir_take(&r, nsampled);
+  reservoir_destroy(&r);
+  return points;
+}
+
+int main(void) {
+  static point_t stream[NPOINTS];
+  for (size_t i = 0; i < NPOINTS; ++i)
+    stream[i] = (point_t) {i, -(double) i};
+
+  int failures = 0;
+  unsigned long buckets[NBUCKETS] = {0};
+  for (uint64_t seed = 1; seed <= NTRIALS && failures == 0; ++seed) {
+    size_t n;
+    point_t *const points = sample(stream, NPOINTS, K, seed, &n);
+    if (!points) {
+      perror("");
+      return 1;
+    }
+
+    /* The sample is k points of the stream, in stream order */
+    if (n != K)
+      ++failures;
+    for (size_t i = 0; i < n; ++i) {
+      const double x = points[i].x;
+      if (x < 0 || x >= NPOINTS || points[i].y != -x || (i > 0 && x <= points[i - 1].x))
+        ++failures;
+      else
+        ++buckets[(size_t) x * NBUCKETS / NPOINTS];
+    }
+    if (failures)
+      fprintf(stderr, "seed %llu: not a sample of the stream\n", (unsigned long long) seed);
+    free(points);
+  }
+
+  const double expected = (double) NTRIALS * K / NBUCKETS;
+  for (size_t b = 0; b < NBUCKETS; ++b)
+    if (buckets[b] < expected * (1 - MAX_BUCKET_ERROR) ||
+        buckets[b] > expected * (1 + MAX_BUCKET_ERROR)) {
+      fprintf(stderr, "bucket %zu: %lu points, expected %g\n", b, buckets[b], expected);
+      ++failures;
+    }
+
+  /* The same seed picks the same sample, and a stream shorter than k is kept whole */
+  size_t n1, n2, n3;
+  point_t *const first = sample(stream, NPOINTS, K, 7, &n1);
+  point_t *const second = sample(stream, NPOINTS, K, 7, &n2);
+  point_t *const whole = sample(stream, K / 2, K, 7, &n3);
+  if (!first || !second || !whole || n1 != n2 || memcmp(first, second, n1 * sizeof(*first)) ||
+      n3 != K / 2 || memcmp(whole, stream, n3 * sizeof(*whole))) {
+    fputs("samples are not repeatable, or a short stream is not kept whole\n", stderr);
+    ++failures;
+  }
+  free(first);
+  free(second);
+  free(whole);
+
+  return failures ? 1 : 0;
+}
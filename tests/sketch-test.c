@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/sketch.h"
+
+#define NVALUES 1000000
+/* The error of a rank is typically well under 1/k of the count; this allows for the worst of
+ * the quantiles checked. */
+#define MAX_RANK_ERROR (2.0 / SKETCH_DEFAULT_K)
+
+static int compare(const void *const a, const void *const b) {
+  const double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* The rank of value among the sorted values, as a fraction of them */
+static double rank_of(const double sorted[], const size_t n, const double value) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (sorted[mid] < value)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return (double) lo / n;
+}
+
+int main(void) {
+  double *const values = malloc(NVALUES * sizeof(*values));
+  sketch_t sketch;
+  if (!values || sketch_init(&sketch, SKETCH_DEFAULT_K) != 0) {
+    perror("");
+    return 1;
+  }
+
+  /* A skewed distribution, so quantiles are not evenly spaced in value */
+  srand(1);
+  for (size_t i = 0; i < NVALUES; ++i) {
+    const double u = rand() / (RAND_MAX + 1.0);
+    values[i] = u * u * u;
+    if (sketch_add(&sketch, values[i]) != 0) {
+      perror("");
+      return 1;
+    }
+  }
+  qsort(values, NVALUES, sizeof(*values), compare);
+
+  int failures = 0;
+  double worst = 0;
+  for (int percent = 1; percent <= 99; ++percent) {
+    const double q = percent / 100.0;
+    const double error = rank_of(values, NVALUES, sketch_quantile(&sketch, q)) - q;
+    if (error > worst || -error > worst)
+      worst = error > 0 ? error : -error;
+    if (error > MAX_RANK_ERROR || -error > MAX_RANK_ERROR) {
+      fprintf(stderr, "p%d: rank off by %g\n", percent, error);
+      ++failures;
+    }
+  }
+  if (sketch_quantile(&sketch, 0) != values[0] || sketch_quantile(&sketch, 1) != values[NVALUES - 1]) {
+    fputs("the extremes are not exact\n", stderr);
+    ++failures;
+  }
+  printf("worst rank error %g over %d values\n", worst, NVALUES);
+
+  sketch_destroy(&sketch);
+  free(values);
+  return failures ? 1 : 0;
+}
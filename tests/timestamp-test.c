@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/timestamp.h"
+
+#define SECONDS_PER_DAY 86400
+#define FIRST_DAY -719528 /* 0000-01-01 */
+#define LAST_DAY 2932896  /* 9999-12-31 */
+
+/* Checks whether s parses as a date, returning the number of failures. */
+static int check_date(const char *const s, const int valid) {
+  double seconds;
+  if ((timestamp_parse(s, s + strlen(s), &seconds) != NULL) == valid)
+    return 0;
+  fprintf(stderr, "%s should %sparse\n", s, valid ? "" : "not ");
+  return 1;
+}
+
+int main(void) {
+  int failures = 0;
+
+  /* Every day formatted as a date parses back to the same day, which takes the conversions
+   * between days and dates both ways. */
+  for (long day = FIRST_DAY; day <= LAST_DAY; ++day) {
+    char date[32];
+    const double seconds = (double) day * SECONDS_PER_DAY;
+    timestamp_format(date, sizeof date, seconds, 0, 1e9);
+
+    double parsed;
+    if (!timestamp_parse(date, date + strlen(date), &parsed) || parsed != seconds) {
+      fprintf(stderr, "day %ld: formatted as %s\n", day, date);
+      if (++failures > 10)
+        return 1;
+    }
+  }
+
+  failures += check_date("1970-01-01", 1) + check_date("2024-02-29", 1) +
+    check_date("2000-02-29", 1) + check_date("2023-02-29", 0) + check_date("1900-02-29", 0) +
+    check_date("2024-02-30", 0) + check_date("2024-04-31", 0) + check_date("2024-12-31", 1) +
+    check_date("2024-13-01", 0) + check_date("2024-01-00", 0);
+
+  return failures ? 1 : 0;
+}